@@ -228,7 +228,7 @@ void Core::App::createRayTracingPipeline() {
 	rtPipelineInfo.maxPipelineRayRecursionDepth = std::max(3U, device.getRTProperties()->maxRayRecursionDepth);
 	rtPipelineInfo.layout = graphicsPipelineLayout;
 
-	vkCreateRayTracingPipelinesKHR(device.getDevice(), {}, {}, 1, & rtPipelineInfo, nullptr, & graphicsPipeline);
+	device.getDispatch().vkCreateRayTracingPipelinesKHR(device.getDevice(), {}, {}, 1, & rtPipelineInfo, nullptr, & graphicsPipeline);
 
 	std::cout << "Creating Shader Binding Table..." << std::endl;
 	createShaderBindingTable(rtPipelineInfo);
@@ -244,7 +244,7 @@ void Core::App::createShaderBindingTable(const VkRayTracingPipelineCreateInfoKHR
 
 	size_t dataSize = handleSize * groupCount;
 	shaderHandles.resize(dataSize);
-	VK_CHECK_RESULT(vkGetRayTracingShaderGroupHandlesKHR(device.getDevice(), graphicsPipeline, 0, groupCount, dataSize, shaderHandles.data()), "failed to get shader shader handles!");
+	VK_CHECK_RESULT(device.getDispatch().vkGetRayTracingShaderGroupHandlesKHR(device.getDevice(), graphicsPipeline, 0, groupCount, dataSize, shaderHandles.data()), "failed to get shader shader handles!");
 
 	auto     alignUp = [](uint32_t size, uint32_t alignment) { return (size + alignment - 1) & ~(alignment - 1); };
 	uint32_t raygenSize = alignUp(handleSize, handleAlignment);
@@ -435,7 +435,7 @@ void Core::App::createAccelerationStructure(VkAccelerationStructureTypeKHR asTyp
 	maxPrimCount[0] = asBuildRangeInfo.primitiveCount;
 
 	VkAccelerationStructureBuildSizesInfoKHR asBuildSize{ .sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_SIZES_INFO_KHR };
-	vkGetAccelerationStructureBuildSizesKHR(device.getDevice(), VK_ACCELERATION_STRUCTURE_BUILD_TYPE_DEVICE_KHR, &asBuildInfo, maxPrimCount.data(), &asBuildSize);
+	device.getDispatch().vkGetAccelerationStructureBuildSizesKHR(device.getDevice(), VK_ACCELERATION_STRUCTURE_BUILD_TYPE_DEVICE_KHR, &asBuildInfo, maxPrimCount.data(), &asBuildSize);
 
 	VkDeviceSize scratchSize = alignUp(asBuildSize.buildScratchSize, device.getAccelProperties()->minAccelerationStructureScratchOffsetAlignment);
 
@@ -456,18 +456,18 @@ void Core::App::createAccelerationStructure(VkAccelerationStructureTypeKHR asTyp
 		.type = asType,
 	};
 
-	vkCreateAccelerationStructureKHR(device.getDevice(), &createInfo, nullptr, &accelStructure.handle);
+	device.getDispatch().vkCreateAccelerationStructureKHR(device.getDevice(), &createInfo, nullptr, &accelStructure.handle);
 
 	VkCommandBuffer cmd = device.beginSingleTimeCommands();
 	asBuildInfo.dstAccelerationStructure = accelStructure.handle;
 	asBuildInfo.scratchData = { .deviceAddress = scratchBuffer.getAddress() };
 
 	VkAccelerationStructureBuildRangeInfoKHR* pBuildRangeInfo = &asBuildRangeInfo;
-	vkCmdBuildAccelerationStructuresKHR(cmd, 1, &asBuildInfo, &pBuildRangeInfo);
+	device.getDispatch().vkCmdBuildAccelerationStructuresKHR(cmd, 1, &asBuildInfo, &pBuildRangeInfo);
 
 	VkAccelerationStructureDeviceAddressInfoKHR info{ .sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_DEVICE_ADDRESS_INFO_KHR,
 													.accelerationStructure = accelStructure.handle };
-	accelStructure.address = vkGetAccelerationStructureDeviceAddressKHR(device.getDevice(), &info);
+	accelStructure.address = device.getDispatch().vkGetAccelerationStructureDeviceAddressKHR(device.getDevice(), &info);
 
 	device.endSingleTimeCommands(cmd);
 
@@ -754,7 +754,7 @@ void Core::App::rayTraceScene() {
 
 		//Call the ray tracing command
 		VkExtent2D size = swapChain->getSwapChainExtent();
-		vkCmdTraceRaysKHR(buffer, &raygenRegion, &missRegion, &hitRegion, &callableRegion, size.width, size.height, 1);
+		device.getDispatch().vkCmdTraceRaysKHR(buffer, &raygenRegion, &missRegion, &hitRegion, &callableRegion, size.width, size.height, 1);
 
 		//The image will later be denoised by DLSS Ray Reconstruction and then upscaled by DLSS Super Resolution
 
@@ -772,19 +772,19 @@ void Core::App::rayTraceScene() {
 void Core::App::destroyStorageImage() {
 	vkDestroyImageView(device.getDevice(), storageImage.imageView, nullptr);
 	vkDestroyImage(device.getDevice(), storageImage.image, nullptr);
-	vkFreeMemory(device.getDevice(), storageImage.imageMemory, nullptr);
+	device.freeMemory(storageImage.imageMemory);
 }
 
 void Core::App::destroyAccelerationStructures() {
 	
-	vkDestroyAccelerationStructureKHR(device.getDevice(), tlasAccel.handle, nullptr);
+	device.getDispatch().vkDestroyAccelerationStructureKHR(device.getDevice(), tlasAccel.handle, nullptr);
 	vkDestroyBuffer(device.getDevice(), tlasAccel.buffer, nullptr);
-	vkFreeMemory(device.getDevice(), tlasAccel.memory, nullptr);
+	device.freeMemory(tlasAccel.memory);
 
 	for (uint32_t i = 0; i < blasAccel.size(); i++) {
-		vkDestroyAccelerationStructureKHR(device.getDevice(), blasAccel[i].handle, nullptr);
+		device.getDispatch().vkDestroyAccelerationStructureKHR(device.getDevice(), blasAccel[i].handle, nullptr);
 		vkDestroyBuffer(device.getDevice(), blasAccel[i].buffer, nullptr);
-		vkFreeMemory(device.getDevice(), blasAccel[i].memory, nullptr);
+		device.freeMemory(blasAccel[i].memory);
 	}
 }
 
@@ -0,0 +1,59 @@
+#include "AliasTable.h"
+#include "Scene.h"
+
+#include <algorithm>
+
+void RayTracing::AliasTable::build(std::span<const float> weights, std::vector<AliasTableEntry>& table) {
+	table.clear();
+
+	double totalWeight = 0.0;
+	for (float weight : weights)
+		totalWeight += std::max(weight, 0.0f);
+	if (weights.empty() || totalWeight <= 0.0) return;
+
+	uint32_t count = static_cast<uint32_t>(weights.size());
+	table.resize(count);
+
+	//weights scaled so that the average slot holds exactly 1
+	std::vector<double> scaled(count);
+	std::vector<uint32_t> small, large;
+	small.reserve(count);
+	large.reserve(count);
+
+	for (uint32_t i = 0; i < count; i++) {
+		double weight = std::max(weights[i], 0.0f);
+		table[i].pmf = static_cast<float>(weight / totalWeight);
+		scaled[i] = weight * count / totalWeight;
+
+		if (scaled[i] < 1.0) small.push_back(i);
+		else large.push_back(i);
+	}
+
+	while (!small.empty() && !large.empty()) {
+		uint32_t less = small.back(); small.pop_back();
+		uint32_t more = large.back();
+
+		table[less].probability = static_cast<float>(scaled[less]);
+		table[less].alias = more;
+
+		//the large element fills the rest of the slot
+		scaled[more] = (scaled[more] + scaled[less]) - 1.0;
+		if (scaled[more] < 1.0) {
+			large.pop_back();
+			small.push_back(more);
+		}
+	}
+
+	//left over entries are 1 up to rounding errors
+	for (uint32_t i : large) {
+		table[i].probability = 1.0f;
+		table[i].alias = i;
+	}
+	for (uint32_t i : small) {
+		table[i].probability = 1.0f;
+		table[i].alias = i;
+	}
+
+	for (AliasTableEntry& entry : table)
+		entry.aliasPmf = table[entry.alias].pmf;
+}
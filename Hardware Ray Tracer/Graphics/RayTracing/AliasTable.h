@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace RayTracing {
+	struct AliasTableEntry;
+
+	/*
+	 * Vose alias table builder
+	 * Every entry splits one slot of the uniform pick between its own element (probability) and an alias.
+	 * Both pmfs are stored with the entry, so sampling reads a single entry. Elements without weight are never picked.
+	 */
+	class AliasTable {
+	public:
+		//table stays empty if the weights sum to zero
+		static void build(std::span<const float> weights, std::vector<AliasTableEntry>& table);
+	};
+}
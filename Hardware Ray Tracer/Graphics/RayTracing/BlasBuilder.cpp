@@ -0,0 +1,298 @@
+#include "BlasBuilder.h"
+
+#include <algorithm>
+
+RayTracing::BlasBuilder::BlasBuilder(Core::Device& device, VkDeviceSize scratchBudget) : device(device), scratchBudget(scratchBudget) {
+	uint32_t familyCount = 0;
+	vkGetPhysicalDeviceQueueFamilyProperties(device.getPhysicalDevice(), &familyCount, nullptr);
+	std::vector<VkQueueFamilyProperties> families(familyCount);
+	vkGetPhysicalDeviceQueueFamilyProperties(device.getPhysicalDevice(), &familyCount, families.data());
+
+	uint32_t validBits = families[device.getQueueFamily(Core::QUEUE_COMPUTE)].timestampValidBits;
+	if (validBits == 0) return;
+
+	timestampPeriod = device.properties.limits.timestampPeriod;
+	timestampMask = validBits >= 64 ? ~0ull : (1ull << validBits) - 1;
+}
+
+RayTracing::BlasBuilder::~BlasBuilder() {
+	device.wait(lastTicket);
+
+	//sources belong to the caller, only the copies that were never handed out are released here
+	for (Compaction& compaction : compactions) {
+		device.wait(compaction.ticket);
+		for (AccelerationStructure& accel : compaction.compacted)
+			destroyAccelerationStructure(accel);
+		vkDestroyQueryPool(device.getDevice(), compaction.queryPool, nullptr);
+	}
+	for (BatchTiming& timing : timings)
+		vkDestroyQueryPool(device.getDevice(), timing.queryPool, nullptr);
+}
+
+Core::GpuTicket RayTracing::BlasBuilder::build(std::vector<BlasBuildInput>& inputs, std::vector<AccelerationStructure>& output, VkBuildAccelerationStructureFlagsKHR flags) {
+	TRACE_ZONE("BlasBuilder::build");
+	auto alignUp = [](auto value, size_t alignment) noexcept { return ((value + alignment - 1) & ~(alignment - 1)); };
+
+	output.resize(inputs.size());
+	if (inputs.empty()) return Core::GpuTicket{};
+
+	const VkDeviceSize scratchAlignment = device.getAccelProperties()->minAccelerationStructureScratchOffsetAlignment;
+
+	std::vector<VkAccelerationStructureBuildGeometryInfoKHR> buildInfos(inputs.size());
+	std::vector<VkDeviceSize> scratchSizes(inputs.size());
+	std::vector<VkDeviceSize> accelSizes(inputs.size());
+	VkDeviceSize totalScratch = 0, maxScratch = 0;
+
+	//query all sizes and create the acceleration structures up front
+	for (size_t i = 0; i < inputs.size(); i++) {
+		buildInfos[i] = VkAccelerationStructureBuildGeometryInfoKHR{
+			.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR,
+			.type = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR,
+			.flags = flags,
+			.mode = VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR,
+			.geometryCount = 1,
+			.pGeometries = &inputs[i].geometry
+		};
+
+		VkAccelerationStructureBuildSizesInfoKHR buildSize{ .sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_SIZES_INFO_KHR };
+		device.getDispatch().vkGetAccelerationStructureBuildSizesKHR(device.getDevice(), VK_ACCELERATION_STRUCTURE_BUILD_TYPE_DEVICE_KHR, &buildInfos[i], &inputs[i].rangeInfo.primitiveCount, &buildSize);
+
+		scratchSizes[i] = alignUp(buildSize.buildScratchSize, scratchAlignment);
+		totalScratch += scratchSizes[i];
+		maxScratch = std::max(maxScratch, scratchSizes[i]);
+		accelSizes[i] = buildSize.accelerationStructureSize;
+
+		AccelerationStructure& accel = output[i];
+		device.createBuffer(buildSize.accelerationStructureSize, VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_STORAGE_BIT_KHR | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &accel.buffer, &accel.memory);
+
+		VkAccelerationStructureCreateInfoKHR createInfo{
+			.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_CREATE_INFO_KHR,
+			.buffer = accel.buffer,
+			.size = buildSize.accelerationStructureSize,
+			.type = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR,
+		};
+		VK_CHECK_RESULT(device.getDispatch().vkCreateAccelerationStructureKHR(device.getDevice(), &createInfo, nullptr, &accel.handle), "failed to create bottom level acceleration structure!");
+
+		VkAccelerationStructureDeviceAddressInfoKHR addressInfo{ .sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_DEVICE_ADDRESS_INFO_KHR,
+																.accelerationStructure = accel.handle };
+		accel.address = device.getDispatch().vkGetAccelerationStructureDeviceAddressKHR(device.getDevice(), &addressInfo);
+
+		buildInfos[i].dstAccelerationStructure = accel.handle;
+	}
+
+	//the arena holds as many builds as the budget allows, but at least the largest single build
+	VkDeviceSize arenaSize = std::max(maxScratch, std::min(totalScratch, scratchBudget));
+
+	if (!scratchArena || scratchArena->getBufferSize() < arenaSize + scratchAlignment) {
+		//builds of the previous call may still use the old arena
+		device.wait(lastTicket);
+		scratchArena = std::make_unique<Core::Buffer>(
+			device,
+			arenaSize + scratchAlignment,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
+		);
+	}
+	VkDeviceAddress scratchAddress = alignUp(scratchArena->getAddress(), scratchAlignment);
+
+	VkQueryPool queryPool = VK_NULL_HANDLE;
+	if (flags & VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_COMPACTION_BIT_KHR) {
+		VkQueryPoolCreateInfo queryPoolInfo{
+			.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+			.queryType = VK_QUERY_TYPE_ACCELERATION_STRUCTURE_COMPACTED_SIZE_KHR,
+			.queryCount = static_cast<uint32_t>(inputs.size())
+		};
+		VK_CHECK_RESULT(vkCreateQueryPool(device.getDevice(), &queryPoolInfo, nullptr, &queryPool), "failed to create compacted size query pool!");
+	}
+
+	//every build of a batch owns a disjoint scratch range, so they need no barriers between each other
+	uint32_t first = 0;
+	VkDeviceSize offset = 0;
+
+	for (uint32_t i = 0; i < inputs.size(); i++) {
+		if (offset + scratchSizes[i] > arenaSize) {
+			lastTicket = buildBatch(buildInfos, inputs, output, first, i - first, offset, queryPool);
+			first = i;
+			offset = 0;
+		}
+
+		buildInfos[i].scratchData = { .deviceAddress = scratchAddress + offset };
+		offset += scratchSizes[i];
+	}
+	lastTicket = buildBatch(buildInfos, inputs, output, first, static_cast<uint32_t>(inputs.size()) - first, offset, queryPool);
+
+	//the compacted sizes are read by update once the builds completed
+	if (queryPool != VK_NULL_HANDLE)
+		compactions.push_back(Compaction{ .queryPool = queryPool, .ticket = lastTicket, .sources = output, .accelSizes = std::move(accelSizes) });
+	return lastTicket;
+}
+
+void RayTracing::BlasBuilder::update(std::vector<CompactedBlas>& completed, Core::GpuProfiler* profiler) {
+	//batches complete in submission order on the compute queue
+	size_t finished = 0;
+	for (; finished < timings.size() && device.isComplete(timings[finished].ticket); finished++) {
+		BatchTiming& timing = timings[finished];
+
+		uint64_t timestamps[2];
+		if (vkGetQueryPoolResults(device.getDevice(), timing.queryPool, 0, 2, sizeof(timestamps), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) == VK_SUCCESS) {
+			float time = static_cast<float>((timestamps[1] - timestamps[0]) & timestampMask) * timestampPeriod * 1e-6f;
+			std::cout << "[INFO] BlasBuilder: Batch " << timing.batch << ": built " << timing.count << " BLAS in " << time << " ms" << std::endl;
+			if (profiler) profiler->addSample("blas build", time);
+		}
+		vkDestroyQueryPool(device.getDevice(), timing.queryPool, nullptr);
+	}
+	timings.erase(timings.begin(), timings.begin() + finished);
+
+	for (auto it = compactions.begin(); it != compactions.end();) {
+		Compaction& compaction = *it;
+		if (!device.isComplete(compaction.ticket)) {
+			it++;
+			continue;
+		}
+
+		if (!compaction.copying) {
+			submitCompaction(compaction);
+			it++;
+			continue;
+		}
+
+		VkDeviceSize totalBefore = 0, totalAfter = 0;
+		uint32_t count = 0;
+		for (size_t i = 0; i < compaction.sources.size(); i++) {
+			//the source was released while the copy was pending
+			if (compaction.sources[i].handle == VK_NULL_HANDLE) {
+				destroyAccelerationStructure(compaction.compacted[i]);
+				continue;
+			}
+
+			completed.push_back(CompactedBlas{ .source = compaction.sources[i], .compacted = compaction.compacted[i], .ticket = compaction.ticket });
+			totalBefore += compaction.accelSizes[i];
+			totalAfter += compaction.compactSizes[i];
+			count++;
+		}
+		vkDestroyQueryPool(device.getDevice(), compaction.queryPool, nullptr);
+		it = compactions.erase(it);
+
+		std::cout << "[INFO] BlasBuilder: Compaction of " << count << " BLAS saved " << (totalBefore - totalAfter) / (1024.0f * 1024.0f) << " MB (" << totalBefore / (1024.0f * 1024.0f) << " MB -> " << totalAfter / (1024.0f * 1024.0f) << " MB)" << std::endl;
+	}
+}
+
+void RayTracing::BlasBuilder::release(const AccelerationStructure& accel) {
+	for (Compaction& compaction : compactions) {
+		for (AccelerationStructure& source : compaction.sources) {
+			if (source.handle != accel.handle) continue;
+
+			//a submitted copy still reads the source
+			if (compaction.copying) device.wait(compaction.ticket);
+			source = AccelerationStructure{};
+			return;
+		}
+	}
+}
+
+Core::GpuTicket RayTracing::BlasBuilder::buildBatch(const std::vector<VkAccelerationStructureBuildGeometryInfoKHR>& buildInfos, const std::vector<BlasBuildInput>& inputs, const std::vector<AccelerationStructure>& output, uint32_t first, uint32_t count, VkDeviceSize scratchUsed, VkQueryPool queryPool) {
+	std::vector<const VkAccelerationStructureBuildRangeInfoKHR*> rangeInfos(count);
+	for (uint32_t i = 0; i < count; i++)
+		rangeInfos[i] = &inputs[first + i].rangeInfo;
+
+	VkCommandBuffer cmd = device.beginSingleTimeCommands(Core::QUEUE_COMPUTE);
+
+	VkQueryPool timestampPool = VK_NULL_HANDLE;
+	if (timestampPeriod > 0.0f) {
+		VkQueryPoolCreateInfo queryPoolInfo{
+			.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+			.queryType = VK_QUERY_TYPE_TIMESTAMP,
+			.queryCount = 2
+		};
+		VK_CHECK_RESULT(vkCreateQueryPool(device.getDevice(), &queryPoolInfo, nullptr, &timestampPool), "failed to create timestamp query pool!");
+		vkCmdResetQueryPool(cmd, timestampPool, 0, 2);
+	}
+
+	//the previous batch may still build into the same scratch ranges
+	VkMemoryBarrier scratchBarrier{
+		.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+		.srcAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_KHR | VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR,
+		.dstAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_KHR | VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR
+	};
+	vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR, 0, 1, &scratchBarrier, 0, VK_NULL_HANDLE, 0, VK_NULL_HANDLE);
+
+	if (timestampPool != VK_NULL_HANDLE) device.getDispatch().vkCmdWriteTimestamp2(cmd, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, timestampPool, 0);
+	device.getDispatch().vkCmdBuildAccelerationStructuresKHR(cmd, count, &buildInfos[first], rangeInfos.data());
+	if (timestampPool != VK_NULL_HANDLE) device.getDispatch().vkCmdWriteTimestamp2(cmd, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, timestampPool, 1);
+
+	if (queryPool != VK_NULL_HANDLE) {
+		//compacted sizes are only valid once the builds have finished writing
+		VkMemoryBarrier barrier{
+			.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+			.srcAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR,
+			.dstAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_KHR
+		};
+		vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR, 0, 1, &barrier, 0, VK_NULL_HANDLE, 0, VK_NULL_HANDLE);
+
+		std::vector<VkAccelerationStructureKHR> handles(count);
+		for (uint32_t i = 0; i < count; i++)
+			handles[i] = output[first + i].handle;
+
+		vkCmdResetQueryPool(cmd, queryPool, first, count);
+		device.getDispatch().vkCmdWriteAccelerationStructuresPropertiesKHR(cmd, count, handles.data(), VK_QUERY_TYPE_ACCELERATION_STRUCTURE_COMPACTED_SIZE_KHR, queryPool, first);
+	}
+
+	Core::GpuTicket ticket = device.submitSingleTimeCommands(cmd, {}, Core::QUEUE_COMPUTE);
+	if (timestampPool != VK_NULL_HANDLE) timings.push_back(BatchTiming{ .queryPool = timestampPool, .ticket = ticket, .batch = batchCount, .count = count });
+
+	std::cout << "[INFO] BlasBuilder: Batch " << batchCount++ << ": submitted " << count << " BLAS using " << scratchUsed / (1024.0f * 1024.0f) << " MB scratch" << std::endl;
+	return ticket;
+}
+
+void RayTracing::BlasBuilder::submitCompaction(Compaction& compaction) {
+	const uint32_t count = static_cast<uint32_t>(compaction.sources.size());
+
+	//the builds completed, so the results are available without waiting
+	compaction.compactSizes.resize(count);
+	VK_CHECK_RESULT(vkGetQueryPoolResults(device.getDevice(), compaction.queryPool, 0, count, compaction.compactSizes.size() * sizeof(VkDeviceSize), compaction.compactSizes.data(), sizeof(VkDeviceSize), VK_QUERY_RESULT_64_BIT), "failed to read compacted acceleration structure sizes!");
+
+	compaction.compacted.resize(count);
+
+	VkCommandBuffer cmd = device.beginSingleTimeCommands(Core::QUEUE_COMPUTE);
+	for (uint32_t i = 0; i < count; i++) {
+		//released before its size was known
+		if (compaction.sources[i].handle == VK_NULL_HANDLE) continue;
+
+		AccelerationStructure& accel = compaction.compacted[i];
+		device.createBuffer(compaction.compactSizes[i], VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_STORAGE_BIT_KHR | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &accel.buffer, &accel.memory);
+
+		VkAccelerationStructureCreateInfoKHR createInfo{
+			.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_CREATE_INFO_KHR,
+			.buffer = accel.buffer,
+			.size = compaction.compactSizes[i],
+			.type = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR,
+		};
+		VK_CHECK_RESULT(device.getDispatch().vkCreateAccelerationStructureKHR(device.getDevice(), &createInfo, nullptr, &accel.handle), "failed to create compacted acceleration structure!");
+
+		VkAccelerationStructureDeviceAddressInfoKHR addressInfo{ .sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_DEVICE_ADDRESS_INFO_KHR,
+																.accelerationStructure = accel.handle };
+		accel.address = device.getDispatch().vkGetAccelerationStructureDeviceAddressKHR(device.getDevice(), &addressInfo);
+
+		VkCopyAccelerationStructureInfoKHR copyInfo{
+			.sType = VK_STRUCTURE_TYPE_COPY_ACCELERATION_STRUCTURE_INFO_KHR,
+			.src = compaction.sources[i].handle,
+			.dst = accel.handle,
+			.mode = VK_COPY_ACCELERATION_STRUCTURE_MODE_COMPACT_KHR
+		};
+		device.getDispatch().vkCmdCopyAccelerationStructureKHR(cmd, &copyInfo);
+	}
+
+	//the builds already completed, waiting on them makes their writes visible to the copies
+	Core::GpuTicket buildTicket = compaction.ticket;
+	compaction.ticket = device.submitSingleTimeCommands(cmd, std::span<const Core::GpuTicket>(&buildTicket, 1), Core::QUEUE_COMPUTE);
+	compaction.copying = true;
+}
+
+void RayTracing::BlasBuilder::destroyAccelerationStructure(AccelerationStructure& accel) {
+	if (accel.handle == VK_NULL_HANDLE) return;
+
+	device.getDispatch().vkDestroyAccelerationStructureKHR(device.getDevice(), accel.handle, nullptr);
+	vkDestroyBuffer(device.getDevice(), accel.buffer, nullptr);
+	device.freeMemory(accel.memory);
+	accel = AccelerationStructure{};
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include "Scene.h"
+#include "../vulkan_core/GpuProfiler.h"
+
+#include <memory>
+#include <vector>
+
+namespace RayTracing {
+
+	struct BlasBuildInput {
+		VkAccelerationStructureGeometryKHR geometry;
+		VkAccelerationStructureBuildRangeInfoKHR rangeInfo;
+	};
+
+	//a finished compaction, source is still owned by the caller and has to be replaced by compacted
+	struct CompactedBlas {
+		AccelerationStructure source;
+		AccelerationStructure compacted;
+		Core::GpuTicket ticket; //of the copy, already completed
+	};
+
+	/*
+	 * Batched bottom level acceleration structure builder
+	 * All build sizes are queried up front, scratch memory is sub-allocated from one shared arena and every
+	 * build that fits into the arena is recorded into the same command buffer. Batches are submitted to the compute
+	 * queue without waiting, a barrier at the start of every batch keeps it from overwriting scratch the previous one still uses.
+	 * The arena is kept for the next build and released once the last submission using it completed.
+	 * Every batch writes a timestamp before and after its builds, update reads them once the batch completed.
+	 * Builds with ALLOW_COMPACTION are followed by a compacted size query. Compaction never blocks: update reads
+	 * the sizes once the build completed, submits the copies into right-sized acceleration structures and hands
+	 * them out once the copies completed. The uncompacted acceleration structures stay usable until then.
+	 */
+	class BlasBuilder {
+	public:
+		static constexpr VkDeviceSize DEFAULT_SCRATCH_BUDGET = 128ULL * 1024 * 1024;
+
+		BlasBuilder(Core::Device& device, VkDeviceSize scratchBudget = DEFAULT_SCRATCH_BUDGET);
+		~BlasBuilder();
+
+		BlasBuilder(const BlasBuilder&) = delete;
+		BlasBuilder operator=(const BlasBuilder&) = delete;
+
+		//creates and builds one acceleration structure per input, output[i] belongs to inputs[i]
+		//the acceleration structures may only be used once the returned ticket is reached
+		Core::GpuTicket build(std::vector<BlasBuildInput>& inputs, std::vector<AccelerationStructure>& output, VkBuildAccelerationStructureFlagsKHR flags);
+		//advances pending compactions and batch timings without waiting, appends the compactions whose copies completed
+		//batch times are added to the "blas build" pass of profiler if there is one
+		void update(std::vector<CompactedBlas>& completed, Core::GpuProfiler* profiler = nullptr);
+		//has to be called before an acceleration structure returned by build is destroyed, drops its pending compaction
+		void release(const AccelerationStructure& accel);
+	private:
+		struct Compaction {
+			VkQueryPool queryPool;
+			Core::GpuTicket ticket; //of the builds until the copies are submitted, then of the copies
+			bool copying = false;
+			std::vector<AccelerationStructure> sources; //null handle once released
+			std::vector<AccelerationStructure> compacted;
+			std::vector<VkDeviceSize> accelSizes;
+			std::vector<VkDeviceSize> compactSizes;
+		};
+
+		struct BatchTiming {
+			VkQueryPool queryPool; //begin and end timestamp
+			Core::GpuTicket ticket;
+			uint32_t batch;
+			uint32_t count;
+		};
+
+		Core::GpuTicket buildBatch(const std::vector<VkAccelerationStructureBuildGeometryInfoKHR>& buildInfos, const std::vector<BlasBuildInput>& inputs, const std::vector<AccelerationStructure>& output, uint32_t first, uint32_t count, VkDeviceSize scratchUsed, VkQueryPool queryPool);
+		void submitCompaction(Compaction& compaction);
+		void destroyAccelerationStructure(AccelerationStructure& accel);
+	private:
+		Core::Device& device;
+		VkDeviceSize scratchBudget;
+		uint32_t batchCount = 0;
+		float timestampPeriod = 0.0f; //ns per tick, 0 if the compute queue has no timestamps
+		uint64_t timestampMask = ~0ull;
+
+		std::unique_ptr<Core::Buffer> scratchArena;
+		Core::GpuTicket lastTicket; //last submission that uses the scratch arena
+		std::vector<Compaction> compactions;
+		std::vector<BatchTiming> timings;
+	};
+}
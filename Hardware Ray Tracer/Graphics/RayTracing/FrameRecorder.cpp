@@ -0,0 +1,53 @@
+#include "FrameRecorder.h"
+
+static void prepareStorageImage(VkCommandBuffer buffer, VkImage image) {
+	//the storage image is shared by all frame slots, so the output of the previous frame may still be reading it
+	//the fences do not cover this, the transfer source stage orders the output before the layout transition on the queue
+	VkImageMemoryBarrier barrier{
+		.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+		.srcAccessMask = 0,
+		.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+		.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+		.newLayout = VK_IMAGE_LAYOUT_GENERAL,
+		.image = image,
+		.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 }
+	};
+
+	vkCmdPipelineBarrier(buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR, 0, 0, VK_NULL_HANDLE, 0, VK_NULL_HANDLE, 1, &barrier);
+}
+
+void RayTracing::recordFrame(VkCommandBuffer buffer, uint32_t frameIndex, const FrameSettings& settings, Scene& scene, Pipeline& pipeline,
+	Core::GpuProfiler& profiler, const char* outputName, const FrameOutput& output) {
+	profiler.beginFrame(buffer, frameIndex);
+
+	//ended before the command buffer
+	Core::GpuProfiler::Scope frameScope(&profiler, buffer, "frame");
+
+	if (scene.update(buffer, frameIndex))
+		pipeline.updateTopLevelAS(scene.getTlas());
+
+	//material edits can require lobes the current variant compiled out
+	pipeline.selectVariant({ .maxDepth = settings.maxDepth, .materialFeatures = scene.getMaterialFeatures() });
+	pipeline.bind(buffer);
+	prepareStorageImage(buffer, pipeline.getRenderOutput().image);
+	pipeline.bindDescriptorSets(buffer, frameIndex);
+
+	uint64_t pixels = static_cast<uint64_t>(settings.extent.width) * settings.extent.height;
+	if (settings.directLighting == DIRECT_LIGHTING_RESTIR) {
+		//one primary ray per pixel
+		Core::GpuProfiler::Scope scope(&profiler, buffer, "reservoirs", pixels);
+		pipeline.traceReservoirs(buffer, settings.extent.width, settings.extent.height);
+	}
+	{
+		//at most one path and one shadow ray per pixel and bounce, an upper bound since paths can end early
+		Core::GpuProfiler::Scope scope(&profiler, buffer, "path tracing", pixels * settings.maxDepth * 2);
+		pipeline.traceRays(buffer, settings.extent.width, settings.extent.height, 1);
+	}
+
+	//DLSS Ray Reconstruction will denoise the image
+	//DLSS Super Resolution will upscale the image
+	{
+		Core::GpuProfiler::Scope scope(&profiler, buffer, outputName);
+		output(buffer);
+	}
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <functional>
+#include "../vulkan_core/GpuProfiler.h"
+
+#include "Scene.h"
+#include "RTPipeline.h"
+
+namespace RayTracing {
+
+	struct FrameSettings {
+		VkExtent2D extent; //of the storage image of the pipeline
+		uint32_t maxDepth; //bounces the pipeline variant is specialized for
+		DirectLighting directLighting;
+	};
+
+	//records what consumes the rendered storage image, it is in VK_IMAGE_LAYOUT_GENERAL and written by ray tracing shaders
+	using FrameOutput = std::function<void(VkCommandBuffer buffer)>;
+
+	/*
+	 * Frame recording shared by RTApp and HeadlessApp
+	 * Records the scene update, the ray tracing passes and the output of one frame into buffer, each inside a
+	 * profiler scope. outputName names the scope of output, e.g. copying to the swap chain or reading the image back.
+	 */
+	void recordFrame(VkCommandBuffer buffer, uint32_t frameIndex, const FrameSettings& settings, Scene& scene, Pipeline& pipeline,
+		Core::GpuProfiler& profiler, const char* outputName, const FrameOutput& output);
+}
@@ -0,0 +1,95 @@
+#include "GpuArray.h"
+
+#include <algorithm>
+#include <cstring>
+
+RayTracing::GpuArray::GpuArray(Core::Device& device, VkDeviceSize stride) : device(device), stride(stride) {
+	//allocated right away so the address can be published before the first upload
+	createBuffer(MIN_CAPACITY);
+}
+
+void RayTracing::GpuArray::markDirty(uint32_t first, uint32_t count) {
+	if (count == 0) return;
+
+	//consecutive edits extend the last range instead of adding a new one
+	if (!ranges.empty() && first >= ranges.back().first && first <= ranges.back().second) {
+		ranges.back().second = std::max(ranges.back().second, first + count);
+		return;
+	}
+	ranges.push_back({ first, first + count });
+}
+
+bool RayTracing::GpuArray::upload(VkCommandBuffer cmd, uint32_t frameIndex, const void* data, uint32_t count, std::vector<std::unique_ptr<Core::Buffer>>& retired) {
+	bool reallocated = false;
+
+	if (count > capacity) {
+		uint32_t newCapacity = capacity;
+		while (newCapacity < count) newCapacity *= 2;
+
+		//the previous frame may still read the old buffer, the new one starts out empty
+		retired.push_back(std::move(buffer));
+		createBuffer(newCapacity);
+
+		ranges.assign(1, { 0, count });
+		reallocated = true;
+	}
+
+	if (ranges.empty()) return reallocated;
+
+	//sort and merge overlapping or touching ranges, elements past count were removed and are dropped
+	std::sort(ranges.begin(), ranges.end());
+	size_t merged = 0;
+	for (size_t i = 0; i < ranges.size(); i++) {
+		uint32_t first = ranges[i].first;
+		uint32_t end = std::min(ranges[i].second, count);
+		if (first >= end) continue;
+
+		if (merged > 0 && first <= ranges[merged - 1].second) ranges[merged - 1].second = std::max(ranges[merged - 1].second, end);
+		else ranges[merged++] = { first, end };
+	}
+	ranges.resize(merged);
+
+	VkDeviceSize uploadSize = 0;
+	for (const auto& [first, end] : ranges)
+		uploadSize += (end - first) * stride;
+
+	if (uploadSize > 0) {
+		std::unique_ptr<Core::Buffer>& stagingBuffer = staging[frameIndex];
+		if (!stagingBuffer || stagingBuffer->getBufferSize() < uploadSize) {
+			VkDeviceSize stagingSize = std::max(uploadSize, stagingBuffer ? stagingBuffer->getBufferSize() * 2 : MIN_CAPACITY * stride);
+			stagingBuffer = std::make_unique<Core::Buffer>(
+				device,
+				stagingSize,
+				VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
+			);
+			stagingBuffer->map();
+		}
+
+		uint8_t* mapped = static_cast<uint8_t*>(stagingBuffer->getMappedMemory());
+		VkDeviceSize offset = 0;
+		for (const auto& [first, end] : ranges) {
+			VkDeviceSize size = (end - first) * stride;
+			memcpy(mapped + offset, static_cast<const uint8_t*>(data) + first * stride, size);
+			regions.push_back(VkBufferCopy{ .srcOffset = offset, .dstOffset = first * stride, .size = size });
+			offset += size;
+		}
+
+		vkCmdCopyBuffer(cmd, stagingBuffer->getBuffer(), buffer->getBuffer(), static_cast<uint32_t>(regions.size()), regions.data());
+	}
+
+	ranges.clear();
+	regions.clear();
+	return reallocated;
+}
+
+void RayTracing::GpuArray::createBuffer(uint32_t newCapacity) {
+	capacity = newCapacity;
+	buffer = std::make_unique<Core::Buffer>(
+		device,
+		capacity * stride,
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT
+	);
+	address = buffer->getAddress();
+}
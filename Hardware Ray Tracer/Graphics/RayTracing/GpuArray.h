@@ -0,0 +1,60 @@
+#pragma once
+
+#include "../vulkan_core/Device.h"
+#include "../vulkan_core/Buffer.h"
+#include "../vulkan_core/SwapChain.h"
+
+#include <array>
+#include <memory>
+#include <vector>
+
+namespace RayTracing {
+
+	/*
+	 * Device local array with capacity headroom
+	 * Edits of the CPU copy are marked as dirty element ranges. upload coalesces them, writes them into the
+	 * persistently mapped staging buffer of the frame slot and records a single vkCmdCopyBuffer with one region
+	 * per range. The device buffer grows geometrically, its address only changes when it reallocates.
+	 */
+	class GpuArray {
+	public:
+		static constexpr uint32_t MIN_CAPACITY = 64;
+
+		GpuArray(Core::Device& device, VkDeviceSize stride);
+
+		GpuArray(const GpuArray&) = delete;
+		GpuArray operator=(const GpuArray&) = delete;
+
+		void markDirty(uint32_t first, uint32_t count = 1);
+
+		//records the copies of all dirty ranges of the first count elements of data into cmd
+		//returns true if the device buffer was reallocated, the replaced buffer is moved into retired
+		bool upload(VkCommandBuffer cmd, uint32_t frameIndex, const void* data, uint32_t count, std::vector<std::unique_ptr<Core::Buffer>>& retired);
+
+		inline bool needsUpload(uint32_t count) const { return !ranges.empty() || count > capacity; }
+		inline VkDeviceAddress getAddress() const { return address; }
+		//view of the first count elements, T has to be the element type the array was created for
+		template<typename T>
+		Core::BufferView<T> getView(uint32_t count) const {
+			assert(stride == sizeof(T) && "GpuArray was created for another element type");
+			assert(count <= capacity && "View exceeds the uploaded elements");
+			return Core::BufferView<T>{ .address = address, .stride = stride, .count = count };
+		}
+		inline uint32_t getCapacity() const { return capacity; }
+	private:
+		void createBuffer(uint32_t newCapacity);
+	private:
+		Core::Device& device;
+		VkDeviceSize stride;
+
+		uint32_t capacity = 0;
+		std::unique_ptr<Core::Buffer> buffer;
+		VkDeviceAddress address = 0;
+
+		//only touched by the host once the fence of its frame slot was waited on
+		std::array<std::unique_ptr<Core::Buffer>, Core::SwapChain::MAX_FRAMES_IN_FLIGHT> staging;
+
+		std::vector<std::pair<uint32_t, uint32_t>> ranges; //dirty [first, end) element ranges in marking order
+		std::vector<VkBufferCopy> regions;
+	};
+}
@@ -0,0 +1,88 @@
+#include "HeadlessApp.h"
+#include "RTApp.h"
+
+RayTracing::HeadlessApp::HeadlessApp(const HeadlessSettings& settings)
+	: settings(settings), device(nullptr), profiler(device), scene(device), target(device, { settings.width, settings.height }) {
+	createDefaultScene(scene);
+	scene.setProfiler(&profiler);
+	scene.build();
+
+	rtPipeline = Pipeline::createPipeline(device, Core::HeadlessTarget::FORMAT, target.getExtent(), scene, maxDepth);
+
+	createCommandBuffers();
+	device.printMemoryStats();
+
+	camera.setView(glm::vec3(0.0f, 0.0f, -2.0f), glm::vec3());
+	camera.setPerspectiveProjection(glm::radians(60.f), target.extentAspectRatio(), 0.001f, 100000.f);
+	prevViewProj = glm::transpose(camera.getProjection() * camera.getView());
+}
+RayTracing::HeadlessApp::~HeadlessApp() {}
+
+void RayTracing::HeadlessApp::run() {
+	TRACE_THREAD_NAME("main");
+	std::cout << "[INFO] HeadlessApp: rendering " << settings.frames << " frames at " << settings.width << "x" << settings.height << std::endl;
+
+	auto startTime = std::chrono::high_resolution_clock::now();
+	for (uint32_t frame = 0; frame < settings.frames; frame++) {
+		TRACE_ZONE("frame");
+		renderFrame(frame);
+	}
+
+	vkDeviceWaitIdle(device.getDevice());
+	float seconds = std::chrono::duration<float, std::chrono::seconds::period>(std::chrono::high_resolution_clock::now() - startTime).count();
+	std::cout << "[INFO] HeadlessApp: " << settings.frames << " frames in " << seconds << " s, " << settings.frames / seconds << " fps" << std::endl;
+
+	if (settings.frames > 0) {
+		//the slot the last frame was rendered to
+		uint32_t lastIndex = (frameIndex + Core::SwapChain::MAX_FRAMES_IN_FLIGHT - 1) % Core::SwapChain::MAX_FRAMES_IN_FLIGHT;
+		target.writeImage(settings.output, lastIndex);
+		std::cout << "[INFO] HeadlessApp: wrote " << settings.output << std::endl;
+	}
+
+	TRACE_EXPORT("trace.json");
+}
+
+void RayTracing::HeadlessApp::createCommandBuffers() {
+	commandBuffers.resize(Core::SwapChain::MAX_FRAMES_IN_FLIGHT);
+
+	VkCommandBufferAllocateInfo allocInfo{};
+	allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	allocInfo.commandPool = device.getCommandPool();
+	allocInfo.commandBufferCount = static_cast<uint32_t>(commandBuffers.size());
+
+	VK_CHECK_RESULT(vkAllocateCommandBuffers(device.getDevice(), &allocInfo, commandBuffers.data()), "failed to allocate command buffers");
+}
+
+void RayTracing::HeadlessApp::renderFrame(uint32_t frame) {
+	target.waitFrame(frameIndex);
+
+	//the camera is static, reprojection sees the same matrix every frame
+	glm::mat4 viewProj = glm::transpose(camera.getProjection() * camera.getView());
+	Uniform uniform{
+		.viewInverse = glm::inverse(glm::transpose(camera.getView())),
+		.projInverse = glm::inverse(glm::transpose(camera.getProjection())),
+		.prevViewProj = prevViewProj,
+		.frame = frame,
+		.depthMax = maxDepth,
+		.directLighting = directLighting
+	};
+	rtPipeline->writeToUniformBuffer(&uniform, frameIndex);
+	prevViewProj = viewProj;
+
+	VkCommandBuffer buffer = commandBuffers[frameIndex];
+	VkCommandBufferBeginInfo beginInfo{
+		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO
+	};
+	VK_CHECK_RESULT(vkBeginCommandBuffer(buffer, &beginInfo), "failed to begin command buffer!");
+
+	FrameSettings frameSettings{ .extent = target.getExtent(), .maxDepth = maxDepth, .directLighting = directLighting };
+	recordFrame(buffer, frameIndex, frameSettings, scene, *rtPipeline, profiler, "readback", [&](VkCommandBuffer cmd) {
+		target.recordReadback(cmd, rtPipeline->getRenderOutput().image, frameIndex);
+	});
+
+	VK_CHECK_RESULT(vkEndCommandBuffer(buffer), "failed to record buffer!");
+	target.submit(buffer, frameIndex);
+
+	frameIndex = (frameIndex + 1) % Core::SwapChain::MAX_FRAMES_IN_FLIGHT;
+}
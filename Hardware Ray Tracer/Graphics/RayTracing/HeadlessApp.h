@@ -0,0 +1,59 @@
+#pragma once
+
+#include <chrono>
+#include <string>
+#include "../Camera.h"
+#include "../vulkan_core/Device.h"
+#include "../vulkan_core/HeadlessTarget.h"
+#include "../vulkan_core/GpuProfiler.h"
+
+#include "Scene.h"
+#include "RTPipeline.h"
+#include "FrameRecorder.h"
+
+namespace RayTracing {
+
+	struct HeadlessSettings {
+		uint32_t width = 1920;
+		uint32_t height = 1080;
+		uint32_t frames = 64;
+		std::string output = "frame.ppm"; //the last frame is written here
+	};
+
+	/*
+	 * Offscreen app
+	 * Renders the demo scene without a window or surface: the device is created headless, the pipeline
+	 * writes into its storage image at the requested resolution and every frame is read back to host memory.
+	 * Runs on machines without a display, like build agents and remote GPU servers.
+	 */
+	class HeadlessApp {
+	public:
+		HeadlessApp(const HeadlessSettings& settings);
+		~HeadlessApp();
+
+		HeadlessApp(const HeadlessApp&) = delete;
+		HeadlessApp operator=(const HeadlessApp&) = delete;
+
+		void run();
+	private:
+		void createCommandBuffers();
+		void renderFrame(uint32_t frame);
+
+	private:
+		HeadlessSettings settings;
+		Core::Device device;
+		Core::GpuProfiler profiler;
+		Core::Camera camera;
+		Scene scene;
+		Core::HeadlessTarget target;
+		std::unique_ptr<Pipeline> rtPipeline;
+
+		std::vector<VkCommandBuffer> commandBuffers;
+
+		DirectLighting directLighting = DIRECT_LIGHTING_RESTIR;
+		uint32_t maxDepth = 2; //bounces the pipeline variant is specialized for
+		glm::mat4 prevViewProj;
+
+		uint32_t frameIndex = 0;
+	};
+}
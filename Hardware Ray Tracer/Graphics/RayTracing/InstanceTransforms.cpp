@@ -0,0 +1,252 @@
+#include "InstanceTransforms.h"
+
+#include <algorithm>
+#include <bit>
+
+#if defined(_M_X64) || defined(__x86_64__) || defined(_M_IX86) || defined(__i386__)
+#define INSTANCE_TRANSFORMS_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define TARGET_AVX2
+#else
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+using Lanes = const float* const*;
+using Block = float[12][RayTracing::InstanceTransforms::BLOCK_SIZE];
+
+static bool supportsAvx2() {
+#if defined(INSTANCE_TRANSFORMS_X86) && defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7) return false;
+
+	//AVX registers have to be saved by the OS
+	__cpuid(info, 1);
+	if (!((info[2] >> 27) & 1) || !((info[2] >> 28) & 1)) return false;
+	if ((_xgetbv(0) & 6) != 6) return false;
+
+	__cpuidex(info, 7, 0);
+	return (info[1] >> 5) & 1;
+#elif defined(INSTANCE_TRANSFORMS_X86)
+	return __builtin_cpu_supports("avx2");
+#else
+	return false;
+#endif
+}
+
+//out[row * 4 + column][lane] of the row major 3x4 matrix T * R * S
+#ifndef INSTANCE_TRANSFORMS_X86
+static void transformBlockScalar(Lanes lanes, uint32_t first, Block& out) {
+	using T = RayTracing::InstanceTransforms;
+
+	for (uint32_t k = 0; k < T::BLOCK_SIZE; k++) {
+		uint32_t i = first + k;
+		float x = lanes[T::ROTATION_X][i], y = lanes[T::ROTATION_Y][i], z = lanes[T::ROTATION_Z][i], w = lanes[T::ROTATION_W][i];
+		float sx = lanes[T::SCALE_X][i], sy = lanes[T::SCALE_Y][i], sz = lanes[T::SCALE_Z][i];
+
+		float xx = x * (x + x), yy = y * (y + y), zz = z * (z + z);
+		float xy = x * (y + y), xz = x * (z + z), yz = y * (z + z);
+		float wx = w * (x + x), wy = w * (y + y), wz = w * (z + z);
+
+		out[0][k] = (1.0f - (yy + zz)) * sx; out[1][k] = (xy - wz) * sy; out[2][k] = (xz + wy) * sz; out[3][k] = lanes[T::POSITION_X][i];
+		out[4][k] = (xy + wz) * sx; out[5][k] = (1.0f - (xx + zz)) * sy; out[6][k] = (yz - wx) * sz; out[7][k] = lanes[T::POSITION_Y][i];
+		out[8][k] = (xz - wy) * sx; out[9][k] = (yz + wx) * sy; out[10][k] = (1.0f - (xx + yy)) * sz; out[11][k] = lanes[T::POSITION_Z][i];
+	}
+}
+#else
+static void transformBlockSse(Lanes lanes, uint32_t first, Block& out) {
+	using T = RayTracing::InstanceTransforms;
+	const __m128 one = _mm_set1_ps(1.0f);
+
+	for (uint32_t half = 0; half < T::BLOCK_SIZE; half += 4) {
+		uint32_t i = first + half;
+		__m128 x = _mm_loadu_ps(lanes[T::ROTATION_X] + i), y = _mm_loadu_ps(lanes[T::ROTATION_Y] + i);
+		__m128 z = _mm_loadu_ps(lanes[T::ROTATION_Z] + i), w = _mm_loadu_ps(lanes[T::ROTATION_W] + i);
+		__m128 sx = _mm_loadu_ps(lanes[T::SCALE_X] + i), sy = _mm_loadu_ps(lanes[T::SCALE_Y] + i), sz = _mm_loadu_ps(lanes[T::SCALE_Z] + i);
+
+		__m128 x2 = _mm_add_ps(x, x), y2 = _mm_add_ps(y, y), z2 = _mm_add_ps(z, z);
+		__m128 xx = _mm_mul_ps(x, x2), yy = _mm_mul_ps(y, y2), zz = _mm_mul_ps(z, z2);
+		__m128 xy = _mm_mul_ps(x, y2), xz = _mm_mul_ps(x, z2), yz = _mm_mul_ps(y, z2);
+		__m128 wx = _mm_mul_ps(w, x2), wy = _mm_mul_ps(w, y2), wz = _mm_mul_ps(w, z2);
+
+		_mm_storeu_ps(out[0] + half, _mm_mul_ps(_mm_sub_ps(one, _mm_add_ps(yy, zz)), sx));
+		_mm_storeu_ps(out[1] + half, _mm_mul_ps(_mm_sub_ps(xy, wz), sy));
+		_mm_storeu_ps(out[2] + half, _mm_mul_ps(_mm_add_ps(xz, wy), sz));
+		_mm_storeu_ps(out[3] + half, _mm_loadu_ps(lanes[T::POSITION_X] + i));
+		_mm_storeu_ps(out[4] + half, _mm_mul_ps(_mm_add_ps(xy, wz), sx));
+		_mm_storeu_ps(out[5] + half, _mm_mul_ps(_mm_sub_ps(one, _mm_add_ps(xx, zz)), sy));
+		_mm_storeu_ps(out[6] + half, _mm_mul_ps(_mm_sub_ps(yz, wx), sz));
+		_mm_storeu_ps(out[7] + half, _mm_loadu_ps(lanes[T::POSITION_Y] + i));
+		_mm_storeu_ps(out[8] + half, _mm_mul_ps(_mm_sub_ps(xz, wy), sx));
+		_mm_storeu_ps(out[9] + half, _mm_mul_ps(_mm_add_ps(yz, wx), sy));
+		_mm_storeu_ps(out[10] + half, _mm_mul_ps(_mm_sub_ps(one, _mm_add_ps(xx, yy)), sz));
+		_mm_storeu_ps(out[11] + half, _mm_loadu_ps(lanes[T::POSITION_Z] + i));
+	}
+}
+
+TARGET_AVX2 static void transformBlockAvx2(Lanes lanes, uint32_t first, Block& out) {
+	using T = RayTracing::InstanceTransforms;
+	const __m256 one = _mm256_set1_ps(1.0f);
+
+	__m256 x = _mm256_loadu_ps(lanes[T::ROTATION_X] + first), y = _mm256_loadu_ps(lanes[T::ROTATION_Y] + first);
+	__m256 z = _mm256_loadu_ps(lanes[T::ROTATION_Z] + first), w = _mm256_loadu_ps(lanes[T::ROTATION_W] + first);
+	__m256 sx = _mm256_loadu_ps(lanes[T::SCALE_X] + first), sy = _mm256_loadu_ps(lanes[T::SCALE_Y] + first), sz = _mm256_loadu_ps(lanes[T::SCALE_Z] + first);
+
+	__m256 x2 = _mm256_add_ps(x, x), y2 = _mm256_add_ps(y, y), z2 = _mm256_add_ps(z, z);
+	__m256 xx = _mm256_mul_ps(x, x2), yy = _mm256_mul_ps(y, y2), zz = _mm256_mul_ps(z, z2);
+	__m256 xy = _mm256_mul_ps(x, y2), xz = _mm256_mul_ps(x, z2), yz = _mm256_mul_ps(y, z2);
+	__m256 wx = _mm256_mul_ps(w, x2), wy = _mm256_mul_ps(w, y2), wz = _mm256_mul_ps(w, z2);
+
+	_mm256_storeu_ps(out[0], _mm256_mul_ps(_mm256_sub_ps(one, _mm256_add_ps(yy, zz)), sx));
+	_mm256_storeu_ps(out[1], _mm256_mul_ps(_mm256_sub_ps(xy, wz), sy));
+	_mm256_storeu_ps(out[2], _mm256_mul_ps(_mm256_add_ps(xz, wy), sz));
+	_mm256_storeu_ps(out[3], _mm256_loadu_ps(lanes[T::POSITION_X] + first));
+	_mm256_storeu_ps(out[4], _mm256_mul_ps(_mm256_add_ps(xy, wz), sx));
+	_mm256_storeu_ps(out[5], _mm256_mul_ps(_mm256_sub_ps(one, _mm256_add_ps(xx, zz)), sy));
+	_mm256_storeu_ps(out[6], _mm256_mul_ps(_mm256_sub_ps(yz, wx), sz));
+	_mm256_storeu_ps(out[7], _mm256_loadu_ps(lanes[T::POSITION_Y] + first));
+	_mm256_storeu_ps(out[8], _mm256_mul_ps(_mm256_sub_ps(xz, wy), sx));
+	_mm256_storeu_ps(out[9], _mm256_mul_ps(_mm256_add_ps(yz, wx), sy));
+	_mm256_storeu_ps(out[10], _mm256_mul_ps(_mm256_sub_ps(one, _mm256_add_ps(xx, yy)), sz));
+	_mm256_storeu_ps(out[11], _mm256_loadu_ps(lanes[T::POSITION_Z] + first));
+}
+#endif
+
+RayTracing::InstanceTransforms::InstanceTransforms() : avx2(supportsAvx2()) {}
+
+uint32_t RayTracing::InstanceTransforms::add(glm::vec3 position, glm::vec3 rotation, glm::vec3 scale) {
+	//lanes grow by whole blocks, padding holds identity transforms
+	if (count % BLOCK_SIZE == 0) {
+		static constexpr float identity[LANE_COUNT] = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f, 1.0f };
+		for (uint32_t lane = 0; lane < LANE_COUNT; lane++)
+			lanes[lane].resize(count + BLOCK_SIZE, identity[lane]);
+		dirty.resize((count + BLOCK_SIZE + 63) / 64, 0);
+	}
+
+	uint32_t index = count++;
+	setPosition(index, position);
+	setRotation(index, rotation);
+	setScale(index, scale);
+	return index;
+}
+
+void RayTracing::InstanceTransforms::remove(uint32_t index) {
+	uint32_t last = --count;
+
+	if (index != last) {
+		for (uint32_t lane = 0; lane < LANE_COUNT; lane++)
+			lanes[lane][index] = lanes[lane][last];
+		markDirty(index);
+	}
+
+	lanes[POSITION_X][last] = lanes[POSITION_Y][last] = lanes[POSITION_Z][last] = 0.0f;
+	lanes[ROTATION_X][last] = lanes[ROTATION_Y][last] = lanes[ROTATION_Z][last] = 0.0f;
+	lanes[ROTATION_W][last] = lanes[SCALE_X][last] = lanes[SCALE_Y][last] = lanes[SCALE_Z][last] = 1.0f;
+	dirty[last >> 6] &= ~(1ULL << (last & 63));
+}
+
+void RayTracing::InstanceTransforms::setPosition(uint32_t index, glm::vec3 position) {
+	lanes[POSITION_X][index] = position.x;
+	lanes[POSITION_Y][index] = position.y;
+	lanes[POSITION_Z][index] = position.z;
+	markDirty(index);
+}
+
+void RayTracing::InstanceTransforms::setRotation(uint32_t index, glm::vec3 rotation) {
+	glm::quat q = glm::angleAxis(rotation.y, glm::vec3(0.0f, 1.0f, 0.0f))
+		* glm::angleAxis(rotation.x, glm::vec3(1.0f, 0.0f, 0.0f))
+		* glm::angleAxis(rotation.z, glm::vec3(0.0f, 0.0f, 1.0f));
+	setRotation(index, q);
+}
+
+void RayTracing::InstanceTransforms::setRotation(uint32_t index, glm::quat rotation) {
+	rotation = glm::normalize(rotation);
+	lanes[ROTATION_X][index] = rotation.x;
+	lanes[ROTATION_Y][index] = rotation.y;
+	lanes[ROTATION_Z][index] = rotation.z;
+	lanes[ROTATION_W][index] = rotation.w;
+	markDirty(index);
+}
+
+void RayTracing::InstanceTransforms::setScale(uint32_t index, glm::vec3 scale) {
+	lanes[SCALE_X][index] = scale.x;
+	lanes[SCALE_Y][index] = scale.y;
+	lanes[SCALE_Z][index] = scale.z;
+	markDirty(index);
+}
+
+glm::vec3 RayTracing::InstanceTransforms::getPosition(uint32_t index) const {
+	return glm::vec3(lanes[POSITION_X][index], lanes[POSITION_Y][index], lanes[POSITION_Z][index]);
+}
+
+glm::quat RayTracing::InstanceTransforms::getRotation(uint32_t index) const {
+	glm::quat rotation;
+	rotation.x = lanes[ROTATION_X][index];
+	rotation.y = lanes[ROTATION_Y][index];
+	rotation.z = lanes[ROTATION_Z][index];
+	rotation.w = lanes[ROTATION_W][index];
+	return rotation;
+}
+
+glm::vec3 RayTracing::InstanceTransforms::getScale(uint32_t index) const {
+	return glm::vec3(lanes[SCALE_X][index], lanes[SCALE_Y][index], lanes[SCALE_Z][index]);
+}
+
+void RayTracing::InstanceTransforms::writeAll(VkAccelerationStructureInstanceKHR* instances) {
+	for (uint32_t first = 0; first < count; first += BLOCK_SIZE)
+		writeBlock(first, 0xFF, instances);
+
+	std::fill(dirty.begin(), dirty.end(), 0);
+}
+
+uint32_t RayTracing::InstanceTransforms::writeDirty(VkAccelerationStructureInstanceKHR* instances, std::vector<uint64_t>& changed) {
+	if (changed.size() < dirty.size()) changed.resize(dirty.size(), 0);
+
+	uint32_t dirtyCount = 0;
+	for (size_t word = 0; word < dirty.size(); word++) {
+		uint64_t bits = dirty[word];
+		if (bits == 0) continue;
+
+		//every set byte of the word is one block
+		for (uint32_t block = 0; block < 64 / BLOCK_SIZE; block++) {
+			uint32_t mask = static_cast<uint32_t>((bits >> (block * BLOCK_SIZE)) & 0xFF);
+			if (mask != 0)
+				writeBlock(static_cast<uint32_t>(word * 64) + block * BLOCK_SIZE, mask, instances);
+		}
+
+		dirtyCount += std::popcount(bits);
+		changed[word] |= bits;
+		dirty[word] = 0;
+	}
+
+	return dirtyCount;
+}
+
+void RayTracing::InstanceTransforms::markDirty(uint32_t index) {
+	dirty[index >> 6] |= 1ULL << (index & 63);
+}
+
+void RayTracing::InstanceTransforms::writeBlock(uint32_t first, uint32_t mask, VkAccelerationStructureInstanceKHR* instances) {
+	const float* lanePointers[LANE_COUNT];
+	for (uint32_t lane = 0; lane < LANE_COUNT; lane++)
+		lanePointers[lane] = lanes[lane].data();
+
+	alignas(32) Block out;
+#ifdef INSTANCE_TRANSFORMS_X86
+	if (avx2) transformBlockAvx2(lanePointers, first, out);
+	else transformBlockSse(lanePointers, first, out);
+#else
+	transformBlockScalar(lanePointers, first, out);
+#endif
+
+	for (uint32_t k = 0; k < BLOCK_SIZE && first + k < count; k++) {
+		if (!((mask >> k) & 1)) continue;
+
+		float* matrix = &instances[first + k].transform.matrix[0][0];
+		for (uint32_t element = 0; element < 12; element++)
+			matrix[element] = out[element][k];
+	}
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "vulkan/vulkan.h"
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <array>
+#include <vector>
+
+namespace RayTracing {
+
+	/*
+	 * Structure of arrays store for instance transformations
+	 * Positions, rotation quaternions and scales live in separate lanes padded to blocks of 8 instances. Changed
+	 * instances are tracked in a dirty bitset and their 3x4 TRS matrices are computed in blocks of 8 (AVX2) or
+	 * 4 (SSE) instances straight into the VkAccelerationStructureInstanceKHR array of the TLAS.
+	 */
+	class InstanceTransforms {
+	public:
+		static constexpr uint32_t BLOCK_SIZE = 8;
+
+		enum Lane : uint32_t {
+			POSITION_X, POSITION_Y, POSITION_Z,
+			ROTATION_X, ROTATION_Y, ROTATION_Z, ROTATION_W,
+			SCALE_X, SCALE_Y, SCALE_Z,
+			LANE_COUNT
+		};
+
+		InstanceTransforms();
+
+		InstanceTransforms(const InstanceTransforms&) = delete;
+		InstanceTransforms operator=(const InstanceTransforms&) = delete;
+
+		uint32_t add(glm::vec3 position, glm::vec3 rotation, glm::vec3 scale);
+		//moves the last instance into the freed slot, matching Scene::destroyInstance
+		void remove(uint32_t index);
+
+		void setPosition(uint32_t index, glm::vec3 position);
+		//euler angles in radians, applied in Y, X, Z order
+		void setRotation(uint32_t index, glm::vec3 rotation);
+		void setRotation(uint32_t index, glm::quat rotation);
+		void setScale(uint32_t index, glm::vec3 scale);
+
+		glm::vec3 getPosition(uint32_t index) const;
+		glm::quat getRotation(uint32_t index) const;
+		glm::vec3 getScale(uint32_t index) const;
+
+		inline uint32_t size() const { return count; }
+		inline bool isDirty(uint32_t index) const { return (dirty[index >> 6] >> (index & 63)) & 1; }
+		inline bool usesAvx2() const { return avx2; }
+
+		//writes the transformation of every instance and clears all dirty bits
+		void writeAll(VkAccelerationStructureInstanceKHR* instances);
+		//writes the transformation of every dirty instance, ORs the dirty bits into changed and clears them
+		//returns the number of dirty instances
+		uint32_t writeDirty(VkAccelerationStructureInstanceKHR* instances, std::vector<uint64_t>& changed);
+	private:
+		void markDirty(uint32_t index);
+		void writeBlock(uint32_t first, uint32_t mask, VkAccelerationStructureInstanceKHR* instances);
+	private:
+		std::array<std::vector<float>, LANE_COUNT> lanes;
+		std::vector<uint64_t> dirty;
+		uint32_t count = 0;
+		bool avx2;
+	};
+}
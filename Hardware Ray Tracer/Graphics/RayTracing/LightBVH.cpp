@@ -0,0 +1,243 @@
+#include "LightBVH.h"
+#include "Scene.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+static constexpr float PI = 3.14159265358979f;
+static constexpr float HALF_PI = PI * 0.5f;
+
+RayTracing::LightBVHBuilder::LightBVHBuilder(Core::ThreadPool& threadPool) : threadPool(threadPool) {}
+
+void RayTracing::LightBVHBuilder::build(std::span<const Light> lights, std::vector<LightBVHNode>& nodes) {
+	TRACE_ZONE("LightBVHBuilder::build");
+	nodes.clear();
+	if (lights.empty()) return;
+
+	//all light types are bounded as omnidirectional emitters until lights carry a direction
+	primitives.resize(lights.size());
+	for (uint32_t i = 0; i < lights.size(); i++) {
+		const Light& light = lights[i];
+		glm::vec3 position(light.pos[0], light.pos[1], light.pos[2]);
+
+		primitives[i] = LightPrimitive{
+			.cluster = {
+				.boundsMin = position,
+				.boundsMax = position,
+				.flux = getLightPower(light),
+				.coneAxis = glm::vec3(0.0f, 0.0f, 1.0f),
+				.coneAngle = PI
+			},
+			.centroid = position,
+			.lightIndex = i
+		};
+	}
+
+	//enough subtrees to keep every worker busy even if the splits are uneven
+	uint32_t lightCount = static_cast<uint32_t>(lights.size());
+	subtreeSize = std::max(MIN_SUBTREE_SIZE, lightCount / (4 * threadPool.getThreadCount()));
+
+	std::vector<Subtree> subtrees;
+	nodes.resize(1);
+	nodes[0] = buildNode(0, lightCount, nodes, lightCount > subtreeSize ? &subtrees : nullptr);
+
+	std::vector<LightBVHNode> subtreeRoots(subtrees.size());
+	std::vector<std::vector<LightBVHNode>> subtreeNodes(subtrees.size());
+	threadPool.parallelFor(static_cast<uint32_t>(subtrees.size()), [&](uint32_t i) {
+		subtreeRoots[i] = buildNode(subtrees[i].first, subtrees[i].count, subtreeNodes[i], nullptr);
+	});
+
+	//child pairs of a subtree are numbered from 0, shift them behind the nodes already placed
+	for (uint32_t i = 0; i < subtrees.size(); i++) {
+		int offset = static_cast<int>(nodes.size());
+
+		for (LightBVHNode& node : subtreeNodes[i]) {
+			if (node.childIndex >= 0) node.childIndex += offset;
+			nodes.push_back(node);
+		}
+
+		if (subtreeRoots[i].childIndex >= 0) subtreeRoots[i].childIndex += offset;
+		nodes[subtrees[i].node] = subtreeRoots[i];
+	}
+}
+
+RayTracing::LightBVHNode RayTracing::LightBVHBuilder::buildNode(uint32_t first, uint32_t count, std::vector<LightBVHNode>& nodes, std::vector<Subtree>* subtrees) {
+	LightCluster cluster = emptyCluster();
+	for (uint32_t i = first; i < first + count; i++)
+		grow(cluster, primitives[i].cluster);
+
+	LightBVHNode node{
+		.bBoxMin = { cluster.boundsMin.x, cluster.boundsMin.y, cluster.boundsMin.z },
+		.bBoxMax = { cluster.boundsMax.x, cluster.boundsMax.y, cluster.boundsMax.z },
+		.totalFlux = cluster.flux,
+		.coneAxis = { cluster.coneAxis.x, cluster.coneAxis.y, cluster.coneAxis.z },
+		.coneAngle = cluster.coneAngle,
+		.childIndex = ~static_cast<int>(primitives[first].lightIndex)
+	};
+	if (count == 1) return node;
+
+	uint32_t leftCount = partition(first, count, cluster);
+	uint32_t pair = static_cast<uint32_t>(nodes.size());
+	nodes.resize(pair + 2);
+
+	uint32_t childFirst[2] = { first, first + leftCount };
+	uint32_t childCount[2] = { leftCount, count - leftCount };
+	for (uint32_t side = 0; side < 2; side++) {
+		if (subtrees && childCount[side] > 1 && childCount[side] <= subtreeSize) {
+			subtrees->push_back(Subtree{ childFirst[side], childCount[side], pair + side });
+			continue;
+		}
+
+		//nodes may grow while building the child
+		LightBVHNode child = buildNode(childFirst[side], childCount[side], nodes, subtrees);
+		nodes[pair + side] = child;
+	}
+
+	node.childIndex = static_cast<int>(pair);
+	return node;
+}
+
+uint32_t RayTracing::LightBVHBuilder::partition(uint32_t first, uint32_t count, const LightCluster& parent) {
+	glm::vec3 centroidMin(std::numeric_limits<float>::max());
+	glm::vec3 centroidMax(std::numeric_limits<float>::lowest());
+	for (uint32_t i = first; i < first + count; i++) {
+		centroidMin = glm::min(centroidMin, primitives[i].centroid);
+		centroidMax = glm::max(centroidMax, primitives[i].centroid);
+	}
+
+	glm::vec3 extent = parent.boundsMax - parent.boundsMin;
+	float maxExtent = std::max({ extent.x, extent.y, extent.z });
+
+	float bestCost = std::numeric_limits<float>::max();
+	int bestAxis = -1;
+	uint32_t bestSplit = 0;
+
+	for (int axis = 0; axis < 3; axis++) {
+		float centroidExtent = centroidMax[axis] - centroidMin[axis];
+		if (centroidExtent <= 0.0f) continue;
+
+		LightCluster bins[BIN_COUNT];
+		uint32_t binCounts[BIN_COUNT] = {};
+		for (uint32_t b = 0; b < BIN_COUNT; b++) bins[b] = emptyCluster();
+
+		for (uint32_t i = first; i < first + count; i++) {
+			uint32_t b = std::min(BIN_COUNT - 1, static_cast<uint32_t>((primitives[i].centroid[axis] - centroidMin[axis]) / centroidExtent * BIN_COUNT));
+			grow(bins[b], primitives[i].cluster);
+			binCounts[b]++;
+		}
+
+		//cost of the lights right of every split, swept from the right
+		float rightCost[BIN_COUNT] = {};
+		uint32_t rightCount[BIN_COUNT] = {};
+		LightCluster right = emptyCluster();
+		uint32_t rightLights = 0;
+		for (uint32_t split = BIN_COUNT - 1; split > 0; split--) {
+			grow(right, bins[split]);
+			rightLights += binCounts[split];
+			rightCost[split] = right.flux * surfaceArea(right) * orientationMeasure(right.coneAngle);
+			rightCount[split] = rightLights;
+		}
+
+		//thin slabs split badly, penalize axes that are short compared to the bounds
+		float regularization = extent[axis] > 0.0f ? maxExtent / extent[axis] : 1.0f;
+
+		LightCluster left = emptyCluster();
+		uint32_t leftLights = 0;
+		for (uint32_t split = 1; split < BIN_COUNT; split++) {
+			grow(left, bins[split - 1]);
+			leftLights += binCounts[split - 1];
+			if (leftLights == 0 || rightCount[split] == 0) continue;
+
+			float cost = regularization * (left.flux * surfaceArea(left) * orientationMeasure(left.coneAngle) + rightCost[split]);
+			if (cost < bestCost) {
+				bestCost = cost;
+				bestAxis = axis;
+				bestSplit = split;
+			}
+		}
+	}
+
+	auto begin = primitives.begin() + first;
+	auto end = begin + count;
+
+	if (bestAxis >= 0) {
+		float centroidExtent = centroidMax[bestAxis] - centroidMin[bestAxis];
+		auto middle = std::partition(begin, end, [&](const LightPrimitive& primitive) {
+			uint32_t b = std::min(BIN_COUNT - 1, static_cast<uint32_t>((primitive.centroid[bestAxis] - centroidMin[bestAxis]) / centroidExtent * BIN_COUNT));
+			return b < bestSplit;
+		});
+		return static_cast<uint32_t>(middle - begin);
+	}
+
+	//all centroids coincide, any split is as good as another
+	return count / 2;
+}
+
+RayTracing::LightBVHBuilder::LightCluster RayTracing::LightBVHBuilder::emptyCluster() {
+	return LightCluster{
+		.boundsMin = glm::vec3(std::numeric_limits<float>::max()),
+		.boundsMax = glm::vec3(std::numeric_limits<float>::lowest()),
+		.flux = 0.0f,
+		.coneAxis = glm::vec3(0.0f, 0.0f, 1.0f),
+		.coneAngle = -1.0f
+	};
+}
+
+void RayTracing::LightBVHBuilder::grow(LightCluster& cluster, const LightCluster& other) {
+	if (other.coneAngle < 0.0f) return;
+
+	cluster.boundsMin = glm::min(cluster.boundsMin, other.boundsMin);
+	cluster.boundsMax = glm::max(cluster.boundsMax, other.boundsMax);
+	cluster.flux += other.flux;
+
+	if (cluster.coneAngle < 0.0f || other.coneAngle >= PI) {
+		cluster.coneAxis = other.coneAxis;
+		cluster.coneAngle = other.coneAngle;
+		return;
+	}
+	if (cluster.coneAngle >= PI) return;
+
+	//smallest cone containing both cones
+	glm::vec3 axisA = cluster.coneAxis, axisB = other.coneAxis;
+	float angleA = cluster.coneAngle, angleB = other.coneAngle;
+	if (angleB > angleA) {
+		std::swap(axisA, axisB);
+		std::swap(angleA, angleB);
+	}
+
+	float angleD = std::acos(std::clamp(glm::dot(axisA, axisB), -1.0f, 1.0f));
+	if (std::min(angleD + angleB, PI) <= angleA) {
+		cluster.coneAxis = axisA;
+		cluster.coneAngle = angleA;
+		return;
+	}
+
+	float angle = (angleA + angleD + angleB) * 0.5f;
+	glm::vec3 rotationAxis = glm::cross(axisA, axisB);
+	if (angle >= PI || glm::dot(rotationAxis, rotationAxis) < 1e-12f) {
+		cluster.coneAxis = axisA;
+		cluster.coneAngle = PI;
+		return;
+	}
+
+	//rotate axisA towards axisB, rotationAxis is perpendicular to axisA
+	float rotation = angle - angleA;
+	rotationAxis = glm::normalize(rotationAxis);
+	cluster.coneAxis = glm::normalize(axisA * std::cos(rotation) + glm::cross(rotationAxis, axisA) * std::sin(rotation));
+	cluster.coneAngle = angle;
+}
+
+float RayTracing::LightBVHBuilder::surfaceArea(const LightCluster& cluster) {
+	glm::vec3 extent = glm::max(cluster.boundsMax - cluster.boundsMin, glm::vec3(0.0f));
+	return 2.0f * (extent.x * extent.y + extent.y * extent.z + extent.z * extent.x);
+}
+
+//solid angle measure of a cone of normals with an emission angle of PI / 2 around every normal
+float RayTracing::LightBVHBuilder::orientationMeasure(float coneAngle) {
+	float angleW = std::min(coneAngle + HALF_PI, PI);
+	float sinAngle = std::sin(coneAngle);
+	float cosAngle = std::cos(coneAngle);
+
+	return 2.0f * PI * (1.0f - cosAngle) + HALF_PI * (2.0f * angleW * sinAngle - std::cos(coneAngle - 2.0f * angleW) - 2.0f * coneAngle * sinAngle + cosAngle);
+}
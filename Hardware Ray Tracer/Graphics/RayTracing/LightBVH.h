@@ -0,0 +1,68 @@
+#pragma once
+
+#include "../ThreadPool.h"
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace RayTracing {
+	struct Light;
+	struct LightBVHNode;
+
+	/*
+	 * Light bounding volume hierarchy builder
+	 * Splits are chosen with the surface area orientation heuristic (SAOH): the flux of both halves weighted by
+	 * the surface area of their bounds and the solid angle measure of their orientation cones, evaluated over
+	 * binned centroids on all three axes. The upper levels are split on the calling thread, the subtrees below
+	 * are built in parallel and appended to the node array afterwards.
+	 * Interior nodes store their two children as a pair at childIndex and childIndex + 1, leaves store ~lightIndex.
+	 */
+	class LightBVHBuilder {
+	public:
+		static constexpr uint32_t BIN_COUNT = 12;
+		static constexpr uint32_t MIN_SUBTREE_SIZE = 256; //smaller subtrees are not worth a job
+
+		LightBVHBuilder(Core::ThreadPool& threadPool);
+
+		LightBVHBuilder(const LightBVHBuilder&) = delete;
+		LightBVHBuilder operator=(const LightBVHBuilder&) = delete;
+
+		//nodes[0] is the root, nodes stays empty without lights
+		void build(std::span<const Light> lights, std::vector<LightBVHNode>& nodes);
+	private:
+		struct LightCluster {
+			glm::vec3 boundsMin;
+			glm::vec3 boundsMax;
+			float flux;
+			glm::vec3 coneAxis;
+			float coneAngle; //negative while the cluster is empty
+		};
+
+		struct LightPrimitive {
+			LightCluster cluster;
+			glm::vec3 centroid;
+			uint32_t lightIndex;
+		};
+
+		struct Subtree {
+			uint32_t first;
+			uint32_t count;
+			uint32_t node; //placeholder node replaced by the root of the subtree
+		};
+
+		LightBVHNode buildNode(uint32_t first, uint32_t count, std::vector<LightBVHNode>& nodes, std::vector<Subtree>* subtrees);
+		uint32_t partition(uint32_t first, uint32_t count, const LightCluster& parent);
+
+		static LightCluster emptyCluster();
+		static void grow(LightCluster& cluster, const LightCluster& other);
+		static float surfaceArea(const LightCluster& cluster);
+		static float orientationMeasure(float coneAngle);
+	private:
+		Core::ThreadPool& threadPool;
+		std::vector<LightPrimitive> primitives;
+		uint32_t subtreeSize = 0;
+	};
+}
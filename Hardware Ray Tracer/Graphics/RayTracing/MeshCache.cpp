@@ -0,0 +1,217 @@
+#include "MeshCache.h"
+#include "Scene.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+RayTracing::MappedFile::MappedFile(const std::string& path) {
+#ifdef _WIN32
+	//shared for writing so MeshCache can refresh the header of a mapped cache
+	HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file == INVALID_HANDLE_VALUE) return;
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+		CloseHandle(file);
+		return;
+	}
+
+	HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (!mapping) {
+		CloseHandle(file);
+		return;
+	}
+
+	data = static_cast<const uint8_t*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+	if (!data) {
+		CloseHandle(mapping);
+		CloseHandle(file);
+		return;
+	}
+
+	size = static_cast<uint64_t>(fileSize.QuadPart);
+	fileHandle = file;
+	mappingHandle = mapping;
+#else
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0) return;
+
+	struct stat fileStat;
+	if (fstat(fd, &fileStat) != 0 || fileStat.st_size == 0) {
+		close(fd);
+		return;
+	}
+
+	void* mapping = mmap(nullptr, static_cast<size_t>(fileStat.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (mapping == MAP_FAILED) return;
+
+	data = static_cast<const uint8_t*>(mapping);
+	size = static_cast<uint64_t>(fileStat.st_size);
+#endif
+}
+
+RayTracing::MappedFile::~MappedFile() {
+	if (!data) return;
+
+#ifdef _WIN32
+	UnmapViewOfFile(data);
+	CloseHandle(mappingHandle);
+	CloseHandle(fileHandle);
+#else
+	munmap(const_cast<uint8_t*>(data), static_cast<size_t>(size));
+#endif
+}
+
+static int64_t sourceWriteTime(const std::string& path) {
+	return static_cast<int64_t>(std::filesystem::last_write_time(path).time_since_epoch().count());
+}
+
+RayTracing::MeshCache::MeshCache(const std::string& sourcePath, uint32_t importFlags) : file(getCachePath(sourcePath)) {
+	valid = validate(sourcePath, importFlags);
+}
+
+std::span<const RayTracing::Vertex> RayTracing::MeshCache::getVertices() const {
+	return { reinterpret_cast<const Vertex*>(file.getData() + header->vertexOffset), static_cast<size_t>(header->vertexCount) };
+}
+
+std::span<const uint32_t> RayTracing::MeshCache::getIndices() const {
+	return { reinterpret_cast<const uint32_t*>(file.getData() + header->indexOffset), static_cast<size_t>(header->indexCount) };
+}
+
+std::string RayTracing::MeshCache::getCachePath(const std::string& sourcePath) {
+	return std::filesystem::path(sourcePath).replace_extension(".bmesh").string();
+}
+
+void RayTracing::MeshCache::write(const std::string& sourcePath, std::span<const Vertex> vertices, std::span<const uint32_t> indices, uint32_t importFlags) {
+	TRACE_ZONE("MeshCache::write");
+	MeshCacheHeader info{
+		.magic = MAGIC,
+		.version = VERSION,
+		.vertexStride = sizeof(Vertex),
+		.indexStride = sizeof(uint32_t),
+		.importFlags = importFlags,
+		.reserved = 0,
+
+		.vertexCount = vertices.size(),
+		.indexCount = indices.size(),
+		.vertexOffset = sizeof(MeshCacheHeader),
+		.indexOffset = sizeof(MeshCacheHeader) + vertices.size_bytes(),
+
+		.boundsMin = { 0.f, 0.f, 0.f },
+		.boundsMax = { 0.f, 0.f, 0.f },
+
+		.sourceSize = static_cast<uint64_t>(std::filesystem::file_size(sourcePath)),
+		.sourceWriteTime = sourceWriteTime(sourcePath),
+		.sourceHash = hashFile(sourcePath)
+	};
+
+	if (!vertices.empty()) {
+		std::copy(vertices[0].pos, vertices[0].pos + 3, info.boundsMin);
+		std::copy(vertices[0].pos, vertices[0].pos + 3, info.boundsMax);
+	}
+	for (const Vertex& vertex : vertices) {
+		for (uint32_t i = 0; i < 3; i++) {
+			info.boundsMin[i] = std::min(info.boundsMin[i], vertex.pos[i]);
+			info.boundsMax[i] = std::max(info.boundsMax[i], vertex.pos[i]);
+		}
+	}
+
+	//write to a temporary file first so an interrupted write never leaves a truncated cache behind
+	std::string cachePath = getCachePath(sourcePath);
+	std::string tempPath = cachePath + ".tmp";
+	{
+		std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+		if (!out.is_open()) throw std::runtime_error("failed to open " + tempPath);
+
+		out.write(reinterpret_cast<const char*>(&info), sizeof(MeshCacheHeader));
+		out.write(reinterpret_cast<const char*>(vertices.data()), vertices.size_bytes());
+		out.write(reinterpret_cast<const char*>(indices.data()), indices.size_bytes());
+
+		if (!out) throw std::runtime_error("failed to write " + tempPath);
+	}
+
+	std::filesystem::rename(tempPath, cachePath);
+}
+
+bool RayTracing::MeshCache::validate(const std::string& sourcePath, uint32_t importFlags) {
+	TRACE_ZONE("MeshCache::validate");
+	if (!file.isOpen() || file.getSize() < sizeof(MeshCacheHeader)) return false;
+
+	header = reinterpret_cast<const MeshCacheHeader*>(file.getData());
+	if (header->magic != MAGIC || header->version != VERSION) return false;
+	if (header->vertexStride != sizeof(Vertex) || header->indexStride != sizeof(uint32_t)) return false;
+	if (header->importFlags != importFlags) return false;
+
+	//vertex and index arrays have to lie completely inside the mapped file
+	if (header->vertexCount > file.getSize() / sizeof(Vertex) || header->indexCount > file.getSize() / sizeof(uint32_t)) return false;
+	if (header->vertexOffset + header->vertexCount * sizeof(Vertex) > file.getSize()) return false;
+	if (header->indexOffset + header->indexCount * sizeof(uint32_t) > file.getSize()) return false;
+	if (header->vertexOffset % alignof(Vertex) != 0 || header->indexOffset % alignof(uint32_t) != 0) return false;
+
+	std::error_code error;
+	uint64_t sourceSize = std::filesystem::file_size(sourcePath, error);
+	if (error || sourceSize != header->sourceSize) return false;
+
+	//only hash the source when its write time changed, e.g. after a checkout that did not modify it
+	int64_t writeTime = sourceWriteTime(sourcePath);
+	if (writeTime == header->sourceWriteTime) return true;
+	if (hashFile(sourcePath) != header->sourceHash) return false;
+
+	//the content is unchanged, the next start can skip the hash again
+	refreshSourceWriteTime(getCachePath(sourcePath), writeTime);
+	return true;
+}
+
+void RayTracing::MeshCache::refreshSourceWriteTime(const std::string& cachePath, int64_t writeTime) {
+	//only the header field is rewritten, the mapped arrays stay untouched
+	std::fstream out(cachePath, std::ios::binary | std::ios::in | std::ios::out);
+	if (out.is_open()) {
+		out.seekp(offsetof(MeshCacheHeader, sourceWriteTime));
+		out.write(reinterpret_cast<const char*>(&writeTime), sizeof(writeTime));
+	}
+
+	//a cache that cannot be updated stays valid, it is only hashed again on the next start
+	if (!out) std::cout << "[WARNING] MeshCache: failed to update the source write time of " << cachePath << std::endl;
+}
+
+uint64_t RayTracing::MeshCache::hashFile(const std::string& path) {
+	std::ifstream in(path, std::ios::binary);
+	if (!in.is_open()) throw std::runtime_error("failed to open " + path);
+
+	std::vector<char> block(1 << 20);
+	uint64_t hash = 0xcbf29ce484222325ULL;
+
+	while (in) {
+		in.read(block.data(), block.size());
+		size_t count = static_cast<size_t>(in.gcount());
+
+		size_t i = 0;
+		for (; i + 8 <= count; i += 8) {
+			uint64_t word;
+			memcpy(&word, block.data() + i, sizeof(word));
+			hash = (hash ^ word) * 0x100000001b3ULL;
+			hash ^= hash >> 29;
+		}
+		for (; i < count; i++)
+			hash = (hash ^ static_cast<uint8_t>(block[i])) * 0x100000001b3ULL;
+	}
+
+	return hash;
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <string>
+
+namespace RayTracing {
+	struct Vertex;
+
+	struct MeshCacheHeader {
+		uint32_t magic;
+		uint32_t version;
+		uint32_t vertexStride; //sizeof(Vertex) at write time, guards against layout changes
+		uint32_t indexStride;
+		uint32_t importFlags; //MeshImportFlags the arrays were produced with
+		uint32_t reserved;
+
+		uint64_t vertexCount;
+		uint64_t indexCount;
+		uint64_t vertexOffset; //byte offset of the vertex array from the start of the file
+		uint64_t indexOffset; //byte offset of the index array from the start of the file
+
+		float boundsMin[3];
+		float boundsMax[3];
+
+		uint64_t sourceSize; //byte size of the source file
+		int64_t sourceWriteTime; //last write time of the source file
+		uint64_t sourceHash; //hash of the source file content
+	};
+
+	class MappedFile {
+	public:
+		MappedFile(const std::string& path);
+		~MappedFile();
+
+		MappedFile(const MappedFile&) = delete;
+		MappedFile operator=(const MappedFile&) = delete;
+
+		inline bool isOpen() const { return data != nullptr; }
+		inline const uint8_t* getData() const { return data; }
+		inline uint64_t getSize() const { return size; }
+	private:
+		const uint8_t* data = nullptr;
+		uint64_t size = 0;
+#ifdef _WIN32
+		void* fileHandle = nullptr;
+		void* mappingHandle = nullptr;
+#endif
+	};
+
+	/*
+	 * Binary mesh cache (<model>.bmesh)
+	 * Stores the imported vertex and index arrays in the RayTracing::Vertex layout. On a warm start the
+	 * file is memory mapped and the arrays are uploaded directly from the mapped pages.
+	 * The cache is stale when the source size changes, its write time changes together with its content hash
+	 * or it was written with different import flags.
+	 */
+	class MeshCache {
+	public:
+		static constexpr uint32_t MAGIC = 0x48534D42; //"BMSH"
+		static constexpr uint32_t VERSION = 2;
+
+		MeshCache(const std::string& sourcePath, uint32_t importFlags);
+
+		MeshCache(const MeshCache&) = delete;
+		MeshCache operator=(const MeshCache&) = delete;
+
+		inline bool isValid() const { return valid; }
+		inline const MeshCacheHeader& getHeader() const { return *header; }
+		std::span<const Vertex> getVertices() const;
+		std::span<const uint32_t> getIndices() const;
+
+		static std::string getCachePath(const std::string& sourcePath);
+		static void write(const std::string& sourcePath, std::span<const Vertex> vertices, std::span<const uint32_t> indices, uint32_t importFlags);
+	private:
+		bool validate(const std::string& sourcePath, uint32_t importFlags);
+		static uint64_t hashFile(const std::string& path);
+		static void refreshSourceWriteTime(const std::string& cachePath, int64_t writeTime);
+	private:
+		MappedFile file;
+		const MeshCacheHeader* header = nullptr;
+		bool valid = false;
+	};
+}
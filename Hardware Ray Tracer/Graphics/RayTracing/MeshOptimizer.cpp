@@ -0,0 +1,125 @@
+#include "MeshOptimizer.h"
+#include "Scene.h"
+
+#include <algorithm>
+
+RayTracing::MeshOptimizationInfo RayTracing::MeshOptimizer::optimize(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices) {
+	TRACE_ZONE("MeshOptimizer::optimize");
+	MeshOptimizationInfo info{};
+	info.fetchSpanBefore = averageFetchSpan(indices);
+
+	std::vector<Vertex> optimizedVertices = vertices;
+	std::vector<uint32_t> optimizedIndices = indices;
+	sortTriangles(optimizedVertices, optimizedIndices);
+	remapVertices(optimizedVertices, optimizedIndices);
+
+	//meshes exported in strip or grid order are often already more coherent than the space filling curve
+	float fetchSpan = averageFetchSpan(optimizedIndices);
+	if (fetchSpan < info.fetchSpanBefore) {
+		vertices.swap(optimizedVertices);
+		indices.swap(optimizedIndices);
+		info.fetchSpanAfter = fetchSpan;
+	} else {
+		info.fetchSpanAfter = info.fetchSpanBefore;
+	}
+
+	return info;
+}
+
+float RayTracing::MeshOptimizer::averageFetchSpan(const std::vector<uint32_t>& indices) {
+	size_t triangleCount = indices.size() / 3;
+	if (triangleCount == 0) return 0.0f;
+
+	double span = 0.0;
+	for (size_t i = 0; i < triangleCount; i++) {
+		uint32_t a = indices[3 * i + 0], b = indices[3 * i + 1], c = indices[3 * i + 2];
+		span += static_cast<double>(std::max({ a, b, c }) - std::min({ a, b, c }));
+	}
+
+	return static_cast<float>(span / triangleCount * sizeof(Vertex));
+}
+
+void RayTracing::MeshOptimizer::sortTriangles(const std::vector<Vertex>& vertices, std::vector<uint32_t>& indices) {
+	size_t triangleCount = indices.size() / 3;
+	if (triangleCount < 2 || vertices.empty()) return;
+
+	glm::vec3 boundsMin(vertices[0].pos[0], vertices[0].pos[1], vertices[0].pos[2]);
+	glm::vec3 boundsMax = boundsMin;
+	for (const Vertex& vertex : vertices) {
+		glm::vec3 pos(vertex.pos[0], vertex.pos[1], vertex.pos[2]);
+		boundsMin = glm::min(boundsMin, pos);
+		boundsMax = glm::max(boundsMax, pos);
+	}
+
+	glm::vec3 extent = boundsMax - boundsMin;
+	glm::vec3 scale(
+		extent.x > 0.0f ? 1.0f / extent.x : 0.0f,
+		extent.y > 0.0f ? 1.0f / extent.y : 0.0f,
+		extent.z > 0.0f ? 1.0f / extent.z : 0.0f);
+
+	//morton code in the upper half, triangle index in the lower half keeps the sort deterministic
+	std::vector<uint64_t> keys(triangleCount);
+	for (size_t i = 0; i < triangleCount; i++) {
+		glm::vec3 centroid(0.0f);
+		for (uint32_t k = 0; k < 3; k++) {
+			const Vertex& vertex = vertices[indices[3 * i + k]];
+			centroid += glm::vec3(vertex.pos[0], vertex.pos[1], vertex.pos[2]);
+		}
+		centroid = (centroid / 3.0f - boundsMin) * scale;
+
+		keys[i] = (static_cast<uint64_t>(mortonCode(centroid.x, centroid.y, centroid.z)) << 32) | static_cast<uint64_t>(i);
+	}
+
+	std::sort(keys.begin(), keys.end());
+
+	std::vector<uint32_t> sorted(indices.size());
+	for (size_t i = 0; i < triangleCount; i++) {
+		size_t triangle = static_cast<size_t>(keys[i] & 0xFFFFFFFFULL);
+		sorted[3 * i + 0] = indices[3 * triangle + 0];
+		sorted[3 * i + 1] = indices[3 * triangle + 1];
+		sorted[3 * i + 2] = indices[3 * triangle + 2];
+	}
+
+	indices.swap(sorted);
+}
+
+void RayTracing::MeshOptimizer::remapVertices(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices) {
+	constexpr uint32_t UNUSED = UINT32_MAX;
+
+	std::vector<uint32_t> remap(vertices.size(), UNUSED);
+	std::vector<Vertex> reordered;
+	reordered.reserve(vertices.size());
+
+	for (uint32_t& index : indices) {
+		if (remap[index] == UNUSED) {
+			remap[index] = static_cast<uint32_t>(reordered.size());
+			reordered.push_back(vertices[index]);
+		}
+		index = remap[index];
+	}
+
+	//keep unreferenced vertices at the end so the vertex count stays the same
+	for (size_t i = 0; i < vertices.size(); i++) {
+		if (remap[i] == UNUSED)
+			reordered.push_back(vertices[i]);
+	}
+
+	vertices.swap(reordered);
+}
+
+uint32_t RayTracing::MeshOptimizer::mortonCode(float x, float y, float z) {
+	auto expandBits = [](uint32_t v) {
+		v = (v * 0x00010001u) & 0xFF0000FFu;
+		v = (v * 0x00000101u) & 0x0F00F00Fu;
+		v = (v * 0x00000011u) & 0xC30C30C3u;
+		v = (v * 0x00000005u) & 0x49249249u;
+		return v;
+	};
+
+	//10 bits per axis
+	uint32_t xi = static_cast<uint32_t>(std::clamp(x * 1024.0f, 0.0f, 1023.0f));
+	uint32_t yi = static_cast<uint32_t>(std::clamp(y * 1024.0f, 0.0f, 1023.0f));
+	uint32_t zi = static_cast<uint32_t>(std::clamp(z * 1024.0f, 0.0f, 1023.0f));
+
+	return (expandBits(xi) << 2) | (expandBits(yi) << 1) | expandBits(zi);
+}
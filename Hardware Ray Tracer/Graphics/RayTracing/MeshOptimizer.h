@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace RayTracing {
+	struct Vertex;
+
+	struct MeshOptimizationInfo {
+		float fetchSpanBefore; //average byte distance between the vertices of a triangle before the pass
+		float fetchSpanAfter; //average byte distance between the vertices of a triangle after the pass
+	};
+
+	/*
+	 * Reorders imported geometry for memory locality
+	 * Triangles are sorted along a Morton curve over their centroids, afterwards vertices are renumbered
+	 * in the order they are first referenced. Neighbouring triangles then fetch neighbouring vertices
+	 * in the hit shader and during BLAS builds. The original order is kept if it already has the smaller fetch span.
+	 */
+	class MeshOptimizer {
+	public:
+		static MeshOptimizationInfo optimize(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices);
+		static float averageFetchSpan(const std::vector<uint32_t>& indices);
+	private:
+		static void sortTriangles(const std::vector<Vertex>& vertices, std::vector<uint32_t>& indices);
+		static void remapVertices(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices);
+		static uint32_t mortonCode(float x, float y, float z);
+	};
+}
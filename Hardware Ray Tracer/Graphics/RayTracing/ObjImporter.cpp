@@ -0,0 +1,522 @@
+#include "ObjImporter.h"
+#include "Scene.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+struct ObjCorner {
+	int v;
+	int vt;
+	int vn;
+};
+
+struct ObjChunk {
+	size_t begin;
+	size_t end;
+
+	uint32_t vCount = 0;
+	uint32_t vnCount = 0;
+	uint32_t vtCount = 0;
+	uint32_t vBase = 0;
+	uint32_t vnBase = 0;
+	uint32_t vtBase = 0;
+
+	std::vector<ObjCorner> corners; //three corners per triangle
+	std::vector<RayTracing::Vertex> uniqueVertices; //first occurrence order inside the chunk
+	std::vector<uint32_t> localIndices;
+	std::vector<uint32_t> hashes; //of uniqueVertices
+	std::vector<std::vector<uint32_t>> partitions; //unique vertices per merge partition, ascending
+	std::vector<uint32_t> remap; //chunk local vertex -> merge key of its first occurrence in the file
+	size_t uniqueBase = 0; //merge key of uniqueVertices[0], keys number all chunk unique vertices in file order
+	size_t vertexBase = 0; //mesh vertices first seen in earlier chunks
+	size_t indexOffset = 0;
+};
+
+struct ObjAttributes {
+	std::vector<float> v;
+	std::vector<float> vn;
+	std::vector<float> vt;
+};
+
+// open addressing table (linear probing) keyed on the full position/normal/uv tuple
+class VertexTable {
+public:
+	VertexTable(size_t expectedCount) {
+		size_t capacity = 16;
+		while (capacity < expectedCount * 2)
+			capacity <<= 1;
+
+		slots.assign(capacity, Slot{ 0, EMPTY });
+	}
+
+	uint32_t findOrInsert(const RayTracing::Vertex& vertex, std::vector<RayTracing::Vertex>& storage) {
+		return findOrInsert(vertex, hashVertex(vertex), storage);
+	}
+
+	uint32_t findOrInsert(const RayTracing::Vertex& vertex, uint32_t hash, std::vector<RayTracing::Vertex>& storage) {
+		size_t mask = slots.size() - 1;
+
+		for (size_t i = hash & mask;; i = (i + 1) & mask) {
+			Slot& slot = slots[i];
+
+			if (slot.index == EMPTY) {
+				uint32_t index = static_cast<uint32_t>(storage.size());
+				storage.push_back(vertex);
+				slot = Slot{ hash, index };
+
+				if (storage.size() * 2 > slots.size())
+					grow();
+
+				return index;
+			}
+
+			if (slot.hash == hash && storage[slot.index] == vertex)
+				return slot.index;
+		}
+	}
+
+	static uint32_t hashVertex(const RayTracing::Vertex& vertex) {
+		uint64_t h = 0x9e3779b97f4a7c15ULL;
+
+		for (uint32_t i = 0; i < 8; i++) {
+			//adding +0 folds -0 into +0 so the hash agrees with Vertex::operator==
+			float value = (i < 3 ? vertex.pos[i] : i < 6 ? vertex.normal[i - 3] : vertex.uv[i - 6]) + 0.0f;
+			uint32_t bits;
+			memcpy(&bits, &value, sizeof(bits));
+
+			h ^= bits;
+			h *= 0xff51afd7ed558ccdULL;
+			h ^= h >> 32;
+		}
+
+		return static_cast<uint32_t>(h);
+	}
+private:
+	struct Slot {
+		uint32_t hash;
+		uint32_t index;
+	};
+
+	static constexpr uint32_t EMPTY = UINT32_MAX;
+
+	void grow() {
+		std::vector<Slot> old = std::move(slots);
+		slots.assign(old.size() * 2, Slot{ 0, EMPTY });
+		size_t mask = slots.size() - 1;
+
+		for (const Slot& slot : old) {
+			if (slot.index == EMPTY)
+				continue;
+
+			size_t i = slot.hash & mask;
+			while (slots[i].index != EMPTY)
+				i = (i + 1) & mask;
+			slots[i] = slot;
+		}
+	}
+private:
+	std::vector<Slot> slots;
+};
+
+static inline bool isSpace(char c) { return c == ' ' || c == '\t'; }
+static inline bool isDigit(char c) { return c >= '0' && c <= '9'; }
+static inline bool isTokenEnd(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+static inline bool isIndexEnd(char c) { return c == '/' || isTokenEnd(c); }
+
+static inline void skipSpace(const char*& token, const char* end) {
+	while (token < end && isSpace(*token)) token++;
+}
+
+// same grammar and arithmetic as tinyobj's tryParseDouble so both loaders produce bit identical floats
+static bool tryParseDouble(const char* s, const char* sEnd, double* result) {
+	if (s >= sEnd) return false;
+
+	double mantissa = 0.0;
+	int exponent = 0;
+	char sign = '+';
+	char expSign = '+';
+	const char* curr = s;
+	int read = 0;
+
+	if (*curr == '+' || *curr == '-') {
+		sign = *curr;
+		curr++;
+	}
+	else if (!isDigit(*curr)) return false;
+
+	while (curr != sEnd && isDigit(*curr)) {
+		mantissa *= 10;
+		mantissa += static_cast<int>(*curr - 0x30);
+		curr++;
+		read++;
+	}
+
+	if (read == 0) return false;
+
+	if (curr != sEnd && *curr == '.') {
+		static const double powLut[] = { 1.0, 0.1, 0.01, 0.001, 0.0001, 0.00001, 0.000001, 0.0000001 };
+		const int lutEntries = sizeof(powLut) / sizeof(powLut[0]);
+
+		curr++;
+		read = 1;
+		while (curr != sEnd && isDigit(*curr)) {
+			mantissa += static_cast<int>(*curr - 0x30) * (read < lutEntries ? powLut[read] : std::pow(10.0, -read));
+			read++;
+			curr++;
+		}
+	}
+	else if (curr == sEnd || (*curr != 'e' && *curr != 'E')) {
+		*result = (sign == '+' ? 1 : -1) * mantissa;
+		return true;
+	}
+
+	if (curr != sEnd && (*curr == 'e' || *curr == 'E')) {
+		curr++;
+		if (curr != sEnd && (*curr == '+' || *curr == '-')) {
+			expSign = *curr;
+			curr++;
+		}
+		else if (curr == sEnd || !isDigit(*curr)) return false;
+
+		read = 0;
+		while (curr != sEnd && isDigit(*curr)) {
+			exponent *= 10;
+			exponent += static_cast<int>(*curr - 0x30);
+			curr++;
+			read++;
+		}
+		exponent *= (expSign == '+' ? 1 : -1);
+		if (read == 0) return false;
+	}
+
+	*result = (sign == '+' ? 1 : -1) * (exponent ? std::ldexp(mantissa * std::pow(5.0, exponent), exponent) : mantissa);
+	return true;
+}
+
+static float parseReal(const char*& token, const char* end, double defaultValue = 0.0) {
+	skipSpace(token, end);
+	const char* tokenEnd = token;
+	while (tokenEnd < end && !isTokenEnd(*tokenEnd)) tokenEnd++;
+
+	double value = defaultValue;
+	tryParseDouble(token, tokenEnd, &value);
+	token = tokenEnd;
+	return static_cast<float>(value);
+}
+
+// behaves like atoi followed by skipping the rest of the index
+static int parseIndex(const char*& token, const char* end) {
+	const char* curr = token;
+	bool negative = false;
+	int value = 0;
+
+	if (curr < end && (*curr == '+' || *curr == '-')) {
+		negative = *curr == '-';
+		curr++;
+	}
+	while (curr < end && isDigit(*curr)) {
+		value = value * 10 + (*curr - '0');
+		curr++;
+	}
+
+	while (token < end && !isIndexEnd(*token)) token++;
+	return negative ? -value : value;
+}
+
+// 1 based and negative (relative) OBJ indices to 0 based, -1 marks a missing attribute
+static inline int fixIndex(int index, int count) {
+	if (index > 0) return index - 1;
+	if (index == 0) return 0;
+	return count + index;
+}
+
+static ObjCorner parseCorner(const char*& token, const char* end, int vCount, int vnCount, int vtCount) {
+	ObjCorner corner{ -1, -1, -1 };
+
+	corner.v = fixIndex(parseIndex(token, end), vCount);
+	if (token >= end || *token != '/') return corner;
+	token++;
+
+	// i//k
+	if (token < end && *token == '/') {
+		token++;
+		corner.vn = fixIndex(parseIndex(token, end), vnCount);
+		return corner;
+	}
+
+	// i/j/k or i/j
+	corner.vt = fixIndex(parseIndex(token, end), vtCount);
+	if (token >= end || *token != '/') return corner;
+	token++;
+
+	corner.vn = fixIndex(parseIndex(token, end), vnCount);
+	return corner;
+}
+
+// calls lineCallback(lineStart, lineEnd) for every non empty line in [begin, end) with leading whitespace and trailing '\r' stripped
+template <typename Callback>
+static void forEachLine(const char* begin, const char* end, Callback lineCallback) {
+	while (begin < end) {
+		const char* lineEnd = static_cast<const char*>(memchr(begin, '\n', end - begin));
+		const char* next = lineEnd ? lineEnd + 1 : end;
+		if (!lineEnd) lineEnd = end;
+		if (lineEnd > begin && lineEnd[-1] == '\r') lineEnd--;
+
+		const char* token = begin;
+		skipSpace(token, lineEnd);
+		if (token < lineEnd && *token != '#')
+			lineCallback(token, lineEnd);
+
+		begin = next;
+	}
+}
+
+static void countAttributes(const char* data, ObjChunk& chunk) {
+	forEachLine(data + chunk.begin, data + chunk.end, [&chunk](const char* token, const char* end) {
+		if (end - token < 2 || token[0] != 'v') return;
+
+		if (isSpace(token[1])) chunk.vCount++;
+		else if (end - token >= 3 && token[1] == 'n' && isSpace(token[2])) chunk.vnCount++;
+		else if (end - token >= 3 && token[1] == 't' && isSpace(token[2])) chunk.vtCount++;
+	});
+}
+
+static void parseChunk(const char* data, ObjChunk& chunk, ObjAttributes& attributes) {
+	float* v = attributes.v.data() + 3 * static_cast<size_t>(chunk.vBase);
+	float* vn = attributes.vn.data() + 3 * static_cast<size_t>(chunk.vnBase);
+	float* vt = attributes.vt.data() + 2 * static_cast<size_t>(chunk.vtBase);
+	uint32_t vCount = 0, vnCount = 0, vtCount = 0;
+
+	std::vector<ObjCorner> face;
+
+	forEachLine(data + chunk.begin, data + chunk.end, [&](const char* token, const char* end) {
+		if (end - token < 2) return;
+
+		if (token[0] == 'v' && isSpace(token[1])) {
+			token += 2;
+			for (uint32_t i = 0; i < 3; i++)
+				v[3 * vCount + i] = parseReal(token, end);
+			vCount++;
+			return;
+		}
+
+		if (token[0] == 'v' && end - token >= 3 && token[1] == 'n' && isSpace(token[2])) {
+			token += 3;
+			for (uint32_t i = 0; i < 3; i++)
+				vn[3 * vnCount + i] = parseReal(token, end);
+			vnCount++;
+			return;
+		}
+
+		if (token[0] == 'v' && end - token >= 3 && token[1] == 't' && isSpace(token[2])) {
+			token += 3;
+			for (uint32_t i = 0; i < 2; i++)
+				vt[2 * vtCount + i] = parseReal(token, end);
+			vtCount++;
+			return;
+		}
+
+		if (token[0] == 'f' && isSpace(token[1])) {
+			token += 2;
+			skipSpace(token, end);
+
+			face.clear();
+			while (token < end && *token != '\r') {
+				face.push_back(parseCorner(token, end,
+					static_cast<int>(chunk.vBase + vCount),
+					static_cast<int>(chunk.vnBase + vnCount),
+					static_cast<int>(chunk.vtBase + vtCount)));
+				while (token < end && isTokenEnd(*token)) token++;
+			}
+
+			//polygon -> triangle fan
+			for (size_t k = 2; k < face.size(); k++) {
+				chunk.corners.push_back(face[0]);
+				chunk.corners.push_back(face[k - 1]);
+				chunk.corners.push_back(face[k]);
+			}
+		}
+	});
+}
+
+static void deduplicateChunk(ObjChunk& chunk, const ObjAttributes& attributes) {
+	const int vTotal = static_cast<int>(attributes.v.size() / 3);
+	const int vnTotal = static_cast<int>(attributes.vn.size() / 3);
+	const int vtTotal = static_cast<int>(attributes.vt.size() / 2);
+
+	VertexTable table(chunk.corners.size() / 4);
+	chunk.localIndices.reserve(chunk.corners.size());
+
+	for (const ObjCorner& corner : chunk.corners) {
+		if (corner.v >= vTotal || corner.vn >= vnTotal || corner.vt >= vtTotal)
+			throw std::runtime_error("face index out of range");
+
+		RayTracing::Vertex vertex{};
+		if (corner.v >= 0) {
+			vertex.pos[0] = attributes.v[3 * corner.v + 0];
+			vertex.pos[1] = -attributes.v[3 * corner.v + 1];
+			vertex.pos[2] = attributes.v[3 * corner.v + 2];
+		}
+
+		if (corner.vn >= 0) {
+			vertex.normal[0] = attributes.vn[3 * corner.vn + 0];
+			vertex.normal[1] = -attributes.vn[3 * corner.vn + 1];
+			vertex.normal[2] = attributes.vn[3 * corner.vn + 2];
+		}
+
+		if (corner.vt >= 0) {
+			vertex.uv[0] = attributes.vt[2 * corner.vt + 0];
+			vertex.uv[1] = attributes.vt[2 * corner.vt + 1];
+		}
+
+		chunk.localIndices.push_back(table.findOrInsert(vertex, chunk.uniqueVertices));
+	}
+
+	std::vector<ObjCorner>().swap(chunk.corners);
+}
+
+RayTracing::ObjImporter::ObjImporter(Core::ThreadPool& pool) : pool(pool) {}
+
+void RayTracing::ObjImporter::load(const std::string& path, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices) {
+	TRACE_ZONE("ObjImporter::load");
+	std::ifstream file(path, std::ios::ate | std::ios::binary);
+	if (!file.is_open()) throw std::runtime_error("Cannot open file [" + path + "]");
+
+	std::string data(static_cast<size_t>(file.tellg()), '\0');
+	file.seekg(0);
+	file.read(data.data(), data.size());
+	file.close();
+
+	//split the file into line aligned chunks, a few per worker to balance uneven line lengths
+	uint32_t chunkCount = std::max(1U, pool.getThreadCount() * 4);
+	size_t chunkSize = std::max<size_t>(data.size() / chunkCount, 1);
+
+	std::vector<ObjChunk> chunks;
+	for (size_t begin = 0; begin < data.size();) {
+		size_t end = std::min(begin + chunkSize, data.size());
+		size_t newline = data.find('\n', end > 0 ? end - 1 : 0);
+		end = newline == std::string::npos ? data.size() : newline + 1;
+
+		ObjChunk chunk{};
+		chunk.begin = begin;
+		chunk.end = end;
+		chunks.push_back(std::move(chunk));
+		begin = end;
+	}
+
+	//pass 1: count attributes per chunk so every chunk knows its global attribute offsets
+	pool.parallelFor(static_cast<uint32_t>(chunks.size()), [&](uint32_t i) { countAttributes(data.data(), chunks[i]); });
+
+	ObjAttributes attributes;
+	uint32_t vTotal = 0, vnTotal = 0, vtTotal = 0;
+	for (ObjChunk& chunk : chunks) {
+		chunk.vBase = vTotal;
+		chunk.vnBase = vnTotal;
+		chunk.vtBase = vtTotal;
+		vTotal += chunk.vCount;
+		vnTotal += chunk.vnCount;
+		vtTotal += chunk.vtCount;
+	}
+	attributes.v.resize(3 * static_cast<size_t>(vTotal));
+	attributes.vn.resize(3 * static_cast<size_t>(vnTotal));
+	attributes.vt.resize(2 * static_cast<size_t>(vtTotal));
+
+	//pass 2: parse attributes straight into their global slots and triangulate faces
+	pool.parallelFor(static_cast<uint32_t>(chunks.size()), [&](uint32_t i) { parseChunk(data.data(), chunks[i], attributes); });
+	std::string().swap(data);
+
+	//pass 3: deduplicate every chunk on its own
+	pool.parallelFor(static_cast<uint32_t>(chunks.size()), [&](uint32_t i) { deduplicateChunk(chunks[i], attributes); });
+
+	//pass 4: merge chunk local vertices across chunks
+	//every chunk unique vertex gets a merge key in file order, the key of the first occurrence of a vertex decides its mesh index
+	size_t uniqueCount = 0, indexCount = 0;
+	for (ObjChunk& chunk : chunks) {
+		chunk.uniqueBase = uniqueCount;
+		chunk.indexOffset = indexCount;
+		uniqueCount += chunk.uniqueVertices.size();
+		indexCount += chunk.localIndices.size();
+	}
+
+	//the high hash bits pick the partition, the tables of the partitions probe with the low bits
+	uint32_t partitionBits = 0;
+	while ((1U << partitionBits) < pool.getThreadCount() * 4 && partitionBits < 8) partitionBits++;
+	const uint32_t partitionCount = 1U << partitionBits;
+	auto partitionOf = [partitionBits](uint32_t hash) { return partitionBits ? hash >> (32 - partitionBits) : 0U; };
+
+	//pass 4a: hash and bucket the unique vertices of every chunk
+	pool.parallelFor(static_cast<uint32_t>(chunks.size()), [&](uint32_t i) {
+		ObjChunk& chunk = chunks[i];
+		chunk.hashes.resize(chunk.uniqueVertices.size());
+		chunk.partitions.resize(partitionCount);
+		chunk.remap.resize(chunk.uniqueVertices.size());
+
+		for (uint32_t j = 0; j < chunk.uniqueVertices.size(); j++) {
+			chunk.hashes[j] = VertexTable::hashVertex(chunk.uniqueVertices[j]);
+			chunk.partitions[partitionOf(chunk.hashes[j])].push_back(j);
+		}
+	});
+
+	//pass 4b: every worker owns a partition and visits its vertices in file order, so the first insert of a vertex is its first occurrence
+	std::vector<uint8_t> firstOccurrence(uniqueCount, 0); //by merge key
+	pool.parallelFor(partitionCount, [&](uint32_t partition) {
+		size_t expectedCount = 0;
+		for (const ObjChunk& chunk : chunks)
+			expectedCount += chunk.partitions[partition].size();
+
+		std::vector<Vertex> storage;
+		std::vector<size_t> keys; //merge key of the first occurrence of storage[i]
+		storage.reserve(expectedCount / 2);
+		keys.reserve(expectedCount / 2);
+		VertexTable table(expectedCount / 2);
+
+		for (ObjChunk& chunk : chunks) {
+			for (uint32_t j : chunk.partitions[partition]) {
+				uint32_t index = table.findOrInsert(chunk.uniqueVertices[j], chunk.hashes[j], storage);
+				if (index == keys.size()) {
+					keys.push_back(chunk.uniqueBase + j);
+					firstOccurrence[chunk.uniqueBase + j] = 1;
+				}
+				chunk.remap[j] = static_cast<uint32_t>(keys[index]);
+			}
+		}
+	});
+
+	//pass 4c: count first occurrences per chunk, their prefix sum is the mesh index the chunk starts writing at
+	pool.parallelFor(static_cast<uint32_t>(chunks.size()), [&](uint32_t i) {
+		ObjChunk& chunk = chunks[i];
+		chunk.vertexBase = std::count(firstOccurrence.begin() + chunk.uniqueBase, firstOccurrence.begin() + chunk.uniqueBase + chunk.uniqueVertices.size(), 1);
+	});
+
+	size_t vertexCount = 0;
+	for (ObjChunk& chunk : chunks) {
+		size_t count = chunk.vertexBase;
+		chunk.vertexBase = vertexCount;
+		vertexCount += count;
+	}
+
+	//pass 4d: write first occurrences to the mesh in file order
+	vertices.resize(vertexCount);
+	std::vector<uint32_t> meshIndices(uniqueCount); //by merge key, only valid for first occurrences
+	pool.parallelFor(static_cast<uint32_t>(chunks.size()), [&](uint32_t i) {
+		ObjChunk& chunk = chunks[i];
+		size_t next = chunk.vertexBase;
+		for (size_t j = 0; j < chunk.uniqueVertices.size(); j++) {
+			if (!firstOccurrence[chunk.uniqueBase + j]) continue;
+
+			meshIndices[chunk.uniqueBase + j] = static_cast<uint32_t>(next);
+			vertices[next++] = chunk.uniqueVertices[j];
+		}
+	});
+
+	//pass 5: rewrite chunk local indices into the mesh index buffer
+	indices.resize(indexCount);
+	pool.parallelFor(static_cast<uint32_t>(chunks.size()), [&](uint32_t i) {
+		const ObjChunk& chunk = chunks[i];
+		for (size_t j = 0; j < chunk.localIndices.size(); j++)
+			indices[chunk.indexOffset + j] = meshIndices[chunk.remap[chunk.localIndices[j]]];
+	});
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include "../ThreadPool.h"
+#include <string>
+#include <vector>
+
+namespace RayTracing {
+	struct Vertex;
+
+	/*
+	 * Parallel Wavefront OBJ importer
+	 * The file is split into line aligned chunks which are parsed and deduplicated on the thread pool.
+	 * Per chunk results are merged in file order, so the produced vertices and indices are identical
+	 * to a sequential import (first occurrence order, fan triangulation, y axis flipped).
+	 */
+	class ObjImporter {
+	public:
+		ObjImporter(Core::ThreadPool& pool);
+
+		void load(const std::string& path, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices);
+	private:
+		Core::ThreadPool& pool;
+	};
+}
@@ -1,26 +1,39 @@
 #include "RTApp.h"
+#include "../vulkan_core/StagingRing.h"
 
-RayTracing::RTApp::RTApp() : window({800, 600, "Bloon RT Engine v0.1.2 | DLSS 4", false}), device(&window), scene(device) {
-	scene.loadModel("models/Plane.obj");
+void RayTracing::createDefaultScene(Scene& scene) {
+	MeshHandle plane = scene.loadModel("models/Plane.obj");
 
-	scene.createMaterial(glm::vec3(1.f, 1.f, 1.f), 1.0f);
-	scene.createMaterial(glm::vec3(1.f, 1.f, 1.f), 1.0f, 0.0f);
+	MaterialHandle rough = scene.createMaterial(glm::vec3(1.f, 1.f, 1.f), 1.0f);
+	MaterialHandle mirror = scene.createMaterial(glm::vec3(1.f, 1.f, 1.f), 1.0f, 0.0f);
 	
 	scene.createLight(glm::vec3(1.f, 0.f, 0.f), glm::vec3(0.0f, 0.0f, 1.0f), 2.0f);
 	scene.createLight(glm::vec3(-1.f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f), 2.0f);
 	scene.createLight(glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(1.0f, 0.0f, 0.0f), 2.0f);
 
-	scene.createInstance(0, 1, glm::vec3(0.f, -1.f, 0.f), glm::vec3(), glm::vec3(1.0f, 1.0f, 1.0f));
-	scene.createInstance(0, 0, glm::vec3(0.f, 1.f, 0.f), glm::vec3(), glm::vec3(4.0f, 1.0f, 4.0f));
+	scene.createInstance(plane, mirror, glm::vec3(0.f, -1.f, 0.f), glm::vec3(), glm::vec3(1.0f, 1.0f, 1.0f));
+	scene.createInstance(plane, rough, glm::vec3(0.f, 1.f, 0.f), glm::vec3(), glm::vec3(4.0f, 1.0f, 4.0f));
 
+	scene.setBlasCompaction(true);
+}
+
+RayTracing::RTApp::RTApp() : window({800, 600, "Bloon RT Engine v0.1.2 | DLSS 4", false}), device(&window), profiler(device), scene(device) {
+	createDefaultScene(scene);
+	scene.setProfiler(&profiler);
 	scene.build();
 
 	recreateSwapChain();
-	rtPipeline = Pipeline::createPipeline(device, swapChain, scene);
+	rtPipeline = Pipeline::createPipeline(device, swapChain, scene, maxDepth);
+#ifdef _DEBUG
+	shaderReloader = std::make_unique<ShaderReloader>(*rtPipeline);
+#endif
 	
-	BUILD("Command Buffer Build", 0, 1, "Creating command buffers...");
 	createCommandBuffers();
-	BUILD("Command Buffer Build", 1, 1, "Command buffers created!");
+	device.printMemoryStats();
+	std::cout << "[INFO] StagingRing: " << device.getStagingRing().getSubmissionCount() << " upload submissions during setup" << std::endl;
+#ifdef BENCHMARK_DISPATCH
+	Core::benchmarkDispatch(device);
+#endif
 
 	camera.setView(glm::vec3(0.0f, 0.0f, -2.0f), glm::vec3());
 }
@@ -29,7 +42,10 @@ RayTracing::RTApp::~RTApp() {}
 void RayTracing::RTApp::run() {
 	auto currentTime = std::chrono::high_resolution_clock::now();
 
+	TRACE_THREAD_NAME("main");
+
 	while (!window.shouldClose()) {
+		TRACE_ZONE("frame");
 		glfwPollEvents();
 
 		auto newTime = std::chrono::high_resolution_clock::now();
@@ -40,15 +56,23 @@ void RayTracing::RTApp::run() {
 		float aspectRatio = swapChain->extentAspectRatio();
 		camera.setPerspectiveProjection(glm::radians(60.f), aspectRatio, 0.001f, 100000.f);
 
+		//reservoirs are reprojected with the camera of the previous frame
+		glm::mat4 viewProj = glm::transpose(camera.getProjection() * camera.getView());
+		if (firstFrame) prevViewProj = viewProj;
+
 		//update uniform buffer
 		Uniform uniform{
 			.viewInverse = glm::inverse(glm::transpose(camera.getView())),
 			.projInverse = glm::inverse(glm::transpose(camera.getProjection())),
+			.prevViewProj = prevViewProj,
 			.frame = imageIndex,
-			.depthMax = 2
+			.depthMax = maxDepth,
+			.directLighting = directLighting
 		};
 
 		rtPipeline->writeToUniformBuffer(&uniform, frameIndex);
+		prevViewProj = viewProj;
+		firstFrame = false;
 
 		//render scene
 		rayTraceScene();
@@ -56,6 +80,7 @@ void RayTracing::RTApp::run() {
 	}
 
 	vkDeviceWaitIdle(device.getDevice());
+	TRACE_EXPORT("trace.json");
 }
 
 void RayTracing::RTApp::createCommandBuffers() {
@@ -70,20 +95,6 @@ void RayTracing::RTApp::createCommandBuffers() {
 	VK_CHECK_RESULT(vkAllocateCommandBuffers(device.getDevice(), &allocInfo, commandBuffers.data()), "failed to allocate command buffers");
 }
 
-void RayTracing::RTApp::prepareStorageImage(VkCommandBuffer buffer) {
-	VkImageMemoryBarrier barrier{
-		.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
-		.srcAccessMask = 0,
-		.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
-		.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
-		.newLayout = VK_IMAGE_LAYOUT_GENERAL,
-		.image = rtPipeline->getRenderOutput().image,
-		.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 }
-	};
-
-	vkCmdPipelineBarrier(buffer, 0, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR, 0, 0, VK_NULL_HANDLE, 0, VK_NULL_HANDLE, 1, &barrier);
-}
-
 void RayTracing::RTApp::copyImageToSwapchain(VkCommandBuffer buffer, VkImage swapChainImage, VkExtent2D size) {
 	VkImageSubresourceRange ressourceRange{ VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
 	
@@ -151,17 +162,15 @@ void RayTracing::RTApp::copyImageToSwapchain(VkCommandBuffer buffer, VkImage swa
 	}
 }
 void RayTracing::RTApp::rayTraceScene() {
+	TRACE_ZONE("RTApp::rayTraceScene");
 	if (auto buffer = beginFrame()) {
-		rtPipeline->bind(buffer);
-		prepareStorageImage(buffer);
-		rtPipeline->bindDescriptorSets(buffer, frameIndex);
-
-		VkExtent2D size = swapChain->getSwapChainExtent();
-		rtPipeline->traceRays(buffer, size.width, size.height, 1);
+		//shaders changed on disk are swapped in between frames
+		rtPipeline->applyReload(frameIndex);
 
-		//DLSS Ray Reconstruction will denoise the image
-		//DLSS Super Resolution will upscale the image
-		copyImageToSwapchain(buffer, swapChain->getImage(imageIndex), swapChain->getSwapChainExtent());
+		FrameSettings settings{ .extent = swapChain->getSwapChainExtent(), .maxDepth = maxDepth, .directLighting = directLighting };
+		recordFrame(buffer, frameIndex, settings, scene, *rtPipeline, profiler, "copy to swapchain", [&](VkCommandBuffer cmd) {
+			copyImageToSwapchain(cmd, swapChain->getImage(imageIndex), swapChain->getSwapChainExtent());
+		});
 
 		endFrame();
 	}
@@ -169,6 +178,7 @@ void RayTracing::RTApp::rayTraceScene() {
 	discardFrame = false;
 }
 VkCommandBuffer RayTracing::RTApp::beginFrame() {
+	TRACE_ZONE("RTApp::beginFrame");
 	assert(!frameStarted);
 
 	auto result = swapChain->acquireNextImage(&imageIndex);
@@ -189,6 +199,7 @@ VkCommandBuffer RayTracing::RTApp::beginFrame() {
 	return commandBuffer;
 }
 void RayTracing::RTApp::endFrame() {
+	TRACE_ZONE("RTApp::endFrame");
 	assert(frameStarted);
 
 	//end command buffer
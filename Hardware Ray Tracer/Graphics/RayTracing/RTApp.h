@@ -5,11 +5,17 @@
 #include "../Camera.h"
 #include "../vulkan_core/Device.h"
 #include "../vulkan_core/SwapChain.h"
+#include "../vulkan_core/GpuProfiler.h"
 
 #include "Scene.h"
 #include "RTPipeline.h"
+#include "FrameRecorder.h"
+#include "ShaderReloader.h"
 
 namespace RayTracing {
+	//demo scene shared by the windowed and the headless app, not built yet
+	void createDefaultScene(Scene& scene);
+
 	class RTApp {
 	public:
 		RTApp();
@@ -18,7 +24,6 @@ namespace RayTracing {
 		void run();
 	private:
 		void createCommandBuffers();
-		void prepareStorageImage(VkCommandBuffer buffer);
 		void copyImageToSwapchain(VkCommandBuffer buffer, VkImage swapChainImage, VkExtent2D size);
 		void rayTraceScene();
 		VkCommandBuffer beginFrame();
@@ -29,13 +34,20 @@ namespace RayTracing {
 	private:
 		Core::Window window;
 		Core::Device device;
+		Core::GpuProfiler profiler;
 		Core::Camera camera;
 		Scene scene;
 		std::unique_ptr<Core::SwapChain> swapChain;
 		std::unique_ptr<Pipeline> rtPipeline;
+		std::unique_ptr<ShaderReloader> shaderReloader; //only created in debug builds
 
 		std::vector<VkCommandBuffer> commandBuffers;
 
+		DirectLighting directLighting = DIRECT_LIGHTING_RESTIR;
+		uint32_t maxDepth = 2; //bounces the pipeline variant is specialized for
+		glm::mat4 prevViewProj;
+		bool firstFrame = true;
+
 		bool frameStarted;
 		bool discardFrame;
 		uint32_t frameIndex;
@@ -1,45 +1,68 @@
 #include "RTPipeline.h"
-#include "Debugging.h"
+#include "../Tracer.h"
 
-RayTracing::Pipeline::Pipeline(Core::Device& device, VkFormat format, VkExtent2D extent, AccelerationStructure topLevelAS, std::unique_ptr<Core::Buffer>& sceneInfoBuffer) 
+#include <chrono>
+
+RayTracing::Pipeline::Pipeline(Core::Device& device, VkFormat format, VkExtent2D extent, AccelerationStructure topLevelAS, std::unique_ptr<Core::Buffer>& sceneInfoBuffer, const PipelineVariant& variant) 
 	: device(device), 
 	format(format), 
 	extent(extent), 
 	topLevelAS(topLevelAS),
 	sceneInfoBuffer(sceneInfoBuffer) {
-	
-	BUILD("Ray Tracing Pipeline", 0, 5, "Creating uniform buffers...");
+	TRACE_ZONE("Pipeline::Pipeline");
+
 	uniformBuffers.resize(Core::SwapChain::MAX_FRAMES_IN_FLIGHT);
 	createUniformBuffers();
 
-	BUILD("Ray Tracing Pipeline", 1, 5, "Creating Storage Image...");
 	createStorageImage();
+	createReservoirBuffers();
 	
-	BUILD("Ray Tracing Pipeline", 2, 5, "Creating Pipeline Descriptor Sets...");
 	createDescriptorSets();
-	BUILD("Ray Tracing Pipeline", 3, 5, "Creating Pipeline Layout...");
 	createPipelineLayout();
-	BUILD("Ray Tracing Pipeline", 4, 5, "Creating Pipeline...");
-	createPipeline();
-
-	BUILD("Ray Tracing Pipeline", 5, 5, "Pipeline created!");
+	createPipeline(variant);
 }
 RayTracing::Pipeline::~Pipeline() {
 	destroyStorageImage();
 
-	vkDestroyPipeline(device.getDevice(), graphicsPipeline, nullptr);
+	destroyProgram(program);
+	destroyProgram(reloadedProgram);
+	for (std::unique_ptr<Program>& retiredProgram : retiredPrograms)
+		destroyProgram(retiredProgram);
 	vkDestroyPipelineLayout(device.getDevice(), graphicsPipelineLayout, nullptr);
-	vkDestroyShaderModule(device.getDevice(), rtShaderModule, nullptr);
+
+	//writes the cache back for the next start
+	pipelineCache.reset();
 }
 
 void RayTracing::Pipeline::bind(VkCommandBuffer buffer) {
-	vkCmdBindPipeline(buffer, VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR, graphicsPipeline);
+	vkCmdBindPipeline(buffer, VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR, program->variants[program->activeVariant].pipeline);
 }
 void RayTracing::Pipeline::bindDescriptorSets(VkCommandBuffer buffer, uint32_t index) {
+	//the frame that last bound this set has finished, so it can be updated before it is bound again
+	if (descriptorTopLevelAS[index] != topLevelAS.handle) writeTopLevelAS(index);
+
 	vkCmdBindDescriptorSets(buffer, VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR, graphicsPipelineLayout, 0, 1, &globalDescriptorSets[index], 0, VK_NULL_HANDLE);
 }
 void RayTracing::Pipeline::traceRays(VkCommandBuffer buffer, uint32_t width, uint32_t height, uint32_t depth) {
-	vkCmdTraceRaysKHR(buffer, &raygenRegion, &missRegion, &hitRegion, &callableRegion, width, height, depth);
+	const Variant& variant = program->variants[program->activeVariant];
+	device.getDispatch().vkCmdTraceRaysKHR(buffer, &variant.raygenRegion, &variant.missRegion, &variant.hitRegion, &variant.callableRegion, width, height, depth);
+}
+void RayTracing::Pipeline::traceReservoirs(VkCommandBuffer buffer, uint32_t width, uint32_t height) {
+	//the reservoirs of the previous frame were written by its reservoir pass and read by its spatial reuse
+	VkMemoryBarrier barrier{
+		.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+		.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_SHADER_READ_BIT,
+		.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT
+	};
+	vkCmdPipelineBarrier(buffer, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR, 0, 1, &barrier, 0, VK_NULL_HANDLE, 0, VK_NULL_HANDLE);
+
+	const Variant& variant = program->variants[program->activeVariant];
+	device.getDispatch().vkCmdTraceRaysKHR(buffer, &variant.reservoirRegion, &variant.missRegion, &variant.hitRegion, &variant.callableRegion, width, height, 1);
+
+	//the spatial reuse in traceRays reads the reservoirs of neighbouring pixels
+	barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	vkCmdPipelineBarrier(buffer, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR, 0, 1, &barrier, 0, VK_NULL_HANDLE, 0, VK_NULL_HANDLE);
 }
 void RayTracing::Pipeline::writeToUniformBuffer(void* data, uint32_t index) {
 	uniformBuffers[index]->writeToBuffer(data);
@@ -51,11 +74,114 @@ void RayTracing::Pipeline::rebuildRenderOutput(VkFormat format, VkExtent2D exten
 	this->format = format;
 	this->extent = extent;
 	createStorageImage();
+	createReservoirBuffers();
 	createDescriptorSets();
 }
 
 void RayTracing::Pipeline::updateTopLevelAS(AccelerationStructure topLevelAS) {
-	
+	//only needed when the scene recreated its TLAS, refits keep the handle
+	//the sets of other frame slots may still be in use, each set is rewritten when its slot is bound next
+	this->topLevelAS = topLevelAS;
+}
+
+void RayTracing::Pipeline::writeTopLevelAS(uint32_t index) {
+	VkWriteDescriptorSetAccelerationStructureKHR accelInfo{};
+	accelInfo.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET_ACCELERATION_STRUCTURE_KHR;
+	accelInfo.accelerationStructureCount = 1;
+	accelInfo.pAccelerationStructures = &topLevelAS.handle;
+
+	Core::DescriptorWriter(*globalSetLayout, *globalPool)
+		.writeAccelStructure(0, &accelInfo)
+		.overwrite(globalDescriptorSets[index]);
+	descriptorTopLevelAS[index] = topLevelAS.handle;
+}
+
+void RayTracing::Pipeline::selectVariant(const PipelineVariant& variant) {
+	collectVariants(*program);
+	if (getVariant() == variant) return;
+
+	{
+		std::lock_guard<std::mutex> lock(reloadMutex);
+		reloadVariant = variant;
+	}
+
+	for (uint32_t i = 0; i < program->variants.size(); i++) {
+		if (program->variants[i].key == variant) {
+			program->activeVariant = i;
+			return;
+		}
+	}
+
+	for (const std::unique_ptr<PendingVariant>& pending : program->pendingVariants) {
+		if (pending->variant.key == variant) return;
+	}
+
+	//creating a pipeline stalls recording for a long time, the active variant renders until the new one is collected
+	//previous variants may still be used by frames in flight, so they are kept
+	std::unique_ptr<PendingVariant> pending = std::make_unique<PendingVariant>();
+	pending->variant.key = variant;
+	Variant* target = &pending->variant;
+	VkShaderModule module = program->module;
+	pending->done = variantThread.submit([this, module, target]() { createVariant(module, *target); });
+	program->pendingVariants.push_back(std::move(pending));
+}
+
+void RayTracing::Pipeline::collectVariants(Program& owner) {
+	for (auto it = owner.pendingVariants.begin(); it != owner.pendingVariants.end();) {
+		PendingVariant& pending = **it;
+		if (pending.done.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+			it++;
+			continue;
+		}
+
+		//a failed creation is reported like a synchronous one, the program still owns the partial variant
+		std::future<void> done = std::move(pending.done);
+		owner.variants.push_back(std::move(pending.variant));
+		it = owner.pendingVariants.erase(it);
+		done.get();
+	}
+}
+
+bool RayTracing::Pipeline::reload(std::vector<char> code) {
+	TRACE_ZONE("Pipeline::reload");
+	PipelineVariant variant;
+	{
+		std::lock_guard<std::mutex> lock(reloadMutex);
+		variant = reloadVariant;
+	}
+
+	std::unique_ptr<Program> reloaded;
+	try {
+		reloaded = createProgram(std::move(code), variant);
+	} catch (const std::exception& e) {
+		std::cout << "[WARNING] Pipeline: reload failed, keeping the running pipeline: " << e.what() << std::endl;
+		destroyProgram(reloaded);
+		return false;
+	}
+
+	std::lock_guard<std::mutex> lock(reloadMutex);
+	//a reload that was never applied is replaced, no frame can have used it
+	destroyProgram(reloadedProgram);
+	reloadedProgram = std::move(reloaded);
+	return true;
+}
+
+bool RayTracing::Pipeline::applyReload(uint32_t frameIndex) {
+	//the frame that last used this slot has finished, so its retired program is no longer referenced
+	destroyProgram(retiredPrograms[frameIndex]);
+
+	std::unique_ptr<Program> reloaded;
+	{
+		std::lock_guard<std::mutex> lock(reloadMutex);
+		if (!reloadedProgram) return false;
+		reloaded = std::move(reloadedProgram);
+	}
+
+	retiredPrograms[frameIndex] = std::move(program);
+	program = std::move(reloaded);
+	//the next start loads the cache for the reloaded shader
+	pipelineCache->rekey(program->code);
+	return true;
 }
 
 void RayTracing::Pipeline::createUniformBuffers() {
@@ -72,6 +198,7 @@ void RayTracing::Pipeline::createUniformBuffers() {
 }
 
 void RayTracing::Pipeline::createStorageImage() {
+	TRACE_ZONE("Pipeline::createStorageImage");
 	VkImageCreateInfo imageInfo{
 		.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
 		.imageType = VK_IMAGE_TYPE_2D,
@@ -98,13 +225,32 @@ void RayTracing::Pipeline::createStorageImage() {
 
 	VK_CHECK_RESULT(vkCreateImageView(device.getDevice(), &viewInfo, nullptr, &storageImage.imageView), "failed to create texture image view!");
 }
+void RayTracing::Pipeline::createReservoirBuffers() {
+	VkDeviceSize size = static_cast<VkDeviceSize>(extent.width) * extent.height * sizeof(Reservoir);
+
+	VkCommandBuffer cmd = device.beginSingleTimeCommands();
+	for (std::unique_ptr<Core::Buffer>& reservoirBuffer : reservoirBuffers) {
+		reservoirBuffer = std::make_unique<Core::Buffer>(
+			device,
+			size,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
+		);
+
+		//zeroed reservoirs have no surface, so the first frame does not reuse garbage
+		vkCmdFillBuffer(cmd, reservoirBuffer->getBuffer(), 0, VK_WHOLE_SIZE, 0);
+	}
+	device.endSingleTimeCommands(cmd);
+}
+
 void RayTracing::Pipeline::createDescriptorSets() {
+	TRACE_ZONE("Pipeline::createDescriptorSets");
 	globalPool = Core::DescriptorPool::Builder(device)
 		.setMaxSets(Core::SwapChain::MAX_FRAMES_IN_FLIGHT)
 		.addPoolSize(VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR, Core::SwapChain::MAX_FRAMES_IN_FLIGHT)
 		.addPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, Core::SwapChain::MAX_FRAMES_IN_FLIGHT)
 		.addPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, Core::SwapChain::MAX_FRAMES_IN_FLIGHT)
-		.addPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, Core::SwapChain::MAX_FRAMES_IN_FLIGHT)
+		.addPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 3 * Core::SwapChain::MAX_FRAMES_IN_FLIGHT)
 		.build();
 
 	globalSetLayout = Core::DescriptorSetLayout::Builder(device)
@@ -112,6 +258,8 @@ void RayTracing::Pipeline::createDescriptorSets() {
 		.addBinding(1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_ALL, 1)
 		.addBinding(2, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_ALL, 1)
 		.addBinding(3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_ALL, 1)
+		.addBinding(4, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_ALL, 1)
+		.addBinding(5, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_ALL, 1)
 		.build();
 
 	globalDescriptorSets.resize(Core::SwapChain::MAX_FRAMES_IN_FLIGHT);
@@ -129,13 +277,18 @@ void RayTracing::Pipeline::createDescriptorSets() {
 
 	for (int i = 0; i < Core::SwapChain::MAX_FRAMES_IN_FLIGHT; i++) {
 		auto uboBufInfo = uniformBuffers[i]->descriptorInfo();
+		auto reservoirInfo = reservoirBuffers[i]->descriptorInfo();
+		auto prevReservoirInfo = reservoirBuffers[(i + Core::SwapChain::MAX_FRAMES_IN_FLIGHT - 1) % Core::SwapChain::MAX_FRAMES_IN_FLIGHT]->descriptorInfo();
 
 		Core::DescriptorWriter(*globalSetLayout, *globalPool)
 			.writeAccelStructure(0, &accelInfo)
 			.writeImage(1, &imageInfo)
 			.writeBuffer(2, &uboBufInfo)
 			.writeBuffer(3, &sceneInfo)
+			.writeBuffer(4, &reservoirInfo)
+			.writeBuffer(5, &prevReservoirInfo)
 			.build(globalDescriptorSets[i]);
+		descriptorTopLevelAS[i] = topLevelAS.handle;
 	}
 }
 
@@ -151,12 +304,37 @@ void RayTracing::Pipeline::createPipelineLayout() {
 	VK_CHECK_RESULT(vkCreatePipelineLayout(device.getDevice(), &pipelineLayoutInfo, nullptr, &graphicsPipelineLayout), "failed to create pipeline layout");
 }
 
-void RayTracing::Pipeline::createPipeline() {
+void RayTracing::Pipeline::createPipeline(const PipelineVariant& variant) {
+	std::vector<char> code = readShaderFile(SHADER_PATH);
+
+	//the cache is keyed by the SPIR-V, a rebuilt shader starts cold instead of feeding the driver stale data
+	pipelineCache = std::make_unique<Core::PipelineCache>(device, "shaders/pathtracing.pipelinecache", code);
+
+	reloadVariant = variant;
+	program = createProgram(std::move(code), variant);
+}
+
+std::unique_ptr<RayTracing::Pipeline::Program> RayTracing::Pipeline::createProgram(std::vector<char> code, const PipelineVariant& variant) {
+	std::unique_ptr<Program> created = std::make_unique<Program>();
+	created->code = std::move(code);
+
+	validateSpecializationConstants(created->code);
+	createShaderModule(created->code, &created->module);
+	//added before the pipeline exists so destroyProgram also releases a partially created variant
+	created->variants.push_back(Variant{ .key = variant });
+	createVariant(created->module, created->variants.back());
+	return created;
+}
+
+void RayTracing::Pipeline::createVariant(VkShaderModule module, Variant& variant) {
+	const PipelineVariant& key = variant.key;
+	TRACE_ZONE("Pipeline::createVariant");
 	enum StageIndices {
 		eRayGen,
 		eMiss,
 		eMissShadow,
 		eClosestHit,
+		eRayGenReservoir,
 		eShaderGroupCount
 	};
 
@@ -165,22 +343,58 @@ void RayTracing::Pipeline::createPipeline() {
 	for (VkPipelineShaderStageCreateInfo& info : stages)
 		info.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
 
-	readShader("shaders/pathtracing.slang.spv", &rtShaderModule);
+	//constant ids have to match shaders/utils/specialization.slang
+	struct SpecializationData {
+		uint32_t maxBounces;
+		VkBool32 subsurface;
+		VkBool32 sheen;
+		VkBool32 clearCoat;
+		VkBool32 anisotropic;
+	} specializationData{
+		.maxBounces = key.maxDepth,
+		.subsurface = (key.materialFeatures & MATERIAL_FEATURE_SUBSURFACE) != 0,
+		.sheen = (key.materialFeatures & MATERIAL_FEATURE_SHEEN) != 0,
+		.clearCoat = (key.materialFeatures & MATERIAL_FEATURE_CLEARCOAT) != 0,
+		.anisotropic = (key.materialFeatures & MATERIAL_FEATURE_ANISOTROPIC) != 0
+	};
+
+	std::array<VkSpecializationMapEntry, SPECIALIZATION_CONSTANT_COUNT> mapEntries{ {
+		{ 0, offsetof(SpecializationData, maxBounces), sizeof(uint32_t) },
+		{ 1, offsetof(SpecializationData, subsurface), sizeof(VkBool32) },
+		{ 2, offsetof(SpecializationData, sheen), sizeof(VkBool32) },
+		{ 3, offsetof(SpecializationData, clearCoat), sizeof(VkBool32) },
+		{ 4, offsetof(SpecializationData, anisotropic), sizeof(VkBool32) }
+	} };
+
+	VkSpecializationInfo specializationInfo{
+		.mapEntryCount = static_cast<uint32_t>(mapEntries.size()),
+		.pMapEntries = mapEntries.data(),
+		.dataSize = sizeof(SpecializationData),
+		.pData = &specializationData
+	};
+
+	for (VkPipelineShaderStageCreateInfo& info : stages)
+		info.pSpecializationInfo = &specializationInfo;
+
 	stages[eRayGen].pName = "rgenMain";
 	stages[eRayGen].stage = VK_SHADER_STAGE_RAYGEN_BIT_KHR;
-	stages[eRayGen].module = rtShaderModule;
+	stages[eRayGen].module = module;
 
 	stages[eMiss].pName = "rmissMain";
 	stages[eMiss].stage = VK_SHADER_STAGE_MISS_BIT_KHR;
-	stages[eMiss].module = rtShaderModule;
+	stages[eMiss].module = module;
 
 	stages[eMissShadow].pName = "rmissShadowMain";
 	stages[eMissShadow].stage = VK_SHADER_STAGE_MISS_BIT_KHR;
-	stages[eMissShadow].module = rtShaderModule;
+	stages[eMissShadow].module = module;
 
 	stages[eClosestHit].pName = "rchitMain";
 	stages[eClosestHit].stage = VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR;
-	stages[eClosestHit].module = rtShaderModule;
+	stages[eClosestHit].module = module;
+
+	stages[eRayGenReservoir].pName = "rgenReservoirMain";
+	stages[eRayGenReservoir].stage = VK_SHADER_STAGE_RAYGEN_BIT_KHR;
+	stages[eRayGenReservoir].module = module;
 
 	std::vector<VkRayTracingShaderGroupCreateInfoKHR> shader_groups;
 
@@ -207,6 +421,11 @@ void RayTracing::Pipeline::createPipeline() {
 	group.closestHitShader = eClosestHit;
 	shader_groups.push_back(group);
 
+	group.type = VK_RAY_TRACING_SHADER_GROUP_TYPE_GENERAL_KHR;
+	group.generalShader = eRayGenReservoir;
+	group.closestHitShader = VK_SHADER_UNUSED_KHR;
+	shader_groups.push_back(group);
+
 	//layout is already created
 
 	VkRayTracingPipelineCreateInfoKHR rtPipelineInfo{ VK_STRUCTURE_TYPE_RAY_TRACING_PIPELINE_CREATE_INFO_KHR };
@@ -217,75 +436,82 @@ void RayTracing::Pipeline::createPipeline() {
 	rtPipelineInfo.maxPipelineRayRecursionDepth = std::max(MAX_DEPTH, device.getRTProperties()->maxRayRecursionDepth);
 	rtPipelineInfo.layout = graphicsPipelineLayout;
 
-	vkCreateRayTracingPipelinesKHR(device.getDevice(), {}, {}, 1, &rtPipelineInfo, nullptr, &graphicsPipeline);
+	auto start = std::chrono::high_resolution_clock::now();
+	VK_CHECK_RESULT(device.getDispatch().vkCreateRayTracingPipelinesKHR(device.getDevice(), {}, pipelineCache->getCache(), 1, &rtPipelineInfo, nullptr, &variant.pipeline), "failed to create ray tracing pipeline!");
+	float milliseconds = std::chrono::duration<float, std::chrono::milliseconds::period>(std::chrono::high_resolution_clock::now() - start).count();
+	std::cout << "[INFO] Pipeline: created ray tracing pipeline (" << key.maxDepth << " bounces, material features 0x" << std::hex << key.materialFeatures << std::dec
+		<< ") in " << milliseconds << " ms (" << (pipelineCache->isWarm() ? "warm" : "cold") << " cache)" << std::endl;
 
 	std::cout << "Creating Shader Binding Table..." << std::endl;
-	createShaderBindingTable(rtPipelineInfo);
+	createShaderBindingTable(variant, rtPipelineInfo);
 	std::cout << "Shader Binding Table created" << std::endl;
 }
 
-void RayTracing::Pipeline::createShaderBindingTable(const VkRayTracingPipelineCreateInfoKHR& rtPipelineInfo) {
+void RayTracing::Pipeline::createShaderBindingTable(Variant& variant, const VkRayTracingPipelineCreateInfoKHR& rtPipelineInfo) {
+	TRACE_ZONE("Pipeline::createShaderBindingTable");
 	uint32_t handleSize = device.getRTProperties()->shaderGroupHandleSize;
 	uint32_t handleAlignment = device.getRTProperties()->shaderGroupHandleAlignment;
 	uint32_t baseAlignment = device.getRTProperties()->shaderGroupBaseAlignment;
 	uint32_t groupCount = rtPipelineInfo.groupCount;
 
 	size_t dataSize = handleSize * groupCount;
-	shaderHandles.resize(dataSize);
-	VK_CHECK_RESULT(vkGetRayTracingShaderGroupHandlesKHR(device.getDevice(), graphicsPipeline, 0, groupCount, dataSize, shaderHandles.data()), "failed to get shader shader handles!");
+	std::vector<uint8_t> shaderHandles(dataSize);
+	VK_CHECK_RESULT(device.getDispatch().vkGetRayTracingShaderGroupHandlesKHR(device.getDevice(), variant.pipeline, 0, groupCount, dataSize, shaderHandles.data()), "failed to get shader shader handles!");
 
 	auto     alignUp = [](uint32_t size, uint32_t alignment) { return (size + alignment - 1) & ~(alignment - 1); };
 	uint32_t raygenSize = alignUp(handleSize, handleAlignment);
 	uint32_t missSize = alignUp(handleSize, handleAlignment);
 	uint32_t shadowMissSize = alignUp(handleSize, handleAlignment);
 	uint32_t hitSize = alignUp(handleSize, handleAlignment);
+	uint32_t reservoirSize = alignUp(handleSize, handleAlignment);
 	uint32_t callableSize = 0; //unused
 
 	uint32_t raygenOffset = 0;
 	uint32_t missOffset = alignUp(raygenSize, baseAlignment);
 	uint32_t shadowMissOffset = alignUp(missOffset + missSize, baseAlignment);
 	uint32_t hitOffset = alignUp(shadowMissOffset + shadowMissSize, baseAlignment);
-	uint32_t callableOffset = alignUp(hitOffset + hitSize, baseAlignment);
+	uint32_t reservoirOffset = alignUp(hitOffset + hitSize, baseAlignment);
+	uint32_t callableOffset = alignUp(reservoirOffset + reservoirSize, baseAlignment);
 
 	size_t bufferSize = callableOffset + callableSize;
 
-	sbtBuffer = std::make_unique<Core::Buffer>(
+	variant.sbtBuffer = std::make_unique<Core::Buffer>(
 		device,
 		bufferSize,
 		VK_BUFFER_USAGE_SHADER_BINDING_TABLE_BIT_KHR | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
 		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT
 	);
 
-	sbtBuffer->map();
-	uint8_t* pData = static_cast<uint8_t*>(sbtBuffer->getMappedMemory());
+	variant.sbtBuffer->map();
+	uint8_t* pData = static_cast<uint8_t*>(variant.sbtBuffer->getMappedMemory());
 	memcpy(pData + raygenOffset, shaderHandles.data() + 0 * handleSize, handleSize);
-	raygenRegion.deviceAddress = sbtBuffer->getAddress() + raygenOffset;
-	raygenRegion.size = raygenSize;
-	raygenRegion.stride = raygenSize;
+	variant.raygenRegion.deviceAddress = variant.sbtBuffer->getAddress(raygenOffset);
+	variant.raygenRegion.size = raygenSize;
+	variant.raygenRegion.stride = raygenSize;
 
 	memcpy(pData + missOffset, shaderHandles.data() + 1 * handleSize, handleSize);
-	missRegion.deviceAddress = sbtBuffer->getAddress() + missOffset;
-	missRegion.size = missSize;
-	missRegion.stride = missSize;
+	variant.missRegion.deviceAddress = variant.sbtBuffer->getAddress(missOffset);
+	variant.missRegion.size = missSize;
+	variant.missRegion.stride = missSize;
 
 	memcpy(pData + shadowMissOffset, shaderHandles.data() + 2 * handleSize, handleSize);
 
 	memcpy(pData + hitOffset, shaderHandles.data() + 3 * handleSize, handleSize);
-	hitRegion.deviceAddress = sbtBuffer->getAddress() + hitOffset;
-	hitRegion.size = hitSize;
-	hitRegion.stride = hitSize;
-
-	callableRegion.deviceAddress = 0;
-	callableRegion.size = 0;
-	callableRegion.stride = 0;
+	variant.hitRegion.deviceAddress = variant.sbtBuffer->getAddress(hitOffset);
+	variant.hitRegion.size = hitSize;
+	variant.hitRegion.stride = hitSize;
+
+	memcpy(pData + reservoirOffset, shaderHandles.data() + 4 * handleSize, handleSize);
+	variant.reservoirRegion.deviceAddress = variant.sbtBuffer->getAddress(reservoirOffset);
+	variant.reservoirRegion.size = reservoirSize;
+	variant.reservoirRegion.stride = reservoirSize;
+
+	variant.callableRegion.deviceAddress = 0;
+	variant.callableRegion.size = 0;
+	variant.callableRegion.stride = 0;
 }
 
-void RayTracing::Pipeline::readShader(std::string path, VkShaderModule* module) {
-	std::vector<char> code = readShaderFile(path);
-	createShaderModule(code, module);
-}
-
-std::vector<char> RayTracing::Pipeline::readShaderFile(std::string& path) {
+std::vector<char> RayTracing::Pipeline::readShaderFile(const std::string& path) {
 	std::ifstream file(path, std::ios::ate | std::ios::binary);
 
 	if (!file.is_open()) throw std::runtime_error("failed to open: " + path);
@@ -299,6 +525,33 @@ std::vector<char> RayTracing::Pipeline::readShaderFile(std::string& path) {
 	return buf;
 }
 
+void RayTracing::Pipeline::validateSpecializationConstants(const std::vector<char>& code) {
+	constexpr uint32_t SPIRV_MAGIC = 0x07230203;
+	constexpr uint32_t SPIRV_HEADER_WORDS = 5;
+	constexpr uint32_t OP_DECORATE = 71;
+	constexpr uint32_t DECORATION_SPEC_ID = 1;
+
+	std::vector<uint32_t> words(code.size() / sizeof(uint32_t));
+	memcpy(words.data(), code.data(), words.size() * sizeof(uint32_t));
+	if (words.size() < SPIRV_HEADER_WORDS || words[0] != SPIRV_MAGIC) throw std::runtime_error("shader module is not SPIR-V");
+
+	//a module built before shaders/utils/specialization.slang ignores the map entries and silently runs the uber-shader
+	uint32_t found = 0;
+	for (size_t i = SPIRV_HEADER_WORDS; i < words.size();) {
+		uint32_t opcode = words[i] & 0xFFFF;
+		uint32_t wordCount = words[i] >> 16;
+		if (wordCount == 0 || i + wordCount > words.size()) throw std::runtime_error("shader module is truncated");
+
+		if (opcode == OP_DECORATE && wordCount >= 4 && words[i + 2] == DECORATION_SPEC_ID && words[i + 3] < SPECIALIZATION_CONSTANT_COUNT)
+			found |= 1u << words[i + 3];
+		i += wordCount;
+	}
+
+	for (uint32_t id = 0; id < SPECIALIZATION_CONSTANT_COUNT; id++)
+		if (!(found & (1u << id)))
+			throw std::runtime_error("shader module has no specialization constant " + std::to_string(id) + ", rebuild " + SHADER_PATH + " with slangc");
+}
+
 void RayTracing::Pipeline::createShaderModule(const std::vector<char>& code, VkShaderModule* module) {
 	VkShaderModuleCreateInfo info{};
 	info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
@@ -308,18 +561,37 @@ void RayTracing::Pipeline::createShaderModule(const std::vector<char>& code, VkS
 	VK_CHECK_RESULT(vkCreateShaderModule(device.getDevice(), &info, nullptr, module), "failed to create Shader module");
 }
 
+void RayTracing::Pipeline::destroyProgram(std::unique_ptr<Program>& target) {
+	if (!target) return;
+
+	//the variant thread may still be creating variants from the module
+	for (std::unique_ptr<PendingVariant>& pending : target->pendingVariants) {
+		pending->done.wait();
+		vkDestroyPipeline(device.getDevice(), pending->variant.pipeline, nullptr);
+	}
+	for (Variant& variant : target->variants)
+		vkDestroyPipeline(device.getDevice(), variant.pipeline, nullptr);
+	vkDestroyShaderModule(device.getDevice(), target->module, nullptr);
+	target.reset();
+}
+
 void RayTracing::Pipeline::destroyStorageImage() {
 	vkDestroyImageView(device.getDevice(), storageImage.imageView, nullptr);
 	vkDestroyImage(device.getDevice(), storageImage.image, nullptr);
-	vkFreeMemory(device.getDevice(), storageImage.imageMemory, nullptr);
+	device.freeMemory(storageImage.imageMemory);
+}
+
+std::unique_ptr<RayTracing::Pipeline> RayTracing::Pipeline::createPipeline(Core::Device& device, std::unique_ptr<Core::SwapChain>& swapChain, Scene& scene, uint32_t maxDepth) {
+	return createPipeline(device, swapChain->getSwapChainImageFormat(), swapChain->getSwapChainExtent(), scene, maxDepth);
 }
 
-std::unique_ptr<RayTracing::Pipeline> RayTracing::Pipeline::createPipeline(Core::Device& device, std::unique_ptr<Core::SwapChain>& swapChain, Scene& scene) {
+std::unique_ptr<RayTracing::Pipeline> RayTracing::Pipeline::createPipeline(Core::Device& device, VkFormat format, VkExtent2D extent, Scene& scene, uint32_t maxDepth) {
 	return std::make_unique<RayTracing::Pipeline>(
 		device,
-		swapChain->getSwapChainImageFormat(),
-		swapChain->getSwapChainExtent(),
+		format,
+		extent,
 		scene.getTlas(),
-		scene.getSceneInfoBuffer()
+		scene.getSceneInfoBuffer(),
+		PipelineVariant{ .maxDepth = maxDepth, .materialFeatures = scene.getMaterialFeatures() }
 	);
 }
\ No newline at end of file
@@ -2,36 +2,64 @@
 
 #include <array>
 #include <fstream>
+#include <mutex>
 #include <glm/glm.hpp>
 #include "../vulkan_core/Device.h"
 #include "../vulkan_core/SwapChain.h"
 #include "../vulkan_core/Descriptors.h"
+#include "../vulkan_core/PipelineCache.h"
+#include "../ThreadPool.h"
 #include "Scene.h"
 
-#define vkCreateRayTracingPipelinesKHR reinterpret_cast<PFN_vkCreateRayTracingPipelinesKHR>(vkGetDeviceProcAddr(device.getDevice(), "vkCreateRayTracingPipelinesKHR"))
-#define vkGetRayTracingShaderGroupHandlesKHR reinterpret_cast<PFN_vkGetRayTracingShaderGroupHandlesKHR>(vkGetDeviceProcAddr(device.getDevice(), "vkGetRayTracingShaderGroupHandlesKHR"))
-#define vkCmdTraceRaysKHR reinterpret_cast<PFN_vkCmdTraceRaysKHR>(vkGetDeviceProcAddr(device.getDevice(), "vkCmdTraceRaysKHR"))
-
 #define MAX_DEPTH 10U
 
 namespace RayTracing {
 	struct StorageImage {
 		VkImage image;
-		VkDeviceMemory imageMemory;
+		Core::Allocation imageMemory;
 		VkImageView imageView;
 	};
 
+	enum DirectLighting : uint32_t {
+		DIRECT_LIGHTING_NEE, //one shadow ray towards one sampled light per bounce
+		DIRECT_LIGHTING_RESTIR //the primary hit reuses light samples of its own and neighbouring pixels over time
+	};
+
 	struct Uniform {
 		glm::mat4 viewInverse;
 		glm::mat4 projInverse;
+		glm::mat4 prevViewProj; //transposed projection * view of the previous frame, reprojects reservoirs
 		uint32_t frame;
 		uint32_t depthMax;
 		float LIGHT_TRESHOLD = .0001f;
+		uint32_t directLighting = DIRECT_LIGHTING_NEE; //DirectLighting
+	};
+
+	//per pixel state of ReSTIR DI, mirrors Restir::Reservoir in shaders/utils/restir.slang
+	struct Reservoir {
+		int lightIndex;
+		float weightSum;
+		float sampleCount;
+		float weight;
+
+		float position[3];
+		float depth;
+
+		float normal[3];
+		uint32_t padding;
+	};
+
+	//specialization constants of a ray tracing pipeline, mirrors shaders/utils/specialization.slang
+	struct PipelineVariant {
+		uint32_t maxDepth = MAX_DEPTH; //fixed bounce count of the path tracing loop, Uniform::depthMax can only end paths earlier
+		uint32_t materialFeatures = MATERIAL_FEATURE_ALL; //MaterialFeatures, lobes outside of it are compiled out
+
+		bool operator==(const PipelineVariant&) const = default;
 	};
 
 	class Pipeline {
 	public:
-		Pipeline(Core::Device& device, VkFormat format, VkExtent2D, AccelerationStructure topLevelAS, std::unique_ptr<Core::Buffer>& sceneInfoBuffer);
+		Pipeline(Core::Device& device, VkFormat format, VkExtent2D, AccelerationStructure topLevelAS, std::unique_ptr<Core::Buffer>& sceneInfoBuffer, const PipelineVariant& variant);
 		~Pipeline();
 
 		Pipeline(const Pipeline&) = delete;
@@ -42,24 +70,80 @@ namespace RayTracing {
 		void bind(VkCommandBuffer buffer);
 		void bindDescriptorSets(VkCommandBuffer buffer, uint32_t index);
 		void traceRays(VkCommandBuffer buffer, uint32_t width, uint32_t height, uint32_t depth);
+		//records the reservoir pass of DIRECT_LIGHTING_RESTIR, has to precede traceRays of the same frame
+		void traceReservoirs(VkCommandBuffer buffer, uint32_t width, uint32_t height);
 		void writeToUniformBuffer(void* data, uint32_t index);
+		//recreates the descriptor sets, the device has to be idle
 		void rebuildRenderOutput(VkFormat format, VkExtent2D extent);
+		//may be called while other frames are in flight, the set of a slot picks up the new TLAS in bindDescriptorSets
 		void updateTopLevelAS(AccelerationStructure topLevelAS);
+		//makes variant the pipeline used by bind and traceRays, variants are created on first use and kept until destruction
+		//a new variant is created on the variant thread, the active one keeps being used until it is done
+		void selectVariant(const PipelineVariant& variant);
+		//creates a shader module from code and the pipeline of the selected variant, may be called from any thread
+		//the result is swapped in by the next applyReload, on failure the running pipeline stays untouched and false is returned
+		bool reload(std::vector<char> code);
+		//swaps in the last successful reload at a frame boundary, returns true if the pipeline changed
+		//the replaced pipelines are destroyed when frameIndex comes around again
+		bool applyReload(uint32_t frameIndex);
 
 		inline StorageImage& getRenderOutput() { return storageImage; }
+		inline const PipelineVariant& getVariant() const { return program->variants[program->activeVariant].key; }
 
-		static std::unique_ptr<Pipeline> createPipeline(Core::Device& device, std::unique_ptr<Core::SwapChain>& swapChain, Scene& scene);
+		static std::unique_ptr<Pipeline> createPipeline(Core::Device& device, std::unique_ptr<Core::SwapChain>& swapChain, Scene& scene, uint32_t maxDepth);
+		//renders into a storage image of format and extent without a swap chain
+		static std::unique_ptr<Pipeline> createPipeline(Core::Device& device, VkFormat format, VkExtent2D extent, Scene& scene, uint32_t maxDepth);
+		static std::vector<char> readShaderFile(const std::string& path);
+
+		static constexpr const char* SHADER_PATH = "shaders/pathtracing.slang.spv";
+		//constant ids 0 to count - 1 of shaders/utils/specialization.slang
+		static constexpr uint32_t SPECIALIZATION_CONSTANT_COUNT = 5;
 	private:
+		//a specialized pipeline and its shader binding table
+		struct Variant {
+			PipelineVariant key;
+			VkPipeline pipeline = VK_NULL_HANDLE;
+			std::unique_ptr<Core::Buffer> sbtBuffer;
+
+			VkStridedDeviceAddressRegionKHR raygenRegion{};
+			VkStridedDeviceAddressRegionKHR reservoirRegion{};
+			VkStridedDeviceAddressRegionKHR missRegion{};
+			VkStridedDeviceAddressRegionKHR hitRegion{};
+			VkStridedDeviceAddressRegionKHR callableRegion{};
+		};
+
+		//a variant written by the variant thread, owned by the program it is created from
+		struct PendingVariant {
+			Variant variant;
+			std::future<void> done;
+		};
+
+		//a shader module and the variants created from it, replaced as a whole by a reload
+		struct Program {
+			std::vector<char> code;
+			VkShaderModule module = VK_NULL_HANDLE;
+			std::vector<Variant> variants;
+			uint32_t activeVariant = 0;
+			std::vector<std::unique_ptr<PendingVariant>> pendingVariants;
+		};
+
 		void createUniformBuffers();
 		void createStorageImage();
+		void createReservoirBuffers();
 		void createDescriptorSets();
+		void writeTopLevelAS(uint32_t index);
 		void createPipelineLayout();
-		void createPipeline();
-		void createShaderBindingTable(const VkRayTracingPipelineCreateInfoKHR& rtPipelineInfo);
+		void createPipeline(const PipelineVariant& variant);
+		std::unique_ptr<Program> createProgram(std::vector<char> code, const PipelineVariant& variant);
+		void createVariant(VkShaderModule module, Variant& variant);
+		//moves finished pending variants of owner into its variants, rethrows if the creation failed
+		void collectVariants(Program& owner);
+		void createShaderBindingTable(Variant& variant, const VkRayTracingPipelineCreateInfoKHR& rtPipelineInfo);
+		void destroyProgram(std::unique_ptr<Program>& target);
 
-		void readShader(std::string path, VkShaderModule* module);
-		std::vector<char> readShaderFile(std::string& path);
 		void createShaderModule(const std::vector<char>& code, VkShaderModule* module);
+		//throws if code does not declare every specialization constant the variants set
+		static void validateSpecializationConstants(const std::vector<char>& code);
 
 		void destroyStorageImage();
 	private:
@@ -68,26 +152,26 @@ namespace RayTracing {
 		VkFormat format;
 		VkExtent2D extent;
 		StorageImage storageImage;
+		//frame slot i writes reservoirBuffers[i] and reads the other one as the previous frame
+		std::array<std::unique_ptr<Core::Buffer>, Core::SwapChain::MAX_FRAMES_IN_FLIGHT> reservoirBuffers;
 
 		AccelerationStructure topLevelAS;
 		std::unique_ptr<Core::Buffer>& sceneInfoBuffer;
 
-		VkPipeline graphicsPipeline;
 		VkPipelineLayout graphicsPipelineLayout;
+		std::unique_ptr<Core::PipelineCache> pipelineCache;
+		std::unique_ptr<Program> program;
+		std::array<std::unique_ptr<Program>, Core::SwapChain::MAX_FRAMES_IN_FLIGHT> retiredPrograms;
+		Core::ThreadPool variantThread{ 1 };
+
+		std::mutex reloadMutex;
+		std::unique_ptr<Program> reloadedProgram; //guarded by reloadMutex
+		PipelineVariant reloadVariant; //guarded by reloadMutex, the variant a reload is created for
 
 		std::unique_ptr<Core::DescriptorPool> globalPool{};
 		std::unique_ptr<Core::DescriptorSetLayout> globalSetLayout;
 		std::vector<VkDescriptorSet> globalDescriptorSets;
+		std::array<VkAccelerationStructureKHR, Core::SwapChain::MAX_FRAMES_IN_FLIGHT> descriptorTopLevelAS{}; //TLAS each set was last written with
 		std::vector<std::unique_ptr<Core::Buffer>> uniformBuffers;
-
-		std::unique_ptr<Core::Buffer> sbtBuffer;
-		std::vector<uint8_t> shaderHandles;
-		std::vector<char> shaderRawCode;
-		VkShaderModule rtShaderModule;
-
-		VkStridedDeviceAddressRegionKHR raygenRegion{};
-		VkStridedDeviceAddressRegionKHR missRegion{};
-		VkStridedDeviceAddressRegionKHR hitRegion{};
-		VkStridedDeviceAddressRegionKHR callableRegion{};
 	};
 }
\ No newline at end of file
@@ -1,92 +1,119 @@
 #include "Scene.h"
-
+#include "ObjImporter.h"
+#include "MeshCache.h"
+#include "MeshOptimizer.h"
+#include "BlasBuilder.h"
+#include "LightBVH.h"
+#include "AliasTable.h"
+#include "../vulkan_core/StagingRing.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
 #include <span>
+#include <chrono>
+#include <unordered_set>
+#include <cstddef>
+#include <glm/gtc/packing.hpp>
+
+RayTracing::Scene::Scene(Core::Device& device, VertexFormat vertexFormat) 
+	: device(device), 
+	vertexFormat(vertexFormat), 
+	blasBuilder(std::make_unique<BlasBuilder>(device)),
+	materialBuffer(device, sizeof(Material)), 
+	lightBuffer(device, sizeof(Light)), 
+	instanceBuffer(device, sizeof(InstanceInfo)),
+	lightTreeBuffer(device, sizeof(LightBVHNode)),
+	lightAliasBuffer(device, sizeof(AliasTableEntry)) {}
+RayTracing::Scene::~Scene() {
+	//builds and uploads may still be in flight
+	device.waitSubmissions();
 
-namespace std {
-	template<>
-	struct hash<RayTracing::Vertex> {
-		size_t operator()(RayTracing::Vertex const& vert) const {
-			size_t seed = 0;
-			hashCombine(seed, vert.pos[0], vert.pos[1], vert.pos[2], 0);
-			return seed;
-		}
-	};
+	destroyAccelerationStructure(tlasAccel);
+
+	for (Mesh& mesh : meshes)
+		destroyAccelerationStructure(mesh.blas);
+
+	for (RetiredResources& resources : retired)
+		releaseResources(resources);
+	releaseResources(retiring);
 }
 
-RayTracing::Scene::Scene(Core::Device& device) : device(device) {}
-RayTracing::Scene::~Scene() {
-	vkDestroyAccelerationStructureKHR(device.getDevice(), tlasAccel.handle, nullptr);
-	vkDestroyBuffer(device.getDevice(), tlasAccel.buffer, nullptr);
-	vkFreeMemory(device.getDevice(), tlasAccel.memory, nullptr);
-
-	for (uint32_t i = 0; i < blasAccel.size(); i++) {
-		vkDestroyAccelerationStructureKHR(device.getDevice(), blasAccel[i].handle, nullptr);
-		vkDestroyBuffer(device.getDevice(), blasAccel[i].buffer, nullptr);
-		vkFreeMemory(device.getDevice(), blasAccel[i].memory, nullptr);
+RayTracing::MeshHandle RayTracing::Scene::loadModel(std::string path, uint32_t importFlags) {
+	TRACE_ZONE("Scene::loadModel");
+	auto start = std::chrono::high_resolution_clock::now();
+
+	//warm start: upload straight from the mapped cache file
+	{
+		MeshCache cache(path, importFlags);
+		if (cache.isValid()) {
+			MeshHandle mesh = meshes.insert(Mesh{ device, cache.getVertices(), cache.getIndices(), vertexFormat });
+
+			float seconds = std::chrono::duration<float, std::chrono::seconds::period>(std::chrono::high_resolution_clock::now() - start).count();
+			std::cout << "[INFO] Scene: Loaded " << path << " from cache (" << cache.getHeader().vertexCount << " vertices, " << cache.getHeader().indexCount / 3 << " triangles) in " << seconds << "s" << std::endl;
+			return mesh;
+		}
 	}
-}
 
-void RayTracing::Scene::loadModel(std::string path) {
 	std::vector<Vertex> vertices;
 	std::vector<uint32_t> indices;
-	
-	tinyobj::attrib_t attributes;
-	std::vector<tinyobj::shape_t> shapes;
-	std::vector<tinyobj::material_t> materials;
-	std::string err;
-
-	if (!tinyobj::LoadObj(&attributes, &shapes, &materials, &err, path.c_str())) {
-		std::cout << "[ERROR] Scene: " << err << std::endl;
-		throw std::runtime_error(err);
+
+	try {
+		ObjImporter(threadPool).load(path, vertices, indices);
+	} catch (const std::runtime_error& e) {
+		std::cout << "[ERROR] Scene: " << path << ": " << e.what() << std::endl;
+		throw;
 	}
 
-	std::unordered_map<Vertex, uint32_t> uniqueVertices{};
-	for (const auto& shape : shapes) {
-		for (const auto& index : shape.mesh.indices) {
-			Vertex vertex{};
-			if (index.vertex_index >= 0) {
-				vertex.pos[0] = attributes.vertices[3 * index.vertex_index + 0];
-				vertex.pos[1] = -attributes.vertices[3 * index.vertex_index + 1];
-				vertex.pos[2] = attributes.vertices[3 * index.vertex_index + 2];
-			}
-
-			if (index.normal_index >= 0) {
-				vertex.normal[0] = attributes.normals[3 * index.normal_index + 0];
-				vertex.normal[1] = -attributes.normals[3 * index.normal_index + 1];
-				vertex.normal[2] = attributes.normals[3 * index.normal_index + 2];
-			}
-
-			if (index.texcoord_index >= 0) {
-				vertex.uv[0] = attributes.texcoords[2 * index.texcoord_index + 0];
-				vertex.uv[1] = attributes.texcoords[2 * index.texcoord_index + 1];
-			}
-
-			if (uniqueVertices.count(vertex) == 0) {
-				uniqueVertices[vertex] = static_cast<uint32_t>(vertices.size());
-				vertices.push_back(vertex);
-			}
-
-			indices.push_back(uniqueVertices[vertex]);
-		}
+	float seconds = std::chrono::duration<float, std::chrono::seconds::period>(std::chrono::high_resolution_clock::now() - start).count();
+	std::cout << "[INFO] Scene: Loaded " << path << " (" << vertices.size() << " vertices, " << indices.size() / 3 << " triangles) in " << seconds << "s" << std::endl;
+
+	if (importFlags & IMPORT_OPTIMIZE) {
+		MeshOptimizationInfo info = MeshOptimizer::optimize(vertices, indices);
+		std::cout << "[INFO] Scene: Optimized " << path << ", average vertex fetch span " << info.fetchSpanBefore << " -> " << info.fetchSpanAfter << " bytes" << std::endl;
 	}
 
-	meshes.push_back(Mesh{ device, vertices, indices });
+	try {
+		MeshCache::write(path, vertices, indices, importFlags);
+	} catch (const std::exception& e) {
+		//a missing cache only costs startup time
+		std::cout << "[WARNING] Scene: failed to write mesh cache for " << path << ": " << e.what() << std::endl;
+	}
+
+	return meshes.insert(Mesh{ device, vertices, indices, vertexFormat });
 }
 
-void RayTracing::Scene::createInstance(uint32_t meshId, uint32_t materialId, glm::vec3 position, glm::vec3 rotation, glm::vec3 scale) {
-	instances.push_back(MeshInstance(meshId, materialId, position, rotation, scale));
+RayTracing::InstanceHandle RayTracing::Scene::createInstance(MeshHandle mesh, MaterialHandle material, glm::vec3 position, glm::vec3 rotation, glm::vec3 scale) {
+	std::vector<uint32_t>& materialUsers = materialInstances[materials.indexOf(material)];
+	meshes.get(mesh).instanceCount++;
+	materialFeaturesOutdated = true;
+
+	InstanceHandle instance = instances.insert(MeshInstance(mesh, material));
+	transforms.add(position, rotation, scale);
+	instanceMaterialPositions.push_back(static_cast<uint32_t>(materialUsers.size()));
+	materialUsers.push_back(instances.size() - 1);
+
+	if (built) {
+		instancePatches.push_back(instances.size() - 1);
+		tlasRebuild = true;
+	}
+	return instance;
 }
 
-void RayTracing::Scene::createMaterial(glm::vec3 color, float metallic, float roughness, glm::vec3 emissiveColor, float emissionStrength) {
-	materials.push_back(Material{
+RayTracing::MaterialHandle RayTracing::Scene::createMaterial(glm::vec3 color, float metallic, float roughness, glm::vec3 emissiveColor, float emissionStrength) {
+	MaterialHandle material = materials.insert(Material{
 		.color = {color.x, color.y, color.z},
 		.metallic = metallic,
 		.roughness = roughness
 	});
+	materialInstances.emplace_back();
+
+	materialBuffer.markDirty(materials.size() - 1);
+	return material;
 }
 
-void RayTracing::Scene::createLight(glm::vec3 position, glm::vec3 color, float intensity) {
-	lights.push_back(
+RayTracing::LightHandle RayTracing::Scene::createLight(glm::vec3 position, glm::vec3 color, float intensity) {
+	LightHandle light = lights.insert(
 		Light{
 			{position.x, position.y, position.z},
 			{color.x, color.y, color.z},
@@ -94,54 +121,189 @@ void RayTracing::Scene::createLight(glm::vec3 position, glm::vec3 color, float i
 			LightType::POINT
 		}
 	);
+
+	lightBuffer.markDirty(lights.size() - 1);
+	sceneInfoOutdated = true;
+	lightTreeOutdated = true;
+	lightAliasOutdated = true;
+	return light;
 }
 
 
 void RayTracing::Scene::build() {
-	BUILD("SCENE", 0, 7, "Creating Bottom Level Acceleration Structure...");
+	TRACE_ZONE("Scene::build");
+	auto start = std::chrono::high_resolution_clock::now();
+
+	//acceleration structures are built on the GPU while the light sampling structure and the sky are created
 	createBottomAS();
-	BUILD("SCENE", 1, 7, "Creating TOP Level Acceleration Structure...");
 	createTopAS();
+	updateLightSampling();
+	createSky();
+	createSceneInfoBuffer();
 
-	BUILD("SCENE", 2, 7, "Creating materials...");
-	createMaterials();
-	BUILD("SCENE", 3, 7, "Creating lights...");
-	createLights();
+	TRACE_ZONE("Scene::build upload");
+	instanceInfo.resize(instances.size());
+	for (uint32_t i = 0; i < instances.size(); i++)
+		instanceInfo[i] = getInstanceInfo(i);
 
-	BUILD("SCENE", 4, 7, "Creating Sky...");
-	createSky();
+	materialBuffer.markDirty(0, materials.size());
+	lightBuffer.markDirty(0, lights.size());
+	instanceBuffer.markDirty(0, instances.size());
+	instancePatches.clear();
 
-	BUILD("SCENE", 5, 7, "Creating scene information...");
-	createSceneInformation();
-	BUILD("SCENE", 6, 7, "Creating scene information buffer...");
-	createSceneInfoBuffer();
+	//the staging buffers of frame slot 0 are written again by the first update
+	VkCommandBuffer cmd = device.beginSingleTimeCommands();
+	updateSceneBuffers(cmd, 0);
+	device.wait(device.submitSingleTimeCommands(cmd, std::span<const Core::GpuTicket>(&tlasTicket, 1)));
+	device.addFrameDependency(tlasTicket);
+	built = true;
+
+	float seconds = std::chrono::duration<float, std::chrono::seconds::period>(std::chrono::high_resolution_clock::now() - start).count();
+	std::cout << "[INFO] Scene: built " << meshes.size() << " meshes, " << instances.size() << " instances and " << lights.size() << " lights in " << seconds << "s" << std::endl;
+}
+
+bool RayTracing::Scene::update(VkCommandBuffer cmd, uint32_t frameIndex) {
+	TRACE_ZONE("Scene::update");
+	//the fence of this frame slot was waited on, nothing retired by its previous use is referenced anymore
+	releaseResources(retired[frameIndex]);
+
+	//uploads queued since the last frame start right away, the builds reading them wait for their ticket
+	device.getStagingRing().flush();
+	createBottomAS();
+	swapCompactedBottomAS();
+	refreshInstances();
+	updateLightSampling();
+	{
+		Core::GpuProfiler::Scope scope(profiler, cmd, "scene upload");
+		updateSceneBuffers(cmd, frameIndex);
+	}
+	bool recreated;
+	{
+		Core::GpuProfiler::Scope scope(profiler, cmd, "tlas build");
+		recreated = updateTopAS(cmd, frameIndex);
+	}
+
+	//resources retired since the last update may still be used by the previous frame
+	std::swap(retired[frameIndex], retiring);
+	return recreated;
+}
+
+void RayTracing::Scene::destroyInstance(InstanceHandle instance) {
+	const MeshInstance& meshInstance = instances.get(instance);
+	meshes.get(meshInstance.getMesh()).instanceCount--;
+	materialFeaturesOutdated = true;
+
+	//swap remove from the users of its material
+	std::vector<uint32_t>& materialUsers = materialInstances[materials.indexOf(meshInstance.getMaterial())];
+	uint32_t position = instanceMaterialPositions[instances.indexOf(instance)];
+	materialUsers[position] = materialUsers.back();
+	instanceMaterialPositions[materialUsers[position]] = position;
+	materialUsers.pop_back();
+
+	SlotMap<MeshInstance>::Removal removal = instances.remove(instance);
+	transforms.remove(removal.index);
+
+	//the last instance moved into the freed dense index
+	if (removal.moved != removal.index) {
+		uint32_t movedPosition = instanceMaterialPositions[removal.moved];
+		materialInstances[materials.indexOf(instances[removal.index].getMaterial())][movedPosition] = removal.index;
+		instanceMaterialPositions[removal.index] = movedPosition;
+	}
+	instanceMaterialPositions.pop_back();
+
+	if (built) {
+		if (removal.moved != removal.index) instancePatches.push_back(removal.index);
+		tlasRebuild = true;
+	}
+}
+
+void RayTracing::Scene::unloadModel(MeshHandle mesh) {
+	Mesh& removed = meshes.get(mesh);
+	if (removed.instanceCount > 0) throw std::runtime_error("failed to unload model, it is still used by instances!");
+
+	//instances reference vertices, indices and the BLAS by address, moving the dense mesh needs no patching
+	retiring.meshes.push_back(std::move(removed));
+	meshes.remove(mesh);
+}
 
-	BUILD("SCENE", 7, 7, "Scene created!");
+void RayTracing::Scene::destroyLight(LightHandle light) {
+	SlotMap<Light>::Removal removal = lights.remove(light);
+
+	if (removal.moved != removal.index) lightBuffer.markDirty(removal.index);
+	sceneInfoOutdated = true;
+	lightTreeOutdated = true;
+	lightAliasOutdated = true;
+}
+
+void RayTracing::Scene::destroyMaterial(MaterialHandle material) {
+	uint32_t index = materials.indexOf(material);
+	if (!materialInstances[index].empty()) throw std::runtime_error("failed to destroy material, it is still used by instances!");
+
+	SlotMap<Material>::Removal removal = materials.remove(material);
+	materialInstances[index] = std::move(materialInstances.back());
+	materialInstances.pop_back();
+
+	if (removal.moved == removal.index) return;
+	materialBuffer.markDirty(removal.index);
+
+	//instance information holds dense material indices, only the users of the moved material change
+	if (built) {
+		for (uint32_t i : materialInstances[removal.index])
+			instancePatches.push_back(i);
+	}
+}
+
+void RayTracing::Scene::setMaterial(MaterialHandle material, const Material& value) {
+	uint32_t index = materials.indexOf(material);
+	materials[index] = value;
+	materialBuffer.markDirty(index);
+	materialFeaturesOutdated = true;
 }
 
-void RayTracing::Scene::destroyInstance(uint32_t instanceID) {
-	instances[instanceID] = instances[instances.size() - 1];
-	instances.pop_back();
+uint32_t RayTracing::Scene::getMaterialFeatures() {
+	if (!materialFeaturesOutdated) return materialFeatures;
+
+	materialFeatures = 0;
+	for (uint32_t i = 0; i < materials.size(); i++) {
+		//materials without instances are never shaded
+		if (materialInstances[i].empty()) continue;
+
+		const Material& material = materials[i];
+		if (material.subsurface != 0.0f) materialFeatures |= MATERIAL_FEATURE_SUBSURFACE;
+		if (material.sheen != 0.0f) materialFeatures |= MATERIAL_FEATURE_SHEEN;
+		if (material.clearCoat != 0.0f) materialFeatures |= MATERIAL_FEATURE_CLEARCOAT;
+		if (material.anisotropic != 0.0f) materialFeatures |= MATERIAL_FEATURE_ANISOTROPIC;
+	}
+
+	materialFeaturesOutdated = false;
+	return materialFeatures;
 }
 
-void RayTracing::Scene::unloadModel(uint32_t meshId) {}
+void RayTracing::Scene::setLight(LightHandle light, const Light& value) {
+	uint32_t index = lights.indexOf(light);
+	//moving or recoloring a light at the same power leaves the alias table as it is
+	if (getLightPower(lights[index]) != getLightPower(value)) lightAliasOutdated = true;
 
-void RayTracing::Scene::destroyLight(uint32_t lightId) {
+	lights[index] = value;
+	lightBuffer.markDirty(index);
+	lightTreeOutdated = true;
 }
 
-void RayTracing::Scene::destroyMaterial(uint32_t materialId) {
+void RayTracing::Scene::setLightSampling(LightSampling sampling) {
+	lightSampling = sampling;
+	sceneInfoOutdated = true;
 }
 
 void RayTracing::Scene::primitiveToGeometry(const Mesh& mesh, VkAccelerationStructureGeometryKHR& geometry, VkAccelerationStructureBuildRangeInfoKHR& rangeInfo) {
-	const auto triangeCount = static_cast<uint32_t>(mesh.indices.size() / 3U);
+	const auto triangeCount = mesh.indexCount / 3U;
 
 	VkAccelerationStructureGeometryTrianglesDataKHR triangles{
 		.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_TRIANGLES_DATA_KHR,
 		.vertexFormat = VK_FORMAT_R32G32B32_SFLOAT,
 		.vertexData = {.deviceAddress = mesh.vertexBuffer->getAddress()},
-		.vertexStride = sizeof(Vertex),
-		.maxVertex = static_cast<uint32_t>(mesh.vertices.size()) - 1,
-		.indexType = VK_INDEX_TYPE_UINT32,
+		.vertexStride = mesh.vertexStride,
+		.maxVertex = mesh.vertexCount - 1,
+		.indexType = (mesh.flags & MESH_INDEX_16) ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32,
 		.indexData = {.deviceAddress = mesh.indexBuffer->getAddress() },
 	};
 
@@ -156,180 +318,355 @@ void RayTracing::Scene::primitiveToGeometry(const Mesh& mesh, VkAccelerationStru
 }
 
 void RayTracing::Scene::createBottomAS() {
-	blasAccel.resize(meshes.size());
+	TRACE_ZONE("Scene::createBottomAS");
+	//only meshes loaded since the last build
+	std::vector<uint32_t> pending;
+	for (uint32_t i = 0; i < meshes.size(); i++) {
+		if (meshes[i].blas.handle == VK_NULL_HANDLE) pending.push_back(i);
+	}
+	if (pending.empty()) return;
+
+	std::vector<BlasBuildInput> inputs(pending.size());
+	for (uint32_t i = 0; i < pending.size(); i++)
+		primitiveToGeometry(meshes[pending[i]], inputs[i].geometry, inputs[i].rangeInfo);
+
+	VkBuildAccelerationStructureFlagsKHR flags = VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR;
+	if (compactBlas) flags |= VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_COMPACTION_BIT_KHR;
+
+	std::vector<AccelerationStructure> output;
+	blasTicket = blasBuilder->build(inputs, output, flags);
 
+	for (uint32_t i = 0; i < pending.size(); i++) {
+		meshes[pending[i]].blas = output[i];
+		meshes[pending[i]].blasTicket = blasTicket;
+	}
+}
+
+void RayTracing::Scene::swapCompactedBottomAS() {
+	std::vector<CompactedBlas> completed;
+	blasBuilder->update(completed, profiler);
+	if (completed.empty()) return;
+
+	std::unordered_map<VkAccelerationStructureKHR, const CompactedBlas*> compacted;
+	for (const CompactedBlas& blas : completed)
+		compacted.emplace(blas.source.handle, &blas);
+
+	//the previous frame may still trace the uncompacted BLAS
+	std::unordered_set<VkAccelerationStructureKHR> swapped;
 	for (uint32_t i = 0; i < meshes.size(); i++) {
-		VkAccelerationStructureGeometryKHR asGeometry{};
-		VkAccelerationStructureBuildRangeInfoKHR asBuildRangeInfo{};
+		auto it = compacted.find(meshes[i].blas.handle);
+		if (it == compacted.end()) continue;
 
-		primitiveToGeometry(meshes[i], asGeometry, asBuildRangeInfo);
+		retiring.accelerationStructures.push_back(meshes[i].blas);
+		meshes[i].blas = it->second->compacted;
+		meshes[i].blasTicket = it->second->ticket; //refreshInstances makes the frame wait on the copy
+		swapped.insert(meshes[i].blas.handle);
+	}
 
-		createAccelerationStructure(VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR, blasAccel[i], asGeometry, asBuildRangeInfo, VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR);
+	//the instances now reference a different BLAS, refreshInstances requests the rebuild
+	for (uint32_t i = 0; i < instances.size(); i++) {
+		if (swapped.contains(meshes.get(instances[i].getMesh()).blas.handle)) instancePatches.push_back(i);
 	}
 }
 
 void RayTracing::Scene::createTopAS() {
-	std::vector<VkAccelerationStructureInstanceKHR> tlasInstances;
-	tlasInstances.reserve(instances.size());
+	TRACE_ZONE("Scene::createTopAS");
+	auto alignUp = [](auto value, size_t alignment) noexcept { return ((value + alignment - 1) & ~(alignment - 1)); };
 
-	for (uint32_t i = 0; i < instances.size(); i++) {
-		uint32_t meshId = instances[i].getMeshId();
+	//instances can be added and removed without recreating the TLAS as long as they fit, growing doubles the capacity
+	//so adding instances one at a time does not recreate it every frame. The builds only read the live instances
+	tlasCapacity = std::max({ tlasCapacity * 2, instances.size(), 1u });
 
-		VkAccelerationStructureInstanceKHR asInstance{
-			.transform = instances[i].getTransformation(),
-			.instanceCustomIndex = meshId,
+	tlasInstances.resize(instances.size());
+	for (uint32_t i = 0; i < instances.size(); i++) {
+		tlasInstances[i] = VkAccelerationStructureInstanceKHR{
 			.mask = 0xFF,
 			.instanceShaderBindingTableRecordOffset = 0,
 			.flags = VK_GEOMETRY_INSTANCE_TRIANGLE_CULL_DISABLE_BIT_NV,
-			.accelerationStructureReference = blasAccel[meshId].address,
+			.accelerationStructureReference = meshes.get(instances[i].getMesh()).blas.address,
 		};
-		tlasInstances.emplace_back(asInstance);
 	}
-
-	VkCommandBuffer cmd = device.beginSingleTimeCommands();
-
-	constexpr size_t instanceAlignment = 16;
-
-	Core::Buffer stagingBuffer{
+	transforms.writeAll(tlasInstances.data());
+	tlasPendingSlices.assign(Core::SwapChain::MAX_FRAMES_IN_FLIGHT, std::vector<uint64_t>((tlasCapacity + 63) / 64, 0));
+	tlasChanged.assign((tlasCapacity + 63) / 64, 0);
+	tlasDegradation = 0.0f;
+	tlasRebuild = false;
+
+	//one slice per frame in flight, so the host never writes a slice the GPU may still read
+	tlasSliceSize = sizeof(VkAccelerationStructureInstanceKHR) * tlasCapacity;
+	tlasInstanceBuffer = std::make_unique<Core::Buffer>(
 		device,
-		std::span<VkAccelerationStructureInstanceKHR const>(tlasInstances).size_bytes(),
-		VK_BUFFER_USAGE_2_TRANSFER_SRC_BIT_KHR | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+		tlasSliceSize * Core::SwapChain::MAX_FRAMES_IN_FLIGHT,
+		VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
 		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-		instanceAlignment
-	};
+		16
+	);
+	tlasInstanceBuffer->map();
+	for (uint32_t i = 0; i < Core::SwapChain::MAX_FRAMES_IN_FLIGHT && !tlasInstances.empty(); i++)
+		tlasInstanceBuffer->writeToBuffer(tlasInstances.data(), std::span<VkAccelerationStructureInstanceKHR const>(tlasInstances).size_bytes(), tlasSliceSize * i);
 
-	Core::Buffer tlasInstanceBuffer{
-		device,
-		std::span<VkAccelerationStructureInstanceKHR const>(tlasInstances).size_bytes(),
-		VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-		instanceAlignment
+	VkAccelerationStructureGeometryInstancesDataKHR geometryInstances{
+		.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_INSTANCES_DATA_KHR,
+		.data = {.deviceAddress = tlasInstanceBuffer->getAddress() }
 	};
-
-	stagingBuffer.map();
-	stagingBuffer.writeToBuffer(tlasInstances.data());
-
-	VkBufferCopy2 copyRegionInfo{
-		.sType = VK_STRUCTURE_TYPE_BUFFER_COPY_2,
-		.srcOffset = 0,
-		.dstOffset = 0,
-		.size = std::span<VkAccelerationStructureInstanceKHR const>(tlasInstances).size_bytes()
+	tlasGeometry = VkAccelerationStructureGeometryKHR{
+		.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_KHR,
+		.geometryType = VK_GEOMETRY_TYPE_INSTANCES_KHR,
+		.geometry = {.instances = geometryInstances }
 	};
 
-	VkCopyBufferInfo2 copyBufferInfo{
-		.sType = VK_STRUCTURE_TYPE_COPY_BUFFER_INFO_2,
-		.srcBuffer = stagingBuffer.getBuffer(),
-		.dstBuffer = tlasInstanceBuffer.getBuffer(),
-		.regionCount = 1,
-		.pRegions = &copyRegionInfo
+	VkAccelerationStructureBuildGeometryInfoKHR asBuildInfo{
+		.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR,
+		.type = VK_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL_KHR,
+		.flags = TLAS_BUILD_FLAGS,
+		.mode = VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR,
+		.geometryCount = 1,
+		.pGeometries = &tlasGeometry
 	};
 
-	vkCmdCopyBuffer2(cmd, &copyBufferInfo);
-
-	device.endSingleTimeCommands(cmd);
+	VkAccelerationStructureBuildSizesInfoKHR asBuildSize{ .sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_SIZES_INFO_KHR };
+	device.getDispatch().vkGetAccelerationStructureBuildSizesKHR(device.getDevice(), VK_ACCELERATION_STRUCTURE_BUILD_TYPE_DEVICE_KHR, &asBuildInfo, &tlasCapacity, &asBuildSize);
 
-	{
-		VkAccelerationStructureGeometryKHR asGeometry{};
-		VkAccelerationStructureBuildRangeInfoKHR asBuildRangeInfo{};
+	//the scratch buffer is kept alive for refits and in-place rebuilds
+	VkDeviceSize scratchAlignment = device.getAccelProperties()->minAccelerationStructureScratchOffsetAlignment;
+	tlasScratchBuffer = std::make_unique<Core::Buffer>(
+		device,
+		std::max(asBuildSize.buildScratchSize, asBuildSize.updateScratchSize) + scratchAlignment,
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
+	);
+	tlasScratchAddress = alignUp(tlasScratchBuffer->getAddress(), scratchAlignment);
 
-		VkAccelerationStructureGeometryInstancesDataKHR geometryInstances{
-				.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_INSTANCES_DATA_KHR,
-				.data = {.deviceAddress = tlasInstanceBuffer.getAddress()}
-		};
+	device.createBuffer(asBuildSize.accelerationStructureSize, VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_STORAGE_BIT_KHR | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &tlasAccel.buffer, &tlasAccel.memory);
 
-		asGeometry = {
-			.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_KHR,
-			.geometryType = VK_GEOMETRY_TYPE_INSTANCES_KHR,
-			.geometry = {.instances = geometryInstances }
-		};
+	VkAccelerationStructureCreateInfoKHR createInfo{
+		.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_CREATE_INFO_KHR,
+		.buffer = tlasAccel.buffer,
+		.size = asBuildSize.accelerationStructureSize,
+		.type = VK_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL_KHR,
+	};
+	VK_CHECK_RESULT(device.getDispatch().vkCreateAccelerationStructureKHR(device.getDevice(), &createInfo, nullptr, &tlasAccel.handle), "failed to create top level acceleration structure!");
 
-		asBuildRangeInfo = { .primitiveCount = static_cast<uint32_t>(instances.size()) };
+	VkAccelerationStructureDeviceAddressInfoKHR info{ .sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_DEVICE_ADDRESS_INFO_KHR,
+													.accelerationStructure = tlasAccel.handle };
+	tlasAccel.address = device.getDispatch().vkGetAccelerationStructureDeviceAddressKHR(device.getDevice(), &info);
 
-		createAccelerationStructure(VK_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL_KHR, tlasAccel, asGeometry, asBuildRangeInfo, VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR);
-	}
+	VkCommandBuffer cmd = device.beginSingleTimeCommands(Core::QUEUE_COMPUTE);
+	recordTopASBuild(cmd, VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR, 0);
+	tlasTicket = device.submitSingleTimeCommands(cmd, std::span<const Core::GpuTicket>(&blasTicket, 1), Core::QUEUE_COMPUTE);
 }
-void RayTracing::Scene::createAccelerationStructure(VkAccelerationStructureTypeKHR asType,
-	AccelerationStructure& accelStructure,
-	VkAccelerationStructureGeometryKHR& asGeometry,
-	VkAccelerationStructureBuildRangeInfoKHR& asBuildRangeInfo,
-	VkBuildAccelerationStructureFlagsKHR flags) {
-	auto alignUp = [](auto value, size_t alignment) noexcept { return ((value + alignment - 1) & ~(alignment - 1)); };
+
+void RayTracing::Scene::recordTopASBuild(VkCommandBuffer cmd, VkBuildAccelerationStructureModeKHR mode, uint32_t slice) {
+	tlasGeometry.geometry.instances.data.deviceAddress = tlasInstanceBuffer->getAddress(tlasSliceSize * slice);
 
 	VkAccelerationStructureBuildGeometryInfoKHR asBuildInfo{
 		.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR,
-		.type = asType,
-		.flags = flags,
-		.mode = VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR,
+		.type = VK_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL_KHR,
+		.flags = TLAS_BUILD_FLAGS,
+		.mode = mode,
+		.srcAccelerationStructure = mode == VK_BUILD_ACCELERATION_STRUCTURE_MODE_UPDATE_KHR ? tlasAccel.handle : VK_NULL_HANDLE,
+		.dstAccelerationStructure = tlasAccel.handle,
 		.geometryCount = 1,
-		.pGeometries = &asGeometry
+		.pGeometries = &tlasGeometry,
+		.scratchData = {.deviceAddress = tlasScratchAddress }
 	};
 
-	std::vector<uint32_t> maxPrimCount(1);
-	maxPrimCount[0] = asBuildRangeInfo.primitiveCount;
+	VkAccelerationStructureBuildRangeInfoKHR asBuildRangeInfo{ .primitiveCount = static_cast<uint32_t>(tlasInstances.size()) };
+	VkAccelerationStructureBuildRangeInfoKHR* pBuildRangeInfo = &asBuildRangeInfo;
+
+	device.getDispatch().vkCmdBuildAccelerationStructuresKHR(cmd, 1, &asBuildInfo, &pBuildRangeInfo);
+}
 
-	VkAccelerationStructureBuildSizesInfoKHR asBuildSize{ .sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_SIZES_INFO_KHR };
-	vkGetAccelerationStructureBuildSizesKHR(device.getDevice(), VK_ACCELERATION_STRUCTURE_BUILD_TYPE_DEVICE_KHR, &asBuildInfo, maxPrimCount.data(), &asBuildSize);
+bool RayTracing::Scene::updateTopAS(VkCommandBuffer cmd, uint32_t frameIndex) {
+	//more instances than the TLAS was created for need a new acceleration structure, the previous frame may still trace the old one
+	if (instances.size() > tlasCapacity) {
+		retiring.accelerationStructures.push_back(tlasAccel);
+		retiring.buffers.push_back(std::move(tlasInstanceBuffer));
+		retiring.buffers.push_back(std::move(tlasScratchBuffer));
 
-	VkDeviceSize scratchSize = alignUp(asBuildSize.buildScratchSize, device.getAccelProperties()->minAccelerationStructureScratchOffsetAlignment);
+		createTopAS();
+		device.addFrameDependency(tlasTicket);
+		return true;
+	}
 
-	Core::Buffer scratchBuffer{
-		device,
-		asBuildSize.buildScratchSize,
-		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_STORAGE_BIT_KHR,
-		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
-		device.getAccelProperties()->minAccelerationStructureScratchOffsetAlignment
-	};
+	//moved instances are written into the CPU copy once and into every slice before that slice is used again
+	std::fill(tlasChanged.begin(), tlasChanged.end(), 0);
+	uint32_t dirtyCount = transforms.writeDirty(tlasInstances.data(), tlasChanged);
 
-	device.createBuffer(asBuildSize.accelerationStructureSize, VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_STORAGE_BIT_KHR | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, &accelStructure.buffer, &accelStructure.memory);
+	if (dirtyCount > 0) {
+		for (std::vector<uint64_t>& pending : tlasPendingSlices) {
+			for (size_t word = 0; word < pending.size(); word++)
+				pending[word] |= tlasChanged[word];
+		}
+	}
 
-	VkAccelerationStructureCreateInfoKHR createInfo{
-		.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_CREATE_INFO_KHR,
-		.buffer = accelStructure.buffer,
-		.size = asBuildSize.accelerationStructureSize,
-		.type = asType,
+	auto* slice = reinterpret_cast<VkAccelerationStructureInstanceKHR*>(static_cast<uint8_t*>(tlasInstanceBuffer->getMappedMemory()) + tlasSliceSize * frameIndex);
+	std::vector<uint64_t>& pending = tlasPendingSlices[frameIndex];
+
+	//bits of removed instances are dropped, the build only reads the first tlasInstances.size() entries
+	for (size_t word = 0; word < pending.size(); word++) {
+		for (uint64_t bits = pending[word]; bits != 0; bits &= bits - 1) {
+			size_t i = word * 64 + std::countr_zero(bits);
+			if (i < tlasInstances.size()) slice[i] = tlasInstances[i];
+		}
+		pending[word] = 0;
+	}
+
+	//pending writes alone only bring this slice up to date, the acceleration structure already matches them
+	if (dirtyCount == 0 && !tlasRebuild) return false;
+
+	//refits keep the tree topology, rebuild in place once the instances moved too far from where it was built
+	//or instances were added or removed
+	tlasDegradation += static_cast<float>(dirtyCount) / static_cast<float>(std::max(instances.size(), 1u));
+	VkBuildAccelerationStructureModeKHR mode = VK_BUILD_ACCELERATION_STRUCTURE_MODE_UPDATE_KHR;
+	if (tlasRebuild || tlasDegradation > TLAS_REFIT_LIMIT) {
+		mode = VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR;
+		tlasDegradation = 0.0f;
+		tlasRebuild = false;
+	}
+
+	//the previous frame may still trace against the acceleration structure
+	vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR, 0, 0, VK_NULL_HANDLE, 0, VK_NULL_HANDLE, 0, VK_NULL_HANDLE);
+
+	recordTopASBuild(cmd, mode, frameIndex);
+
+	VkMemoryBarrier barrier{
+		.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+		.srcAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR,
+		.dstAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_KHR
 	};
+	vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR, 0, 1, &barrier, 0, VK_NULL_HANDLE, 0, VK_NULL_HANDLE);
 
-	vkCreateAccelerationStructureKHR(device.getDevice(), &createInfo, nullptr, &accelStructure.handle);
+	return false;
+}
 
-	VkCommandBuffer cmd = device.beginSingleTimeCommands();
-	asBuildInfo.dstAccelerationStructure = accelStructure.handle;
-	asBuildInfo.scratchData = { .deviceAddress = scratchBuffer.getAddress() };
+void RayTracing::Scene::refreshInstances() {
+	instanceInfo.resize(instances.size());
+	tlasInstances.resize(instances.size());
+
+	std::vector<uint32_t> deferred;
+	for (uint32_t i : instancePatches) {
+		if (i >= instances.size()) continue;
+
+		instanceInfo[i] = getInstanceInfo(i);
+		instanceBuffer.markDirty(i);
+
+		//instances of meshes whose BLAS is still building on the compute queue are inactive until it completed,
+		//the frame keeps tracing meanwhile and only waits for builds it already uses
+		const Mesh& mesh = meshes.get(instances[i].getMesh());
+		bool ready = device.isComplete(mesh.blasTicket);
+		if (ready) device.addFrameDependency(mesh.blasTicket);
+		else deferred.push_back(i);
+
+		//transforms of moved and new instances are marked dirty and written by updateTopAS
+		VkAccelerationStructureInstanceKHR& tlasInstance = tlasInstances[i];
+		tlasInstance.mask = ready ? 0xFF : 0x00;
+		tlasInstance.instanceShaderBindingTableRecordOffset = 0;
+		tlasInstance.flags = VK_GEOMETRY_INSTANCE_TRIANGLE_CULL_DISABLE_BIT_NV;
+		tlasInstance.accelerationStructureReference = ready ? mesh.blas.address : 0;
+
+		if (i >= tlasCapacity) continue;
+		for (std::vector<uint64_t>& pending : tlasPendingSlices)
+			pending[i >> 6] |= 1ULL << (i & 63);
+	}
 
-	VkAccelerationStructureBuildRangeInfoKHR* pBuildRangeInfo = &asBuildRangeInfo;
-	vkCmdBuildAccelerationStructuresKHR(cmd, 1, &asBuildInfo, &pBuildRangeInfo);
+	//activating an instance changes the acceleration structure it references, which a refit may not do
+	if (deferred.size() < instancePatches.size()) tlasRebuild = true;
+	instancePatches.swap(deferred);
+}
 
-	VkAccelerationStructureDeviceAddressInfoKHR info{ .sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_DEVICE_ADDRESS_INFO_KHR,
-													.accelerationStructure = accelStructure.handle };
-	accelStructure.address = vkGetAccelerationStructureDeviceAddressKHR(device.getDevice(), &info);
+void RayTracing::Scene::updateSceneBuffers(VkCommandBuffer cmd, uint32_t frameIndex) {
+	if (!materialBuffer.needsUpload(materials.size()) && !lightBuffer.needsUpload(lights.size()) && !instanceBuffer.needsUpload(instances.size()) &&
+		!lightTreeBuffer.needsUpload(static_cast<uint32_t>(lightTree.size())) && !lightAliasBuffer.needsUpload(static_cast<uint32_t>(lightAliasTable.size())) &&
+		!sceneInfoOutdated) return;
+
+	//the previous frame may still read the scene buffers
+	vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, VK_NULL_HANDLE, 0, VK_NULL_HANDLE, 0, VK_NULL_HANDLE);
+
+	//addresses in the scene information only change when a buffer had to grow
+	sceneInfoOutdated |= materialBuffer.upload(cmd, frameIndex, materials.data(), materials.size(), retiring.buffers);
+	sceneInfoOutdated |= lightBuffer.upload(cmd, frameIndex, lights.data(), lights.size(), retiring.buffers);
+	sceneInfoOutdated |= instanceBuffer.upload(cmd, frameIndex, instanceInfo.data(), instances.size(), retiring.buffers);
+	sceneInfoOutdated |= lightTreeBuffer.upload(cmd, frameIndex, lightTree.data(), static_cast<uint32_t>(lightTree.size()), retiring.buffers);
+	sceneInfoOutdated |= lightAliasBuffer.upload(cmd, frameIndex, lightAliasTable.data(), static_cast<uint32_t>(lightAliasTable.size()), retiring.buffers);
+
+	if (sceneInfoOutdated) {
+		SceneBufferInfo info = getSceneBufferInfo();
+		vkCmdUpdateBuffer(cmd, sceneInfoBuffer->getBuffer(), 0, sizeof(SceneBufferInfo), &info);
+		sceneInfoOutdated = false;
+	}
 
-	device.endSingleTimeCommands(cmd);
+	VkMemoryBarrier barrier{
+		.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+		.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+		.dstAccessMask = VK_ACCESS_SHADER_READ_BIT
+	};
+	vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR, 0, 1, &barrier, 0, VK_NULL_HANDLE, 0, VK_NULL_HANDLE);
 }
 
-void RayTracing::Scene::createLightAccelerationStructure() {
-	
+void RayTracing::Scene::releaseResources(RetiredResources& resources) {
+	//a mesh may be unloaded before its BLAS build completed
+	for (Mesh& mesh : resources.meshes) {
+		device.wait(mesh.blasTicket);
+		blasBuilder->release(mesh.blas);
+		destroyAccelerationStructure(mesh.blas);
+	}
+	for (AccelerationStructure& accel : resources.accelerationStructures)
+		destroyAccelerationStructure(accel);
+
+	resources.meshes.clear();
+	resources.accelerationStructures.clear();
+	resources.buffers.clear();
 }
 
-void RayTracing::Scene::createMaterials() {
-	uint64_t size = materials.size() * sizeof(Material);
+void RayTracing::Scene::destroyAccelerationStructure(AccelerationStructure& accel) {
+	if (accel.handle == VK_NULL_HANDLE) return;
 
-	materialBuffer = std::make_unique<Core::Buffer>(
-		device, size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT
-	);
+	device.getDispatch().vkDestroyAccelerationStructureKHR(device.getDevice(), accel.handle, nullptr);
+	vkDestroyBuffer(device.getDevice(), accel.buffer, nullptr);
+	device.freeMemory(accel.memory);
+	accel = AccelerationStructure{};
+}
 
-	stageInformation(materials.data(), size, materialBuffer->getBuffer());
+void RayTracing::Scene::updateLightSampling() {
+	if (lightSampling == LIGHT_SAMPLING_TREE && lightTreeOutdated) createLightAccelerationStructure();
+	if (lightSampling == LIGHT_SAMPLING_ALIAS && lightAliasOutdated) createLightAliasTable();
 }
 
-void RayTracing::Scene::createLights() {
-	uint64_t size = lights.size() * sizeof(Light);
+void RayTracing::Scene::createLightAccelerationStructure() {
+	TRACE_ZONE("Scene::createLightAccelerationStructure");
+	//the tree references dense light indices and is rebuilt as a whole, the node count changes with the light count
+	LightBVHBuilder(threadPool).build(std::span<const Light>(lights.data(), lights.size()), lightTree);
 
-	lightBuffer = std::make_unique<Core::Buffer>(
-		device, size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT
-	);
+	lightTreeBuffer.markDirty(0, static_cast<uint32_t>(lightTree.size()));
+	lightTreeOutdated = false;
+	sceneInfoOutdated = true;
+}
 
-	stageInformation(lights.data(), size, lightBuffer->getBuffer());
+void RayTracing::Scene::createLightAliasTable() {
+	TRACE_ZONE("Scene::createLightAliasTable");
+	lightPowers.resize(lights.size());
+	for (uint32_t i = 0; i < lights.size(); i++)
+		lightPowers[i] = getLightPower(lights[i]);
+
+	AliasTable::build(lightPowers, lightAliasScratch);
+
+	//building is linear in the light count, only entries that changed are uploaded
+	uint32_t count = static_cast<uint32_t>(lightAliasScratch.size());
+	uint32_t previousCount = static_cast<uint32_t>(std::min(lightAliasTable.size(), lightAliasScratch.size()));
+	for (uint32_t i = 0; i < count; i++) {
+		const AliasTableEntry& entry = lightAliasScratch[i];
+		if (i < previousCount && memcmp(&entry, &lightAliasTable[i], sizeof(AliasTableEntry)) == 0) continue;
+		lightAliasBuffer.markDirty(i);
+	}
+
+	if (count != lightAliasTable.size()) sceneInfoOutdated = true;
+	std::swap(lightAliasTable, lightAliasScratch);
+	lightAliasOutdated = false;
 }
 
 void RayTracing::Scene::createSky() {
+	TRACE_ZONE("Scene::createSky");
 	SkyInfo info{
 		.skyColor = {0.17f, 0.24f, 0.31f},
 		.horizonColor = {1.f, 0.5f, 0.31f},
@@ -353,105 +690,153 @@ void RayTracing::Scene::createSky() {
 	stageInformation(&info, sizeof(SkyInfo), skyBuffer->getBuffer());
 }
 
-void RayTracing::Scene::createSceneInformation() {
-	std::vector<InstanceInfo> instanceInfo;
-	instanceInfo.resize(instances.size());
+void RayTracing::Scene::createSceneInfoBuffer() {
+	TRACE_ZONE("Scene::createSceneInfoBuffer");
+	std::cout << "Lights: " << lights.size() << std::endl;
 
-	for (uint32_t i = 0; i < instances.size(); i++) {
-		uint32_t meshId = instances[i].getMeshId();
-		
-		instanceInfo[i] = {
-			.vertexAddress = meshes[meshId].vertexBuffer->getAddress(),
-			.indexAddress = meshes[meshId].indexBuffer->getAddress(),
-			.materialId = instances[i].getMaterialId()
-		};
-	}
+	SceneBufferInfo info = getSceneBufferInfo();
 
-	instanceBuffer = std::make_unique<Core::Buffer>(
-		device, sizeof(InstanceInfo) * instanceInfo.size(), VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT
+	sceneInfoBuffer = std::make_unique<Core::Buffer>(
+		device, sizeof(SceneBufferInfo), VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT
 	);
 
-	stageInformation(instanceInfo.data(), sizeof(InstanceInfo) * instanceInfo.size(), instanceBuffer->getBuffer());
+	stageInformation(&info, sizeof(SceneBufferInfo), sceneInfoBuffer->getBuffer());
+}
+
+RayTracing::InstanceInfo RayTracing::Scene::getInstanceInfo(uint32_t index) {
+	const Mesh& mesh = meshes.get(instances[index].getMesh());
+
+	return InstanceInfo{
+		.vertexAddress = mesh.vertexBuffer->getAddress(),
+		.indexAddress = mesh.indexBuffer->getAddress(),
+		.materialId = materials.indexOf(instances[index].getMaterial()),
+		.meshFlags = mesh.flags
+	};
 }
 
-void RayTracing::Scene::createSceneInfoBuffer() {
-	std::cout << "Lights: " << lights.size() << std::endl;
+RayTracing::SceneBufferInfo RayTracing::Scene::getSceneBufferInfo() {
+	Core::BufferView<Material> materialView = materialBuffer.getView<Material>(materials.size());
+	Core::BufferView<Light> lightView = lightBuffer.getView<Light>(lights.size());
+	Core::BufferView<InstanceInfo> instanceView = instanceBuffer.getView<InstanceInfo>(instances.size());
+	Core::BufferView<SkyInfo> skyView = skyBuffer->getView<SkyInfo>(0, 1);
+	Core::BufferView<LightBVHNode> lightTreeView = lightTreeBuffer.getView<LightBVHNode>(static_cast<uint32_t>(lightTree.size()));
+	Core::BufferView<AliasTableEntry> lightAliasView = lightAliasBuffer.getView<AliasTableEntry>(static_cast<uint32_t>(lightAliasTable.size()));
 
 	SceneBufferInfo info{
-		.mBuf = materialBuffer->getAddress(),
-		.mStride = sizeof(Material),
+		.mBuf = materialView.address,
+		.mStride = materialView.stride,
 		
-		.lBuf = lightBuffer->getAddress(),
-		.lStride = sizeof(Light),
-		.lCount = lights.size(),
+		.lBuf = lightView.address,
+		.lStride = lightView.stride,
+		.lCount = lightView.count,
 
-		.vStride = sizeof(Vertex),
+		.vStride = vertexFormat == VERTEX_FORMAT_COMPACT ? sizeof(CompactVertex) : sizeof(Vertex),
 
-		.sBuf = instanceBuffer->getAddress(),
-		.sStride = sizeof(InstanceInfo),
+		.sBuf = instanceView.address,
+		.sStride = instanceView.stride,
 
-		.skyBuf = skyBuffer->getAddress(),
-		.skyStride = sizeof(SkyInfo)
+		.skyBuf = skyView.address,
+		.skyStride = skyView.stride,
+
+		.ltBuf = lightTreeView.address,
+		.ltStride = lightTreeView.stride,
+		.ltCount = lightTreeView.count,
+
+		.laBuf = lightAliasView.address,
+		.laStride = lightAliasView.stride,
+		.laCount = lightAliasView.count,
+
+		.lightSampling = lightSampling
 	};
 
-	sceneInfoBuffer = std::make_unique<Core::Buffer>(
-		device, sizeof(SceneBufferInfo), VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT
-	);
+#ifdef _DEBUG
+	validateSceneBufferInfo(info);
+#endif
+	return info;
+}
 
-	stageInformation(&info, sizeof(SceneBufferInfo), sceneInfoBuffer->getBuffer());
+#ifdef _DEBUG
+void RayTracing::Scene::validateSceneBufferInfo(const SceneBufferInfo& info) const {
+	//struct layouts are checked at compile time next to the structs, only the vertex stride depends on the meshes
+	for (const Mesh& mesh : meshes) {
+		if (mesh.vertexStride != info.vStride)
+			throw std::runtime_error("vertex buffer stride is " + std::to_string(mesh.vertexStride) + " bytes, the scene reads " + std::to_string(info.vStride) + "!");
+		if (mesh.vertexBuffer->getAddress() % alignof(float) != 0)
+			throw std::runtime_error("vertex buffer is not aligned to " + std::to_string(alignof(float)) + " bytes!");
+	}
 }
+#endif
 
 void RayTracing::Scene::stageInformation(void* data, uint64_t size, VkBuffer dstBuffer) {
-	Core::Buffer stagingBuffer{
-		device,
-		size,
-		VK_BUFFER_USAGE_TRANSFER_SRC_BIT, 
-		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
-	};
+	device.getStagingRing().upload(dstBuffer, 0, data, size);
+}
 
-	stagingBuffer.map();
-	stagingBuffer.writeToBuffer(data);
+//octahedral mapping of a unit vector onto [-1, 1]^2
+static glm::vec2 encodeOctahedral(glm::vec3 n) {
+	n /= (std::abs(n.x) + std::abs(n.y) + std::abs(n.z));
+	glm::vec2 e(n.x, n.y);
+	if (n.z < 0.0f) {
+		glm::vec2 signs(e.x >= 0.0f ? 1.0f : -1.0f, e.y >= 0.0f ? 1.0f : -1.0f);
+		e = (1.0f - glm::abs(glm::vec2(e.y, e.x))) * signs;
+	}
+	return e;
+}
+
+static RayTracing::CompactVertex compactVertex(const RayTracing::Vertex& vertex) {
+	glm::vec3 normal(vertex.normal[0], vertex.normal[1], vertex.normal[2]);
+	float length = glm::length(normal);
 
-	device.copyBuffer(stagingBuffer.getBuffer(), dstBuffer, size);
+	return RayTracing::CompactVertex{
+		.pos = { vertex.pos[0], vertex.pos[1], vertex.pos[2] },
+		.normal = length > 0.0f ? glm::packSnorm2x16(encodeOctahedral(normal / length)) : 0u,
+		.uv = glm::packHalf2x16(glm::vec2(vertex.uv[0], vertex.uv[1]))
+	};
 }
 
-RayTracing::Mesh::Mesh(Core::Device& device, std::vector<Vertex> vertices, std::vector<uint32_t> indices) : vertices(vertices), indices(indices) {
-	
-	{
-		vertexBuffer = std::make_unique<Core::Buffer>(
-			device, 
-			sizeof(Vertex) * vertices.size(), 
-			VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR | VK_BUFFER_USAGE_TRANSFER_DST_BIT, 
-			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT
-		);
-		Core::Buffer stagingBuffer{ device, 
-			sizeof(Vertex) * vertices.size(), 
-			VK_BUFFER_USAGE_TRANSFER_SRC_BIT, 
-			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT };
-
-		stagingBuffer.map();
-		stagingBuffer.writeToBuffer((void*)vertices.data());
-
-		device.copyBuffer(stagingBuffer.getBuffer(), vertexBuffer->getBuffer(), sizeof(Vertex) * vertices.size());
-	}
-	{
-		indexBuffer = std::make_unique<Core::Buffer>(
-			device,
-			sizeof(uint32_t) * indices.size(),
-			VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT
-		);
-		Core::Buffer stagingBuffer{
-			device,
-			sizeof(uint32_t) * indices.size(),
-			VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
-		};
+RayTracing::Mesh::Mesh(Core::Device& device, std::span<const Vertex> vertices, std::span<const uint32_t> indices, VertexFormat format)
+	: vertexCount(static_cast<uint32_t>(vertices.size())), indexCount(static_cast<uint32_t>(indices.size())), vertexStride(sizeof(Vertex)), flags(0) {
+
+	std::span<const std::byte> vertexData = std::as_bytes(vertices);
+	std::span<const std::byte> indexData = std::as_bytes(indices);
+
+	std::vector<CompactVertex> compactVertices;
+	std::vector<uint16_t> compactIndices;
+
+	if (format == VERTEX_FORMAT_COMPACT) {
+		compactVertices.resize(vertices.size());
+		for (size_t i = 0; i < vertices.size(); i++)
+			compactVertices[i] = compactVertex(vertices[i]);
+
+		vertexData = std::as_bytes(std::span<const CompactVertex>(compactVertices));
+		vertexStride = sizeof(CompactVertex);
+		flags |= MESH_COMPACT_VERTICES;
 
-		stagingBuffer.map();
-		stagingBuffer.writeToBuffer((void*)indices.data());
+		if (vertices.size() < 65536) {
+			//padded to a whole number of 32-bit words, the hit shader reads indices in pairs
+			compactIndices.resize(indices.size() + (indices.size() & 1), 0);
+			for (size_t i = 0; i < indices.size(); i++)
+				compactIndices[i] = static_cast<uint16_t>(indices[i]);
 
-		device.copyBuffer(stagingBuffer.getBuffer(), indexBuffer->getBuffer(), sizeof(uint32_t) * indices.size());
+			indexData = std::as_bytes(std::span<const uint16_t>(compactIndices));
+			flags |= MESH_INDEX_16;
+		}
 	}
 
-}
+	vertexBuffer = std::make_unique<Core::Buffer>(
+		device, 
+		vertexData.size_bytes(), 
+		VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR | VK_BUFFER_USAGE_TRANSFER_DST_BIT, 
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT
+	);
+	indexBuffer = std::make_unique<Core::Buffer>(
+		device,
+		indexData.size_bytes(),
+		VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT
+	);
+
+	//the copies are batched with every other upload and submitted before the BLAS build reads the geometry
+	Core::StagingRing& stagingRing = device.getStagingRing();
+	stagingRing.upload(vertexBuffer->getBuffer(), 0, vertexData.data(), vertexData.size_bytes());
+	stagingRing.upload(indexBuffer->getBuffer(), 0, indexData.data(), indexData.size_bytes());
+}
\ No newline at end of file
@@ -1,20 +1,23 @@
 #pragma once
 
-#include "Debugging.h"
+#include "../Tracer.h"
 #include "MeshInstance.h"
+#include "InstanceTransforms.h"
+#include "SlotMap.h"
+#include "GpuArray.h"
 
 #include "../vulkan_core/Device.h"
 #include "../vulkan_core/Buffer.h"
-#include "../tinyobj/tiny_obj_loader.h"
+#include "../vulkan_core/GpuProfiler.h"
+#include "../ThreadPool.h"
+#include "../vulkan_core/SwapChain.h"
+#include <algorithm>
+#include <array>
+#include <cstddef>
 #include <unordered_map>
+#include <span>
 #include <glm/glm.hpp>
 
-#define vkCmdBuildAccelerationStructuresKHR reinterpret_cast<PFN_vkCmdBuildAccelerationStructuresKHR>(vkGetDeviceProcAddr(device.getDevice(), "vkCmdBuildAccelerationStructuresKHR"))
-#define vkCreateAccelerationStructureKHR reinterpret_cast<PFN_vkCreateAccelerationStructureKHR>(vkGetDeviceProcAddr(device.getDevice(), "vkCreateAccelerationStructureKHR"))
-#define vkGetAccelerationStructureBuildSizesKHR reinterpret_cast<PFN_vkGetAccelerationStructureBuildSizesKHR>(vkGetDeviceProcAddr(device.getDevice(), "vkGetAccelerationStructureBuildSizesKHR"))
-#define vkDestroyAccelerationStructureKHR reinterpret_cast<PFN_vkDestroyAccelerationStructureKHR>(vkGetDeviceProcAddr(device.getDevice(), "vkDestroyAccelerationStructureKHR"))
-#define vkGetAccelerationStructureDeviceAddressKHR reinterpret_cast<PFN_vkGetAccelerationStructureDeviceAddressKHR>(vkGetDeviceProcAddr(device.getDevice(), "vkGetAccelerationStructureDeviceAddressKHR"))
-
 #define ROUGHNESS_ZERO 0.0001f
 
 template <typename T, typename... Rest>
@@ -36,15 +39,52 @@ namespace RayTracing {
 				uv[0] == other.uv[0] && uv[1] == other.uv[1];
 		}
 	};
+	static_assert(sizeof(Vertex) == 32 && offsetof(Vertex, normal) == 12 && offsetof(Vertex, uv) == 24,
+		"Vertex must match getTriangeInformation in mesh.slang");
+
+	/*
+	 * Quantized vertex layout (20 bytes)
+	 * Positions stay full precision for the BLAS build, normals are octahedral encoded into two snorm16
+	 * and uvs are stored as two half floats. Decoded in shaders/utils/mesh.slang.
+	 */
+	struct CompactVertex {
+		float pos[3];
+		uint32_t normal; //octahedral normal, packed snorm16x2
+		uint32_t uv; //packed half2
+	};
+	static_assert(sizeof(CompactVertex) == 20 && offsetof(CompactVertex, normal) == 12 && offsetof(CompactVertex, uv) == 16,
+		"CompactVertex must match getTriangeInformation in mesh.slang");
+
+	enum VertexFormat : uint32_t {
+		VERTEX_FORMAT_FULL, //RayTracing::Vertex, 32-bit indices
+		VERTEX_FORMAT_COMPACT //RayTracing::CompactVertex, 16-bit indices for meshes with less than 65536 vertices
+	};
+
+	enum MeshFlags : uint32_t {
+		MESH_INDEX_16 = 1 << 0, //index buffer holds uint16 indices
+		MESH_COMPACT_VERTICES = 1 << 1 //vertex buffer holds CompactVertex
+	};
+
+	struct AccelerationStructure {
+		VkAccelerationStructureKHR handle;
+		VkBuffer buffer;
+		Core::Allocation memory;
+		VkDeviceAddress address;
+	};
 
 	struct Mesh {
-		Mesh(Core::Device& device, std::vector<Vertex> vertices, std::vector<uint32_t> indices);
+		Mesh(Core::Device& device, std::span<const Vertex> vertices, std::span<const uint32_t> indices, VertexFormat format = VERTEX_FORMAT_FULL);
 
-		std::vector<Vertex> vertices;
-		std::vector<uint32_t> indices;
+		uint32_t vertexCount;
+		uint32_t indexCount;
+		uint32_t vertexStride;
+		uint32_t flags; //MeshFlags
+		uint32_t instanceCount = 0; //instances referencing this mesh
 
 		std::unique_ptr<Core::Buffer> vertexBuffer;
 		std::unique_ptr<Core::Buffer> indexBuffer;
+		AccelerationStructure blas{}; //null handle until built by the next Scene::build or Scene::update
+		Core::GpuTicket blasTicket; //instances of the mesh stay inactive until the BLAS build completed
 	};
 
 	struct Material {
@@ -60,6 +100,22 @@ namespace RayTracing {
 		float clearCoat;
 		float clearCoatGloss;
 	};
+	static_assert(sizeof(Material) == 52 && offsetof(Material, subsurface) == 12 && offsetof(Material, clearCoatGloss) == 48,
+		"Material must match Mesh::Material in mesh.slang");
+
+	//lobes of the Disney BRDF that can be compiled out of the ray tracing pipeline, see PipelineVariant
+	enum MaterialFeatures : uint32_t {
+		MATERIAL_FEATURE_SUBSURFACE = 1 << 0,
+		MATERIAL_FEATURE_SHEEN = 1 << 1,
+		MATERIAL_FEATURE_CLEARCOAT = 1 << 2,
+		MATERIAL_FEATURE_ANISOTROPIC = 1 << 3,
+		MATERIAL_FEATURE_ALL = (1 << 4) - 1
+	};
+
+	enum MeshImportFlags : uint32_t {
+		IMPORT_DEFAULT = 0,
+		IMPORT_OPTIMIZE = 1 << 0 //reorder triangles and vertices for fetch locality (see MeshOptimizer)
+	};
 
 	enum LightType : uint8_t {
 		POINT,
@@ -73,19 +129,33 @@ namespace RayTracing {
 		float intensity;
 		LightType type;
 	};
-
-	struct AccelerationStructure {
-		VkAccelerationStructureKHR handle;
-		VkBuffer buffer;
-		VkDeviceMemory memory;
-		VkDeviceAddress address;
+	static_assert(sizeof(Light) == 32 && offsetof(Light, color) == 12 && offsetof(Light, intensity) == 24 && offsetof(Light, type) == 28,
+		"Light must match processLight in light.slang");
+
+	//emitted power used to distribute light samples, the luminance of the color scaled by the intensity
+	inline float getLightPower(const Light& light) {
+		float luminance = 0.2126f * light.color[0] + 0.7152f * light.color[1] + 0.0722f * light.color[2];
+		return std::max(light.intensity * luminance, 0.0f);
+	}
+
+	enum LightSampling : uint32_t {
+		LIGHT_SAMPLING_TREE, //walks the light BVH by estimated contribution at the shading point
+		LIGHT_SAMPLING_ALIAS //picks lights in proportion to their power in O(1), independent of the shading point
 	};
 
+	using MeshHandle = Handle<Mesh>;
+	using MaterialHandle = Handle<Material>;
+	using LightHandle = Handle<Light>;
+	using InstanceHandle = Handle<MeshInstance>;
+
 	struct InstanceInfo {
 		uint64_t vertexAddress; //address of vertex buffer
 		uint64_t indexAddress; //address of index buffer
 		uint32_t materialId; //id of material
+		uint32_t meshFlags; //MeshFlags of the referenced mesh
 	};
+	static_assert(sizeof(InstanceInfo) == 24 && offsetof(InstanceInfo, indexAddress) == 8 && offsetof(InstanceInfo, materialId) == 16 && offsetof(InstanceInfo, meshFlags) == 20,
+		"InstanceInfo must match getTriangeInformation and getMaterial in mesh.slang");
 
 	struct SkyInfo {
 		float skyColor[3];
@@ -111,41 +181,97 @@ namespace RayTracing {
 		uint64_t lStride; //byte stride of light
 		uint64_t lCount; //count of lights
 
-		uint64_t vStride; //byte stride of vertices
+		uint64_t vStride; //byte stride of vertices, depends on the VertexFormat of the scene
 
 		uint64_t sBuf; //address of scene buffer
 		uint64_t sStride; //byte stride of scene info
 
 		uint64_t skyBuf;
 		uint64_t skyStride;
+
+		uint64_t ltBuf; //address of light tree
+		uint64_t ltStride; //byte stride of light tree node
+		uint64_t ltCount; //count of light tree nodes, 0 without lights
+
+		uint64_t laBuf; //address of light alias table
+		uint64_t laStride; //byte stride of alias table entry
+		uint64_t laCount; //count of alias table entries, 0 without lights or power
+
+		uint64_t lightSampling; //LightSampling used by the shaders
 	};
+	static_assert(sizeof(SceneBufferInfo) == 136 && offsetof(SceneBufferInfo, vStride) == 40 && offsetof(SceneBufferInfo, skyBuf) == 64 &&
+		offsetof(SceneBufferInfo, ltBuf) == 80 && offsetof(SceneBufferInfo, laBuf) == 104 && offsetof(SceneBufferInfo, lightSampling) == 128,
+		"SceneBufferInfo must match SceneBuffer in shaderio.slang");
 
+	//built by LightBVHBuilder, traversed in shaders/utils/light.slang
 	struct LightBVHNode {
 		float bBoxMin[3];
 		float bBoxMax[3];
 		float totalFlux;
 		float coneAxis[3];
-		float coneAngle;
-		int childIndex;
+		float coneAngle; //bounds the normals of all lights below, PI for omnidirectional lights
+		int childIndex; //children at childIndex and childIndex + 1, ~lightIndex for leaves
+	};
+	static_assert(sizeof(LightBVHNode) == 48 && offsetof(LightBVHNode, totalFlux) == 24 && offsetof(LightBVHNode, coneAxis) == 28 &&
+		offsetof(LightBVHNode, coneAngle) == 40 && offsetof(LightBVHNode, childIndex) == 44,
+		"LightBVHNode must match readLightTreeNode in light.slang");
+
+	//built by AliasTable, sampled in shaders/utils/light.slang
+	struct AliasTableEntry {
+		float probability; //chance to keep this entry when its slot is picked, otherwise alias is taken
+		uint32_t alias;
+		float pmf; //probability of picking this entry over the whole table
+		float aliasPmf; //pmf of alias, stored to avoid a second read
 	};
+	static_assert(sizeof(AliasTableEntry) == 16 && offsetof(AliasTableEntry, alias) == 4 && offsetof(AliasTableEntry, pmf) == 8 && offsetof(AliasTableEntry, aliasPmf) == 12,
+		"AliasTableEntry must match light.slang");
+
+	class BlasBuilder;
 
 	class Scene {
 	public:
-		Scene(Core::Device& device);
+		static constexpr VkBuildAccelerationStructureFlagsKHR TLAS_BUILD_FLAGS = VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR | VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_UPDATE_BIT_KHR;
+		static constexpr float TLAS_REFIT_LIMIT = 8.0f; //average refits per instance before the TLAS is rebuilt
+
+		Scene(Core::Device& device, VertexFormat vertexFormat = VERTEX_FORMAT_FULL);
 		~Scene();
 
-		void loadModel(std::string path);
-		void createInstance(uint32_t meshId, uint32_t materialId, glm::vec3 position = glm::vec3(), glm::vec3 rotation = glm::vec3(), glm::vec3 scale = glm::vec3(1, 1, 1));
-		void createMaterial(glm::vec3 color, float metallic = 0.f, float roughness = 1.f, glm::vec3 emissiveColor = glm::vec3(), float emissionStrength = 0.f);
-		void createLight(glm::vec3 position, glm::vec3 color, float intensity);
+		MeshHandle loadModel(std::string path, uint32_t importFlags = IMPORT_DEFAULT);
+		InstanceHandle createInstance(MeshHandle mesh, MaterialHandle material, glm::vec3 position = glm::vec3(), glm::vec3 rotation = glm::vec3(), glm::vec3 scale = glm::vec3(1, 1, 1));
+		MaterialHandle createMaterial(glm::vec3 color, float metallic = 0.f, float roughness = 1.f, glm::vec3 emissiveColor = glm::vec3(), float emissionStrength = 0.f);
+		LightHandle createLight(glm::vec3 position, glm::vec3 color, float intensity);
 		void build();
-
-		void destroyInstance(uint32_t instanceID);
-		void unloadModel(uint32_t meshId);
-		void destroyLight(uint32_t lightId);
-		void destroyMaterial(uint32_t materialId);
+		//records all scene changes since the last frame into cmd, returns true if the TLAS had to be recreated
+		bool update(VkCommandBuffer cmd, uint32_t frameIndex);
+
+		//resources of removed objects are released once no frame in flight can reference them anymore
+		void destroyInstance(InstanceHandle instance);
+		//throws if instances still reference the mesh
+		void unloadModel(MeshHandle mesh);
+		void destroyLight(LightHandle light);
+		//throws if instances still reference the material
+		void destroyMaterial(MaterialHandle material);
+
+		//edits are uploaded by the next update
+		void setMaterial(MaterialHandle material, const Material& value);
+		void setLight(LightHandle light, const Light& value);
+		inline const Material& getMaterial(MaterialHandle material) const { return materials.get(material); }
+		inline const Light& getLight(LightHandle light) const { return lights.get(light); }
+		//MaterialFeatures used by materials that are referenced by instances
+		uint32_t getMaterialFeatures();
+
+		//static meshes are built with ALLOW_COMPACTION and copied into right-sized buffers, takes effect on the next build()
+		inline void setBlasCompaction(bool enabled) { compactBlas = enabled; }
+		//uploads and TLAS builds recorded by update are timed as their own passes
+		inline void setProfiler(Core::GpuProfiler* profiler) { this->profiler = profiler; }
+		//only the structure of the active method is kept up to date
+		void setLightSampling(LightSampling sampling);
+		inline LightSampling getLightSampling() const { return lightSampling; }
 
 		inline AccelerationStructure getTlas() { return tlasAccel; }
+		//transformations are indexed by the dense instance index, which changes when other instances are destroyed
+		inline InstanceTransforms& getInstanceTransforms() { return transforms; }
+		inline uint32_t getInstanceIndex(InstanceHandle instance) const { return instances.indexOf(instance); }
 		inline std::unique_ptr<Core::Buffer>& getSceneInfoBuffer() { return sceneInfoBuffer; }
 
 		Scene(const Scene&) = delete;
@@ -153,41 +279,97 @@ namespace RayTracing {
 		Scene(const Scene&&) = delete;
 		Scene operator=(Scene&&) = delete;
 	private:
+		//removed objects and replaced buffers, released when their frame slot comes around again
+		struct RetiredResources {
+			std::vector<Mesh> meshes;
+			std::vector<AccelerationStructure> accelerationStructures;
+			std::vector<std::unique_ptr<Core::Buffer>> buffers;
+		};
+
 		void primitiveToGeometry(const Mesh& mesh, VkAccelerationStructureGeometryKHR& geometry, VkAccelerationStructureBuildRangeInfoKHR& rangeInfo);
 		void createBottomAS();
+		void swapCompactedBottomAS();
 		void createTopAS();
-		void createAccelerationStructure(VkAccelerationStructureTypeKHR asType,
-			AccelerationStructure& accelStructure,
-			VkAccelerationStructureGeometryKHR& asGeometry,
-			VkAccelerationStructureBuildRangeInfoKHR& asBuildRangeInfo,
-			VkBuildAccelerationStructureFlagsKHR flags);
+		void recordTopASBuild(VkCommandBuffer cmd, VkBuildAccelerationStructureModeKHR mode, uint32_t slice);
+		bool updateTopAS(VkCommandBuffer cmd, uint32_t frameIndex);
+		void refreshInstances();
+		void updateSceneBuffers(VkCommandBuffer cmd, uint32_t frameIndex);
+		void releaseResources(RetiredResources& resources);
+		void destroyAccelerationStructure(AccelerationStructure& accel);
+		void updateLightSampling();
 		void createLightAccelerationStructure();
+		void createLightAliasTable();
 
-		void createMaterials();
-		void createLights();
 		void createSky();
-		void createSceneInformation();
 		void createSceneInfoBuffer();
+		InstanceInfo getInstanceInfo(uint32_t index);
+		SceneBufferInfo getSceneBufferInfo();
+#ifdef _DEBUG
+		//throws if the vertex buffer of a mesh disagrees with the vertex stride handed to the shaders
+		void validateSceneBufferInfo(const SceneBufferInfo& info) const;
+#endif
 
 		void stageInformation(void* data, uint64_t size, VkBuffer dstBuffer);
 	private:
 		Core::Device& device;
-
-		std::vector<Mesh> meshes;
-		std::vector<MeshInstance> instances;
-		std::vector<Material> materials;
-		std::vector<Light> lights;
-		std::vector<AccelerationStructure> blasAccel;
-		AccelerationStructure tlasAccel;
-
-		std::unique_ptr<Core::Buffer> materialBuffer;
-		std::unique_ptr<Core::Buffer> lightBuffer;
+		Core::ThreadPool threadPool;
+		VertexFormat vertexFormat;
+		Core::GpuProfiler* profiler = nullptr;
+		bool compactBlas = false;
+
+		SlotMap<Mesh> meshes;
+		SlotMap<MeshInstance> instances;
+		InstanceTransforms transforms;
+		SlotMap<Material> materials;
+		std::vector<std::vector<uint32_t>> materialInstances; //dense instance indices, parallel to the dense materials
+		std::vector<uint32_t> instanceMaterialPositions; //position in materialInstances, parallel to the dense instances
+		uint32_t materialFeatures = 0;
+		bool materialFeaturesOutdated = true; //recomputed when materials change or gain or lose instances
+		SlotMap<Light> lights;
+		AccelerationStructure tlasAccel{};
+
+		//BLAS and TLAS builds are submitted to the compute queue without waiting, the TLAS build waits for the BLAS builds on the GPU
+		std::unique_ptr<BlasBuilder> blasBuilder;
+		Core::GpuTicket blasTicket;
+		Core::GpuTicket tlasTicket;
+
+		//dense indices of instances whose information has to be recomputed, only tracked once the scene is built
+		bool built = false;
+		std::vector<uint32_t> instancePatches;
+		bool sceneInfoOutdated = false;
+
+		RetiredResources retiring; //retired by the frame being recorded next
+		std::array<RetiredResources, Core::SwapChain::MAX_FRAMES_IN_FLIGHT> retired;
+
+		std::vector<InstanceInfo> instanceInfo;
+		std::vector<VkAccelerationStructureInstanceKHR> tlasInstances;
+		uint32_t tlasCapacity = 0; //instances the TLAS and its instance buffer were created for
+		bool tlasRebuild = false;
+		std::vector<std::vector<uint64_t>> tlasPendingSlices; //per slice of the instance buffer, bitset of instances holding an old transform
+		std::vector<uint64_t> tlasChanged;
+		std::unique_ptr<Core::Buffer> tlasInstanceBuffer; //persistently mapped, one slice per frame in flight
+		VkDeviceSize tlasSliceSize;
+		std::unique_ptr<Core::Buffer> tlasScratchBuffer;
+		VkDeviceAddress tlasScratchAddress;
+		VkAccelerationStructureGeometryKHR tlasGeometry;
+		float tlasDegradation = 0.0f;
+
+		GpuArray materialBuffer;
+		GpuArray lightBuffer;
+		GpuArray instanceBuffer;
 		std::unique_ptr<Core::Buffer> vertexBuffer;
 		std::unique_ptr<Core::Buffer> indexBuffer;
-		std::unique_ptr<Core::Buffer> instanceBuffer;
 		std::unique_ptr<Core::Buffer> skyBuffer;
 		std::unique_ptr<Core::Buffer> sceneInfoBuffer;
-		std::unique_ptr<Core::Buffer> lightAccelerationStructures;
+		std::vector<LightBVHNode> lightTree;
+		GpuArray lightTreeBuffer;
+		bool lightTreeOutdated = true; //rebuilt by the next update whenever lights change
+		LightSampling lightSampling = LIGHT_SAMPLING_TREE;
+		std::vector<AliasTableEntry> lightAliasTable;
+		std::vector<AliasTableEntry> lightAliasScratch;
+		std::vector<float> lightPowers;
+		GpuArray lightAliasBuffer;
+		bool lightAliasOutdated = true; //rebuilt by the next update whenever the power of lights changes
 	};
 
 }
\ No newline at end of file
@@ -0,0 +1,85 @@
+#include "ShaderReloader.h"
+#include "../Tracer.h"
+
+#include <cstdlib>
+
+RayTracing::ShaderReloader::ShaderReloader(Pipeline& pipeline) : pipeline(pipeline) {
+	//the running pipeline was created from the current sources
+	scan();
+	worker = std::thread(&ShaderReloader::watchLoop, this);
+
+	std::cout << "[INFO] ShaderReloader: watching " << SHADER_DIRECTORY << " for changes" << std::endl;
+}
+
+RayTracing::ShaderReloader::~ShaderReloader() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	condition.notify_all();
+
+	worker.join();
+}
+
+void RayTracing::ShaderReloader::watchLoop() {
+	TRACE_THREAD_NAME("ShaderReloader");
+	std::unique_lock<std::mutex> lock(mutex);
+
+	while (!condition.wait_for(lock, POLL_INTERVAL, [this] { return stopping; })) {
+		lock.unlock();
+		if (scan()) rebuild();
+		lock.lock();
+	}
+}
+
+bool RayTracing::ShaderReloader::scan() {
+	std::unordered_map<std::string, std::filesystem::file_time_type> current;
+
+	//editors replace files while saving, entries that vanish during the scan are picked up by the next one
+	std::error_code error;
+	for (std::filesystem::recursive_directory_iterator it(SHADER_DIRECTORY, error), end; !error && it != end; it.increment(error)) {
+		if (it->path().extension() != ".slang") continue;
+
+		std::filesystem::file_time_type writeTime = std::filesystem::last_write_time(it->path(), error);
+		if (!error) current.emplace(it->path().string(), writeTime);
+	}
+	if (error) return false;
+
+	bool changed = current != writeTimes;
+	writeTimes = std::move(current);
+	return changed;
+}
+
+void RayTracing::ShaderReloader::rebuild() {
+	TRACE_ZONE("ShaderReloader::rebuild");
+	std::string output = std::string(Pipeline::SHADER_PATH) + ".tmp";
+	std::string command = std::string("slangc \"") + SHADER_SOURCE + "\" " + COMPILE_ARGUMENTS + " -o \"" + output + "\"";
+
+	auto start = std::chrono::high_resolution_clock::now();
+	int result = std::system(command.c_str());
+	float compileTime = std::chrono::duration<float, std::chrono::milliseconds::period>(std::chrono::high_resolution_clock::now() - start).count();
+
+	if (result != 0) {
+		std::cout << "[WARNING] ShaderReloader: slangc failed with exit code " << result << " after " << compileTime << " ms, keeping the running pipeline" << std::endl;
+		return;
+	}
+
+	std::vector<char> code;
+	try {
+		code = Pipeline::readShaderFile(output);
+	} catch (const std::exception& e) {
+		std::cout << "[WARNING] ShaderReloader: " << e.what() << std::endl;
+		return;
+	}
+
+	start = std::chrono::high_resolution_clock::now();
+	if (!pipeline.reload(std::move(code))) return;
+	float pipelineTime = std::chrono::duration<float, std::chrono::milliseconds::period>(std::chrono::high_resolution_clock::now() - start).count();
+
+	//the next start uses the reloaded shader as well
+	std::error_code error;
+	std::filesystem::rename(output, Pipeline::SHADER_PATH, error);
+	if (error) std::cout << "[WARNING] ShaderReloader: failed to replace " << Pipeline::SHADER_PATH << ": " << error.message() << std::endl;
+
+	std::cout << "[INFO] ShaderReloader: compiled " << SHADER_SOURCE << " in " << compileTime << " ms, created pipeline and SBT in " << pipelineTime << " ms" << std::endl;
+}
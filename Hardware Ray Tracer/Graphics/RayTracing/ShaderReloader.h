@@ -0,0 +1,51 @@
+#pragma once
+
+#include "RTPipeline.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+namespace RayTracing {
+
+	/*
+	 * Shader hot reload
+	 * A worker thread polls the write times of every .slang file below the shader directory. After a change it
+	 * compiles the ray tracing shader with slangc into a temporary file and hands the SPIR-V to Pipeline::reload,
+	 * which creates the new pipeline and its shader binding table on the worker as well. The render loop only swaps
+	 * pipelines at a frame boundary through Pipeline::applyReload.
+	 * A failed compile or pipeline creation keeps the running pipeline, the compiled SPIR-V only replaces
+	 * Pipeline::SHADER_PATH once a pipeline was created from it.
+	 */
+	class ShaderReloader {
+	public:
+		static constexpr std::chrono::milliseconds POLL_INTERVAL{ 500 };
+		static constexpr const char* SHADER_DIRECTORY = "shaders";
+		static constexpr const char* SHADER_SOURCE = "shaders/pathtracing.slang";
+		//same arguments as the slangc build step of shaders/pathtracing.slang in the project file
+		static constexpr const char* COMPILE_ARGUMENTS = "-target spirv -profile spirv_1_4 -fvk-use-entrypoint-name";
+
+		ShaderReloader(Pipeline& pipeline);
+		~ShaderReloader();
+
+		ShaderReloader(const ShaderReloader&) = delete;
+		ShaderReloader operator=(const ShaderReloader&) = delete;
+	private:
+		void watchLoop();
+		//records the current write times, returns true if a source was added, removed or modified since the last scan
+		bool scan();
+		void rebuild();
+	private:
+		Pipeline& pipeline;
+		std::unordered_map<std::string, std::filesystem::file_time_type> writeTimes;
+
+		std::thread worker;
+		std::mutex mutex;
+		std::condition_variable condition;
+		bool stopping = false;
+	};
+}
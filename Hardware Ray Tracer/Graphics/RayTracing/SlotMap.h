@@ -0,0 +1,113 @@
+#pragma once
+
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+namespace RayTracing {
+
+	/*
+	 * Stable reference into a SlotMap
+	 * The generation of a slot is bumped every time it is freed, so a handle to a removed object never
+	 * resolves again, even after its slot got reused.
+	 */
+	template <typename T>
+	struct Handle {
+		static constexpr uint32_t INVALID_INDEX = UINT32_MAX;
+
+		uint32_t index = INVALID_INDEX;
+		uint32_t generation = 0;
+
+		inline bool isValid() const { return index != INVALID_INDEX; }
+		bool operator==(const Handle& other) const = default;
+	};
+
+	/*
+	 * Generational slot map
+	 * Values are stored densely so GPU arrays can be built by iterating them in order, slots map handles to
+	 * dense indices. insert and remove are O(1): removing moves the last value into the freed dense index and
+	 * reports that move, so arrays kept parallel to the dense values (and their GPU copies) can be patched.
+	 */
+	template <typename T>
+	class SlotMap {
+	public:
+		struct Removal {
+			uint32_t index; //dense index that was freed
+			uint32_t moved; //former dense index of the value that now lives at index, equal to index if nothing moved
+		};
+
+		Handle<T> insert(T&& value) {
+			uint32_t slot;
+			if (freeHead != Handle<T>::INVALID_INDEX) {
+				slot = freeHead;
+				freeHead = slots[slot].dense;
+			} else {
+				slot = static_cast<uint32_t>(slots.size());
+				slots.push_back(Slot{ 0, 0 });
+			}
+
+			slots[slot].dense = static_cast<uint32_t>(values.size());
+			values.push_back(std::move(value));
+			owners.push_back(slot);
+
+			return Handle<T>{ slot, slots[slot].generation };
+		}
+
+		Removal remove(Handle<T> handle) {
+			uint32_t index = indexOf(handle);
+			uint32_t last = static_cast<uint32_t>(values.size() - 1);
+
+			if (index != last) {
+				values[index] = std::move(values[last]);
+				owners[index] = owners[last];
+				slots[owners[index]].dense = index;
+			}
+			values.pop_back();
+			owners.pop_back();
+
+			//freed slots are chained through their dense index
+			slots[handle.index].generation++;
+			slots[handle.index].dense = freeHead;
+			freeHead = handle.index;
+
+			return Removal{ index, last };
+		}
+
+		inline bool contains(Handle<T> handle) const {
+			return handle.index < slots.size() && slots[handle.index].generation == handle.generation;
+		}
+
+		uint32_t indexOf(Handle<T> handle) const {
+			if (!contains(handle)) throw std::runtime_error("stale or invalid handle!");
+			return slots[handle.index].dense;
+		}
+
+		inline Handle<T> handleAt(uint32_t index) const { return Handle<T>{ owners[index], slots[owners[index]].generation }; }
+
+		inline T& get(Handle<T> handle) { return values[indexOf(handle)]; }
+		inline const T& get(Handle<T> handle) const { return values[indexOf(handle)]; }
+
+		inline T& operator[](uint32_t index) { return values[index]; }
+		inline const T& operator[](uint32_t index) const { return values[index]; }
+
+		inline uint32_t size() const { return static_cast<uint32_t>(values.size()); }
+		inline bool empty() const { return values.empty(); }
+		inline T* data() { return values.data(); }
+		inline const T* data() const { return values.data(); }
+
+		inline auto begin() { return values.begin(); }
+		inline auto end() { return values.end(); }
+		inline auto begin() const { return values.begin(); }
+		inline auto end() const { return values.end(); }
+	private:
+		struct Slot {
+			uint32_t dense; //index into values while used, next free slot while free
+			uint32_t generation;
+		};
+
+		std::vector<T> values;
+		std::vector<uint32_t> owners; //slot of every dense value
+		std::vector<Slot> slots;
+		uint32_t freeHead = Handle<T>::INVALID_INDEX;
+	};
+}
@@ -0,0 +1,73 @@
+#include "ThreadPool.h"
+#include "Tracer.h"
+
+#include <algorithm>
+
+Core::ThreadPool::ThreadPool(uint32_t threadCount) {
+	threadCount = std::max(threadCount, 1U);
+
+	workers.reserve(threadCount);
+	for (uint32_t i = 0; i < threadCount; i++)
+		workers.emplace_back(&ThreadPool::workerLoop, this);
+}
+
+Core::ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard<std::mutex> lock(queueMutex);
+		stopping = true;
+	}
+	queueCondition.notify_all();
+
+	for (std::thread& worker : workers)
+		worker.join();
+}
+
+std::future<void> Core::ThreadPool::submit(std::function<void()> job) {
+	std::packaged_task<void()> task(std::move(job));
+	std::future<void> future = task.get_future();
+
+	{
+		std::lock_guard<std::mutex> lock(queueMutex);
+		jobs.push(std::move(task));
+	}
+	queueCondition.notify_one();
+
+	return future;
+}
+
+void Core::ThreadPool::parallelFor(uint32_t count, const std::function<void(uint32_t)>& job) {
+	std::vector<std::future<void>> futures;
+	futures.reserve(count);
+
+	for (uint32_t i = 0; i < count; i++)
+		futures.push_back(submit([&job, i]() { job(i); }));
+
+	//wait for every job before rethrowing so no job outlives the captured references
+	for (std::future<void>& future : futures)
+		future.wait();
+
+	for (std::future<void>& future : futures)
+		future.get();
+}
+
+void Core::ThreadPool::workerLoop() {
+	TRACE_THREAD_NAME("ThreadPool worker");
+
+	while (true) {
+		std::packaged_task<void()> task;
+
+		{
+			std::unique_lock<std::mutex> lock(queueMutex);
+			queueCondition.wait(lock, [this]() { return stopping || !jobs.empty(); });
+
+			if (stopping && jobs.empty())
+				return;
+
+			task = std::move(jobs.front());
+			jobs.pop();
+		}
+
+		TRACE_ZONE("ThreadPool job");
+		task();
+	}
+}
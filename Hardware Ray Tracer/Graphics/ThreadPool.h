@@ -0,0 +1,38 @@
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+namespace Core {
+	class ThreadPool {
+	public:
+		ThreadPool(uint32_t threadCount = std::thread::hardware_concurrency());
+		~ThreadPool();
+
+		ThreadPool(const ThreadPool&) = delete;
+		ThreadPool operator=(const ThreadPool&) = delete;
+		ThreadPool(const ThreadPool&&) = delete;
+		ThreadPool operator=(ThreadPool&&) = delete;
+
+		std::future<void> submit(std::function<void()> job);
+		//runs job(0) ... job(count - 1) on the workers and blocks until all of them are done
+		//exceptions thrown by a job are rethrown on the calling thread
+		void parallelFor(uint32_t count, const std::function<void(uint32_t)>& job);
+
+		inline uint32_t getThreadCount() const { return static_cast<uint32_t>(workers.size()); }
+	private:
+		void workerLoop();
+	private:
+		std::vector<std::thread> workers;
+		std::queue<std::packaged_task<void()>> jobs;
+
+		std::mutex queueMutex;
+		std::condition_variable queueCondition;
+		bool stopping = false;
+	};
+}
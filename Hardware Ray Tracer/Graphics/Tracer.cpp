@@ -0,0 +1,131 @@
+#include "Tracer.h"
+
+#include <array>
+#include <atomic>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace {
+	struct TraceEvent {
+		const char* name;
+		int64_t start;
+		int64_t end;
+	};
+
+	struct ThreadBuffer {
+		uint32_t threadID;
+		std::string name; //guarded by the registry mutex
+
+		//chunks below the published count are complete and never move
+		std::array<std::unique_ptr<TraceEvent[]>, Core::Tracer::MAX_CHUNKS> chunks;
+		std::atomic<uint32_t> count{ 0 };
+		std::atomic<uint32_t> dropped{ 0 };
+	};
+
+	//buffers outlive their threads, workers that exited still show up in the trace
+	struct Registry {
+		std::mutex mutex;
+		std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+	};
+
+	Registry& getRegistry() {
+		static Registry registry;
+		return registry;
+	}
+
+	const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+
+	ThreadBuffer& getThreadBuffer() {
+		thread_local ThreadBuffer* buffer = nullptr;
+		if (buffer) return *buffer;
+
+		//once per thread
+		Registry& registry = getRegistry();
+		std::lock_guard<std::mutex> lock(registry.mutex);
+		registry.buffers.push_back(std::make_unique<ThreadBuffer>());
+		buffer = registry.buffers.back().get();
+		buffer->threadID = static_cast<uint32_t>(registry.buffers.size());
+		return *buffer;
+	}
+
+	void writeEscaped(std::ostream& out, const char* text) {
+		for (; *text; text++) {
+			if (*text == '"' || *text == '\\') out << '\\';
+			out << *text;
+		}
+	}
+}
+
+int64_t Core::Tracer::now() {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+}
+
+void Core::Tracer::record(const char* name, int64_t start, int64_t end) {
+	ThreadBuffer& buffer = getThreadBuffer();
+
+	//only this thread writes count, a relaxed load sees its own latest store
+	uint32_t index = buffer.count.load(std::memory_order_relaxed);
+	uint32_t chunk = index / CHUNK_SIZE;
+	if (chunk >= MAX_CHUNKS) {
+		buffer.dropped.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+	if (!buffer.chunks[chunk]) buffer.chunks[chunk] = std::make_unique<TraceEvent[]>(CHUNK_SIZE);
+
+	buffer.chunks[chunk][index % CHUNK_SIZE] = TraceEvent{ .name = name, .start = start, .end = end };
+	buffer.count.store(index + 1, std::memory_order_release);
+}
+
+void Core::Tracer::setThreadName(const std::string& name) {
+	ThreadBuffer& buffer = getThreadBuffer();
+
+	std::lock_guard<std::mutex> lock(getRegistry().mutex);
+	buffer.name = name;
+}
+
+void Core::Tracer::write(const std::string& path) {
+	std::ofstream out(path, std::ios::trunc);
+	if (!out.is_open()) {
+		std::cout << "[WARNING] Tracer: failed to open " << path << std::endl;
+		return;
+	}
+
+	Registry& registry = getRegistry();
+	std::lock_guard<std::mutex> lock(registry.mutex);
+
+	//timestamps of the trace format are in microseconds
+	out << std::fixed << std::setprecision(3) << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+	bool first = true;
+	size_t eventCount = 0;
+	uint32_t dropped = 0;
+
+	for (const std::unique_ptr<ThreadBuffer>& buffer : registry.buffers) {
+		if (!buffer->name.empty()) {
+			out << (first ? "" : ",\n") << "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":" << buffer->threadID << ",\"args\":{\"name\":\"";
+			writeEscaped(out, buffer->name.c_str());
+			out << "\"}}";
+			first = false;
+		}
+
+		uint32_t count = buffer->count.load(std::memory_order_acquire);
+		for (uint32_t i = 0; i < count; i++) {
+			const TraceEvent& event = buffer->chunks[i / CHUNK_SIZE][i % CHUNK_SIZE];
+			out << (first ? "" : ",\n") << "{\"ph\":\"X\",\"name\":\"";
+			writeEscaped(out, event.name);
+			out << "\",\"pid\":1,\"tid\":" << buffer->threadID << ",\"ts\":" << event.start * 1e-3 << ",\"dur\":" << (event.end - event.start) * 1e-3 << "}";
+			first = false;
+		}
+
+		eventCount += count;
+		dropped += buffer->dropped.load(std::memory_order_relaxed);
+	}
+	out << "\n]}\n";
+
+	std::cout << "[INFO] Tracer: wrote " << eventCount << " zones of " << registry.buffers.size() << " threads to " << path;
+	if (dropped) std::cout << ", " << dropped << " zones were dropped";
+	std::cout << std::endl;
+}
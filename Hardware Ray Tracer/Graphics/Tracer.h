@@ -0,0 +1,61 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+//zones are recorded in debug builds and in builds that define ENABLE_TRACING, they compile to nothing otherwise
+#if defined(_DEBUG) || defined(ENABLE_TRACING)
+#define TRACING_ENABLED
+#endif
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+
+#ifdef TRACING_ENABLED
+//times the rest of the enclosing block, name has to be a string literal
+#define TRACE_ZONE(name) Core::TraceZone TRACE_CONCAT(traceZone, __LINE__)(name)
+#define TRACE_THREAD_NAME(name) Core::Tracer::setThreadName(name)
+#define TRACE_EXPORT(path) Core::Tracer::write(path)
+#else
+#define TRACE_ZONE(name) ((void)0)
+#define TRACE_THREAD_NAME(name) ((void)0)
+#define TRACE_EXPORT(path) ((void)0)
+#endif
+
+namespace Core {
+
+	/*
+	 * CPU zone tracer
+	 * Every thread appends the zones it completes to its own event buffer, so recording takes no lock and never
+	 * waits on other threads. Buffers grow in fixed chunks that are never moved, and a buffer publishes its event
+	 * count only after the event is written, so write can read the buffers of threads that are still running.
+	 * write exports all recorded zones as Chrome trace JSON, which chrome://tracing and ui.perfetto.dev open.
+	 */
+	class Tracer {
+	public:
+		static constexpr uint32_t CHUNK_SIZE = 4096; //events
+		static constexpr uint32_t MAX_CHUNKS = 1024; //per thread, later zones are dropped
+
+		//start and end are taken from Tracer::now
+		static void record(const char* name, int64_t start, int64_t end);
+		//shown instead of the thread id, name is copied
+		static void setThreadName(const std::string& name);
+		static void write(const std::string& path);
+
+		//ns since the tracer was loaded
+		static int64_t now();
+	};
+
+	class TraceZone {
+	public:
+		TraceZone(const char* name) : name(name), start(Tracer::now()) {}
+		~TraceZone() { Tracer::record(name, start, Tracer::now()); }
+
+		TraceZone(const TraceZone&) = delete;
+		TraceZone operator=(const TraceZone&) = delete;
+	private:
+		const char* name;
+		int64_t start;
+	};
+}
@@ -22,16 +22,39 @@ Core::Buffer::Buffer(
     alignmentSize = getAlignment(instanceSize, minOffsetAlignment);
     bufferSize = getAlignment(bufferSize, minOffsetAlignment);
     device.createBuffer(bufferSize, usageFlags, memoryPropertyFlags, &buffer, &memory);
+
+    //the address of a buffer never changes, callers read it every frame
+    if (usageFlags & VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT) address = device.getBufferDeviceAddress(buffer);
 }
 
 Core::Buffer::~Buffer() {
     unmap();
     vkDestroyBuffer(lveDevice.getDevice(), buffer, nullptr);
-    vkFreeMemory(lveDevice.getDevice(), memory, nullptr);
+    lveDevice.freeMemory(memory);
+}
+
+/**
+ * Device address of a byte offset into this buffer, without a call into the driver
+ *
+ * @param offset (Optional) Byte offset from beginning
+ *
+ * @return Address cached at creation plus offset
+ */
+VkDeviceAddress Core::Buffer::getAddress(VkDeviceSize offset) const {
+    assert(address && "Buffer was created without VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT");
+    assert(offset <= bufferSize && "Address offset exceeds the buffer");
+    return address + offset;
+}
+
+//whole size ranges end with the allocation instead of the shared memory block
+VkDeviceSize Core::Buffer::getMappedRangeSize(VkDeviceSize size, VkDeviceSize offset) const {
+    if (size != VK_WHOLE_SIZE || memory.pool == UINT32_MAX) return size;
+    return memory.size - offset;
 }
 
 /**
  * Map a memory range of this buffer. If successful, mapped points to the specified buffer range.
+ * Host visible memory blocks stay mapped by the allocator, this only hands out the pointer into them.
  *
  * @param size (Optional) Size of the memory range to map. Pass VK_WHOLE_SIZE to map the complete
  * buffer range.
@@ -40,20 +63,20 @@ Core::Buffer::~Buffer() {
  * @return VkResult of the buffer mapping call
  */
 VkResult Core::Buffer::map(VkDeviceSize size, VkDeviceSize offset) {
-    assert(buffer && memory && "Called map on buffer before create");
-    return vkMapMemory(lveDevice.getDevice(), memory, offset, size, 0, &mapped);
+    assert(buffer && memory.memory && "Called map on buffer before create");
+    if (!memory.mapped) return VK_ERROR_MEMORY_MAP_FAILED;
+
+    mapped = static_cast<char*>(memory.mapped) + offset;
+    return VK_SUCCESS;
 }
 
 /**
  * Unmap a mapped memory range
  *
- * @note Does not return a result as vkUnmapMemory can't fail
+ * @note The memory block itself stays mapped, other buffers may live in it
  */
 void Core::Buffer::unmap() {
-    if (mapped) {
-        vkUnmapMemory(lveDevice.getDevice(), memory);
-        mapped = nullptr;
-    }
+    mapped = nullptr;
 }
 
 /**
@@ -92,9 +115,9 @@ void Core::Buffer::writeToBuffer(void* data, VkDeviceSize size, VkDeviceSize off
 VkResult Core::Buffer::flush(VkDeviceSize size, VkDeviceSize offset) {
     VkMappedMemoryRange mappedRange = {};
     mappedRange.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
-    mappedRange.memory = memory;
-    mappedRange.offset = offset;
-    mappedRange.size = size;
+    mappedRange.memory = memory.memory;
+    mappedRange.offset = memory.offset + offset;
+    mappedRange.size = getMappedRangeSize(size, offset);
     return vkFlushMappedMemoryRanges(lveDevice.getDevice(), 1, &mappedRange);
 }
 
@@ -112,9 +135,9 @@ VkResult Core::Buffer::flush(VkDeviceSize size, VkDeviceSize offset) {
 VkResult Core::Buffer::invalidate(VkDeviceSize size, VkDeviceSize offset) {
     VkMappedMemoryRange mappedRange = {};
     mappedRange.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
-    mappedRange.memory = memory;
-    mappedRange.offset = offset;
-    mappedRange.size = size;
+    mappedRange.memory = memory.memory;
+    mappedRange.offset = memory.offset + offset;
+    mappedRange.size = getMappedRangeSize(size, offset);
     return vkInvalidateMappedMemoryRanges(lveDevice.getDevice(), 1, &mappedRange);
 }
 
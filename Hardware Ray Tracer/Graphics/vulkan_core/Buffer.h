@@ -2,8 +2,24 @@
 
 #include "Device.h"
 
+#include <cassert>
+
 namespace Core {
 
+    /**
+     * Typed window into a buffer with a device address, what the shaders receive as address and byte stride.
+     * Element i lives at address + i * stride, stride may exceed sizeof(T) for padded or interleaved data.
+     */
+    template<typename T>
+    struct BufferView {
+        VkDeviceAddress address = 0;
+        VkDeviceSize stride = sizeof(T);
+        VkDeviceSize count = 0;
+
+        VkDeviceAddress addressOf(VkDeviceSize index) const { return address + index * stride; }
+        VkDeviceSize size() const { return count * stride; }
+    };
+
     class Buffer {
     public:
         Buffer(
@@ -33,15 +49,26 @@ namespace Core {
         VkDeviceSize getAlignmentSize() const { return instanceSize; }
         VkBufferUsageFlags getUsageFlags() const { return usageFlags; }
         VkMemoryPropertyFlags getMemoryPropertyFlags() const { return memoryPropertyFlags; }
-		VkDeviceAddress getAddress() { return lveDevice.getBufferDeviceAddress(buffer); }
+        VkDeviceAddress getAddress(VkDeviceSize offset = 0) const;
+
+        //count defaults to every whole element between offset and the end of the buffer
+        template<typename T>
+        BufferView<T> getView(VkDeviceSize offset = 0, VkDeviceSize count = VK_WHOLE_SIZE, VkDeviceSize stride = sizeof(T)) const {
+            assert(stride >= sizeof(T) && "View stride is smaller than the element");
+            if (count == VK_WHOLE_SIZE) count = offset < bufferSize ? (bufferSize - offset) / stride : 0;
+            assert(offset + count * stride <= bufferSize && "View exceeds the buffer");
+            return BufferView<T>{ .address = getAddress(offset), .stride = stride, .count = count };
+        }
 
     private:
         static VkDeviceSize getAlignment(VkDeviceSize instanceSize, VkDeviceSize minOffsetAlignment);
+        VkDeviceSize getMappedRangeSize(VkDeviceSize size, VkDeviceSize offset) const;
 
         Device& lveDevice;
         void* mapped = nullptr;
         VkBuffer buffer = VK_NULL_HANDLE;
-        VkDeviceMemory memory = VK_NULL_HANDLE;
+        VkDeviceAddress address = 0; //queried once at creation, stays 0 without VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT
+        Allocation memory; //sub-allocated, offsets of map, flush and invalidate are relative to the buffer
 
         VkDeviceSize bufferSize;
         uint32_t instanceCount;
@@ -1,4 +1,7 @@
 #include "Device.h"
+#include "StagingRing.h"
+#include "../Tracer.h"
+#include <algorithm>
 #include <set>
 #include <unordered_set>
 
@@ -42,18 +45,39 @@ void DestroyDebugUtilsMessengerEXT(
 }
 #pragma endregion
 
+//tags allocations for the memory statistics by what their buffer is used for
+static Core::MemoryTag memoryTagFromUsage(VkBufferUsageFlags usage) {
+	if (usage & VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_STORAGE_BIT_KHR) return Core::MEMORY_TAG_ACCELERATION_STRUCTURE;
+	if (usage & (VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR)) return Core::MEMORY_TAG_GEOMETRY;
+	if (usage == VK_BUFFER_USAGE_TRANSFER_SRC_BIT) return Core::MEMORY_TAG_STAGING;
+	return Core::MEMORY_TAG_GENERIC;
+}
+
 Core::Device::Device(Window* window) : window(window) {
+	TRACE_ZONE("Device::Device");
 	createInstance();
 	setupDebugMessenger();
 	createSurface();
 	pickPhysicalDevice();
 	createLogicalDevice();
-	createCommandPool();
+	//debug utils are enabled on the instance together with the validation layers
+	dispatch.load(device_, enableValidationLayers);
+	allocator = std::make_unique<MemoryAllocator>(device_, physicalDevice);
+	createCommandPools();
+	createTimelines();
+	stagingRing = std::make_unique<StagingRing>(*this);
 	creatRayTracingProperties();
 }
 
 Core::Device::~Device() {
-	vkDestroyCommandPool(device_, commandPool, nullptr);
+	stagingRing.reset();
+	waitSubmissions();
+	releaseCompletedCommands();
+	for (Queue& queue : queues) {
+		vkDestroySemaphore(device_, queue.timeline, nullptr);
+		vkDestroyCommandPool(device_, queue.commandPool, nullptr);
+	}
+	allocator.reset();
 	vkDestroyDevice(device_, nullptr);
 	if (enableValidationLayers) {
 		DestroyDebugUtilsMessengerEXT(instance, debugMessenger, nullptr);
@@ -92,49 +116,56 @@ VkFormat Core::Device::findSupportedFormat(const std::vector<VkFormat>& candidat
 	throw std::runtime_error("failed to find supported format!");
 }
 
-void Core::Device::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer* buffer, VkDeviceMemory* bufferMemory) {
+void Core::Device::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer* buffer, Allocation* bufferMemory) {
 	VkBufferCreateInfo bufferInfo{};
 	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
 	bufferInfo.size = size;
 	bufferInfo.usage = usage;
 	bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 
+	//buffers are written and read by different queues, concurrent sharing saves an ownership transfer for every handoff
+	if (bufferQueueFamilies.size() > 1) {
+		bufferInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+		bufferInfo.queueFamilyIndexCount = static_cast<uint32_t>(bufferQueueFamilies.size());
+		bufferInfo.pQueueFamilyIndices = bufferQueueFamilies.data();
+	}
+
 	if (vkCreateBuffer(device_, &bufferInfo, nullptr, buffer) != VK_SUCCESS) {
 		throw std::runtime_error("failed to create vertex buffer!");
 	}
 
-	VkMemoryRequirements memRequirements;
-	vkGetBufferMemoryRequirements(device_, *buffer, &memRequirements);
+	VkBufferMemoryRequirementsInfo2 requirementsInfo{ .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_REQUIREMENTS_INFO_2, .buffer = *buffer };
+	VkMemoryDedicatedRequirements dedicatedRequirements{ .sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS };
+	VkMemoryRequirements2 memRequirements{ .sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2, .pNext = &dedicatedRequirements };
+	vkGetBufferMemoryRequirements2(device_, &requirementsInfo, &memRequirements);
 
-	VkMemoryAllocateFlagsInfoKHR flagsInfo{ VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO_KHR };
-	flagsInfo.flags = VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT_KHR;
+	VkMemoryDedicatedAllocateInfo dedicatedInfo{ .sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO, .buffer = *buffer };
+	bool dedicated = dedicatedRequirements.prefersDedicatedAllocation || dedicatedRequirements.requiresDedicatedAllocation;
 
-	VkMemoryAllocateInfo allocInfo{};
-	allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	allocInfo.allocationSize = memRequirements.size;
-	allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties);
-	allocInfo.pNext = &flagsInfo;
-
-
-	if (vkAllocateMemory(device_, &allocInfo, nullptr, bufferMemory) != VK_SUCCESS) {
-		throw std::runtime_error("failed to allocate vertex buffer memory!");
-	}
+	*bufferMemory = allocator->allocate(
+		memRequirements.memoryRequirements,
+		findMemoryType(memRequirements.memoryRequirements.memoryTypeBits, properties),
+		true,
+		true,
+		dedicated ? &dedicatedInfo : nullptr,
+		memoryTagFromUsage(usage)
+	);
 
-	vkBindBufferMemory(device_, *buffer, *bufferMemory, 0);
+	VK_CHECK_RESULT(vkBindBufferMemory(device_, *buffer, bufferMemory->memory, bufferMemory->offset), "failed to bind buffer memory!");
 }
 
 VkDeviceAddress Core::Device::getBufferDeviceAddress(VkBuffer buffer) {
 	VkBufferDeviceAddressInfoKHR bufferDeviceAI{};
 	bufferDeviceAI.sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO;
 	bufferDeviceAI.buffer = buffer;
-	return vkGetBufferDeviceAddressKHR(device_, &bufferDeviceAI);
+	return dispatch.vkGetBufferDeviceAddressKHR(device_, &bufferDeviceAI);
 }
 
-VkCommandBuffer Core::Device::beginSingleTimeCommands() {
+VkCommandBuffer Core::Device::beginSingleTimeCommands(QueueType queue) {
 	VkCommandBufferAllocateInfo allocInfo{};
 	allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
 	allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-	allocInfo.commandPool = commandPool;
+	allocInfo.commandPool = queues[queue].commandPool;
 	allocInfo.commandBufferCount = 1;
 
 	VkCommandBuffer commandBuffer;
@@ -148,18 +179,114 @@ VkCommandBuffer Core::Device::beginSingleTimeCommands() {
 	return commandBuffer;
 }
 
-void Core::Device::endSingleTimeCommands(VkCommandBuffer commandBuffer) {
+void Core::Device::endSingleTimeCommands(VkCommandBuffer commandBuffer, QueueType queue) {
+	wait(submitSingleTimeCommands(commandBuffer, {}, queue));
+}
+
+Core::GpuTicket Core::Device::submitSingleTimeCommands(VkCommandBuffer commandBuffer, std::span<const GpuTicket> waits, QueueType queue) {
 	vkEndCommandBuffer(commandBuffer);
 
-	VkSubmitInfo submitInfo{};
-	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-	submitInfo.commandBufferCount = 1;
-	submitInfo.pCommandBuffers = &commandBuffer;
+	std::vector<GpuTicket> allWaits(waits.begin(), waits.end());
+	allWaits.push_back(stagingRing->flush());
 
-	vkQueueSubmit(graphicsQueue_, 1, &submitInfo, VK_NULL_HANDLE);
-	vkQueueWaitIdle(graphicsQueue_);
+	GpuTicket ticket = submit(commandBuffer, allWaits, queue);
+	pendingCommands.push_back({ ticket, commandBuffer });
+	return ticket;
+}
 
-	vkFreeCommandBuffers(device_, commandPool, 1, &commandBuffer);
+Core::GpuTicket Core::Device::submit(VkCommandBuffer commandBuffer, std::span<const GpuTicket> waits, QueueType queue) {
+	//values of one timeline are reached in order, waiting for the largest value of every queue covers all of them
+	std::array<uint64_t, QUEUE_COUNT> maxWaits{};
+	for (GpuTicket ticket : waits)
+		maxWaits[ticket.queue] = std::max(maxWaits[ticket.queue], ticket.value);
+
+	std::array<VkSemaphore, QUEUE_COUNT> waitSemaphores;
+	std::array<uint64_t, QUEUE_COUNT> waitValues;
+	std::array<VkPipelineStageFlags, QUEUE_COUNT> waitStages;
+	uint32_t waitCount = 0;
+	for (uint32_t i = 0; i < QUEUE_COUNT; i++) {
+		if (maxWaits[i] <= queues[i].completedValue) continue;
+
+		waitSemaphores[waitCount] = queues[i].timeline;
+		waitValues[waitCount] = maxWaits[i];
+		waitStages[waitCount] = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+		waitCount++;
+	}
+
+	Queue& target = queues[queue];
+	uint64_t signalValue = ++target.timelineValue;
+	VkTimelineSemaphoreSubmitInfo timelineInfo{
+		.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+		.waitSemaphoreValueCount = waitCount,
+		.pWaitSemaphoreValues = waitValues.data(),
+		.signalSemaphoreValueCount = 1,
+		.pSignalSemaphoreValues = &signalValue
+	};
+
+	VkSubmitInfo submitInfo{
+		.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+		.pNext = &timelineInfo,
+		.waitSemaphoreCount = waitCount,
+		.pWaitSemaphores = waitSemaphores.data(),
+		.pWaitDstStageMask = waitStages.data(),
+		.commandBufferCount = 1,
+		.pCommandBuffers = &commandBuffer,
+		.signalSemaphoreCount = 1,
+		.pSignalSemaphores = &target.timeline
+	};
+	VK_CHECK_RESULT(vkQueueSubmit(target.queue, 1, &submitInfo, VK_NULL_HANDLE), "failed to submit command buffer!");
+
+	releaseCompletedCommands();
+	return GpuTicket{ signalValue, queue };
+}
+
+bool Core::Device::isComplete(GpuTicket ticket) {
+	Queue& queue = queues[ticket.queue];
+	if (ticket.value <= queue.completedValue) return true;
+
+	VK_CHECK_RESULT(vkGetSemaphoreCounterValue(device_, queue.timeline, &queue.completedValue), "failed to read timeline semaphore!");
+	return ticket.value <= queue.completedValue;
+}
+
+void Core::Device::wait(GpuTicket ticket) {
+	Queue& queue = queues[ticket.queue];
+	if (ticket.value <= queue.completedValue) return;
+
+	VkSemaphoreWaitInfo waitInfo{
+		.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO,
+		.semaphoreCount = 1,
+		.pSemaphores = &queue.timeline,
+		.pValues = &ticket.value
+	};
+	VK_CHECK_RESULT(vkWaitSemaphores(device_, &waitInfo, UINT64_MAX), "failed to wait for timeline semaphore!");
+	queue.completedValue = std::max(queue.completedValue, ticket.value);
+	releaseCompletedCommands();
+}
+
+void Core::Device::waitSubmissions() {
+	for (uint32_t i = 0; i < QUEUE_COUNT; i++)
+		wait(lastSubmission(static_cast<QueueType>(i)));
+}
+
+void Core::Device::addFrameDependency(GpuTicket ticket) {
+	GpuTicket& dependency = frameDependencies[ticket.queue];
+	dependency.value = std::max(dependency.value, ticket.value);
+	dependency.queue = ticket.queue;
+}
+
+std::array<Core::GpuTicket, Core::QUEUE_COUNT> Core::Device::takeFrameDependencies() {
+	std::array<GpuTicket, QUEUE_COUNT> dependencies = frameDependencies;
+	frameDependencies = {};
+	return dependencies;
+}
+
+void Core::Device::releaseCompletedCommands() {
+	std::erase_if(pendingCommands, [this](const std::pair<GpuTicket, VkCommandBuffer>& pending) {
+		if (!isComplete(pending.first)) return false;
+
+		vkFreeCommandBuffers(device_, queues[pending.first.queue].commandPool, 1, &pending.second);
+		return true;
+	});
 }
 
 void Core::Device::copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size) {
@@ -200,29 +327,36 @@ void Core::Device::copyBufferToImage(VkBuffer buffer, VkImage image, uint32_t wi
 	endSingleTimeCommands(commandBuffer);
 }
 
-void Core::Device::createImageWithInfo(const VkImageCreateInfo& imageInfo, VkMemoryPropertyFlags properties, VkImage& image, VkDeviceMemory& imageMemory) {
+void Core::Device::createImageWithInfo(const VkImageCreateInfo& imageInfo, VkMemoryPropertyFlags properties, VkImage& image, Allocation& imageMemory) {
 	if (vkCreateImage(device_, &imageInfo, nullptr, &image) != VK_SUCCESS) {
 		throw std::runtime_error("failed to create image!");
 	}
 
-	VkMemoryRequirements memRequirements;
-	vkGetImageMemoryRequirements(device_, image, &memRequirements);
+	VkImageMemoryRequirementsInfo2 requirementsInfo{ .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_REQUIREMENTS_INFO_2, .image = image };
+	VkMemoryDedicatedRequirements dedicatedRequirements{ .sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS };
+	VkMemoryRequirements2 memRequirements{ .sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2, .pNext = &dedicatedRequirements };
+	vkGetImageMemoryRequirements2(device_, &requirementsInfo, &memRequirements);
 
-	VkMemoryAllocateInfo allocInfo{};
-	allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	allocInfo.allocationSize = memRequirements.size;
-	allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties);
+	//render targets are usually preferred dedicated by the driver
+	VkMemoryDedicatedAllocateInfo dedicatedInfo{ .sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO, .image = image };
+	bool dedicated = dedicatedRequirements.prefersDedicatedAllocation || dedicatedRequirements.requiresDedicatedAllocation;
 
-	if (vkAllocateMemory(device_, &allocInfo, nullptr, &imageMemory) != VK_SUCCESS) {
-		throw std::runtime_error("failed to allocate image memory!");
-	}
+	imageMemory = allocator->allocate(
+		memRequirements.memoryRequirements,
+		findMemoryType(memRequirements.memoryRequirements.memoryTypeBits, properties),
+		imageInfo.tiling == VK_IMAGE_TILING_LINEAR,
+		false,
+		dedicated ? &dedicatedInfo : nullptr,
+		MEMORY_TAG_IMAGE
+	);
 
-	if (vkBindImageMemory(device_, image, imageMemory, 0) != VK_SUCCESS) {
+	if (vkBindImageMemory(device_, image, imageMemory.memory, imageMemory.offset) != VK_SUCCESS) {
 		throw std::runtime_error("failed to bind image memory!");
 	}
 }
 
 void Core::Device::createInstance() {
+	TRACE_ZONE("Device::createInstance");
 	if (enableValidationLayers && !checkValidationLayerSupport()) {
 		throw std::runtime_error("validation layers requested, but not available!");
 	}
@@ -273,10 +407,12 @@ void Core::Device::setupDebugMessenger() {
 }
 
 void Core::Device::createSurface() {
+	if (isHeadless()) return;
 	window->createWindowSurface(instance, &surface_);
 }
 
 void Core::Device::pickPhysicalDevice() {
+	TRACE_ZONE("Device::pickPhysicalDevice");
 	uint32_t deviceCount = 0;
 	vkEnumeratePhysicalDevices(instance, &deviceCount, nullptr);
 	if (deviceCount == 0)
@@ -319,10 +455,16 @@ void Core::Device::pickPhysicalDevice() {
 }
 
 void Core::Device::createLogicalDevice() {
+	TRACE_ZONE("Device::createLogicalDevice");
 	QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
 
+	//transfer and compute share the graphics queue on drivers with a single family
+	queues[QUEUE_GRAPHICS].family = indices.graphicsFamily;
+	queues[QUEUE_TRANSFER].family = indices.transferFamilyHasValue ? indices.transferFamily : indices.graphicsFamily;
+	queues[QUEUE_COMPUTE].family = indices.computeFamilyHasValue ? indices.computeFamily : indices.graphicsFamily;
+
 	std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
-	std::set<uint32_t> uniqueQueueFamilies = { indices.graphicsFamily, indices.presentFamily };
+	std::set<uint32_t> uniqueQueueFamilies = { indices.graphicsFamily, indices.presentFamily, queues[QUEUE_TRANSFER].family, queues[QUEUE_COMPUTE].family };
 
 	float queuePriority = 1.0f;
 	for (uint32_t queueFamily : uniqueQueueFamilies) {
@@ -356,6 +498,10 @@ void Core::Device::createLogicalDevice() {
 	synchronizationFeature.synchronization2 = VK_TRUE;
 	accelStructureFeature.pNext = &synchronizationFeature;
 
+	VkPhysicalDeviceTimelineSemaphoreFeatures timelineFeature{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES };
+	timelineFeature.timelineSemaphore = VK_TRUE;
+	synchronizationFeature.pNext = &timelineFeature;
+
 	VkPhysicalDeviceFeatures2 deviceFeatures2{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2 };
 	deviceFeatures2.features = deviceFeatures;
 	deviceFeatures2.pNext = &bufferDeviceAddressFeature;
@@ -367,8 +513,9 @@ void Core::Device::createLogicalDevice() {
 	createInfo.pQueueCreateInfos = queueCreateInfos.data();
 
 	//createInfo.pEnabledFeatures = &deviceFeatures;
-	createInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
-	createInfo.ppEnabledExtensionNames = deviceExtensions.data();
+	std::vector<const char*> extensions = getDeviceExtensions();
+	createInfo.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
+	createInfo.ppEnabledExtensionNames = extensions.data();
 	createInfo.pNext = &deviceFeatures2;
 
 	// might not really be necessary anymore because device specific validation layers
@@ -385,24 +532,44 @@ void Core::Device::createLogicalDevice() {
 		throw std::runtime_error("failed to create logical device!");
 	}
 
-	vkGetDeviceQueue(device_, indices.graphicsFamily, 0, &graphicsQueue_);
+	for (Queue& queue : queues)
+		vkGetDeviceQueue(device_, queue.family, 0, &queue.queue);
 	vkGetDeviceQueue(device_, indices.presentFamily, 0, &presentQueue_);
-}
 
-void Core::Device::createCommandPool() {
-	QueueFamilyIndices queueFamilyIndices = findPhysicalQueueFamilies();
+	std::set<uint32_t> bufferFamilies = { queues[QUEUE_GRAPHICS].family, queues[QUEUE_TRANSFER].family, queues[QUEUE_COMPUTE].family };
+	bufferQueueFamilies.assign(bufferFamilies.begin(), bufferFamilies.end());
 
-	VkCommandPoolCreateInfo poolInfo = {};
-	poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-	poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily;
-	poolInfo.flags =
-		VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+	std::cout << "[INFO] Device: graphics family " << queues[QUEUE_GRAPHICS].family
+		<< ", transfer family " << queues[QUEUE_TRANSFER].family << (indices.transferFamilyHasValue ? " (dedicated)" : " (graphics)")
+		<< ", compute family " << queues[QUEUE_COMPUTE].family << (indices.computeFamilyHasValue ? " (async)" : " (graphics)") << std::endl;
+}
 
-	if (vkCreateCommandPool(device_, &poolInfo, nullptr, &commandPool) != VK_SUCCESS) {
-		throw std::runtime_error("failed to create command pool!");
+void Core::Device::createCommandPools() {
+	for (Queue& queue : queues) {
+		VkCommandPoolCreateInfo poolInfo = {};
+		poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+		poolInfo.queueFamilyIndex = queue.family;
+		poolInfo.flags =
+			VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+
+		if (vkCreateCommandPool(device_, &poolInfo, nullptr, &queue.commandPool) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create command pool!");
+		}
 	}
 }
 
+void Core::Device::createTimelines() {
+	VkSemaphoreTypeCreateInfo typeInfo{
+		.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
+		.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE,
+		.initialValue = 0
+	};
+	VkSemaphoreCreateInfo createInfo{ .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO, .pNext = &typeInfo };
+
+	for (Queue& queue : queues)
+		VK_CHECK_RESULT(vkCreateSemaphore(device_, &createInfo, nullptr, &queue.timeline), "failed to create timeline semaphore!");
+}
+
 void Core::Device::creatRayTracingProperties() {
 	std::cout << "creating ray tracing properties" << std::endl;
 	
@@ -418,8 +585,8 @@ bool Core::Device::isDeviceSuitable(VkPhysicalDevice device) {
 
 	bool extensionsSupported = checkDeviceExtensionSupport(device);
 
-	bool swapChainAdequate = false;
-	if (extensionsSupported) {
+	bool swapChainAdequate = isHeadless();
+	if (extensionsSupported && !isHeadless()) {
 		SwapChainSupportDetails swapChainSupport = querySwapChainSupport(device);
 		swapChainAdequate = !swapChainSupport.formats.empty() && !swapChainSupport.presentModes.empty();
 	}
@@ -432,11 +599,14 @@ bool Core::Device::isDeviceSuitable(VkPhysicalDevice device) {
 }
 
 std::vector<const char*> Core::Device::getRequiredExtensions() {
-	uint32_t glfwExtensionCount = 0;
-	const char** glfwExtensions;
-	glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+	std::vector<const char*> extensions;
 
-	std::vector<const char*> extensions(glfwExtensions, glfwExtensions + glfwExtensionCount);
+	//GLFW is never initialized without a window
+	if (!isHeadless()) {
+		uint32_t glfwExtensionCount = 0;
+		const char** glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+		extensions.assign(glfwExtensions, glfwExtensions + glfwExtensionCount);
+	}
 
 	if (enableValidationLayers) {
 		extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
@@ -445,6 +615,12 @@ std::vector<const char*> Core::Device::getRequiredExtensions() {
 	return extensions;
 }
 
+std::vector<const char*> Core::Device::getDeviceExtensions() {
+	std::vector<const char*> extensions = deviceExtensions;
+	if (!isHeadless()) extensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+	return extensions;
+}
+
 bool Core::Device::checkValidationLayerSupport() {
 	uint32_t layerCount;
 	vkEnumerateInstanceLayerProperties(&layerCount, nullptr);
@@ -479,8 +655,23 @@ Core::QueueFamilyIndices Core::Device::findQueueFamilies(VkPhysicalDevice device
 	std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
 	vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, queueFamilies.data());
 
+	//trace rays and acceleration structure builds only need a compute queue, which is all a headless device asks for
+	if (isHeadless()) {
+		for (uint32_t family = 0; family < queueFamilyCount; family++) {
+			if (queueFamilies[family].queueCount == 0 || !(queueFamilies[family].queueFlags & VK_QUEUE_COMPUTE_BIT)) continue;
+
+			indices.graphicsFamily = family;
+			indices.graphicsFamilyHasValue = true;
+			indices.presentFamily = family;
+			indices.presentFamilyHasValue = true;
+			break;
+		}
+	}
+
 	int i = 0;
 	for (const auto& queueFamily : queueFamilies) {
+		if (indices.isComplete()) break;
+
 		if (queueFamily.queueCount > 0 && queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) {
 			indices.graphicsFamily = i;
 			indices.graphicsFamilyHasValue = true;
@@ -498,6 +689,21 @@ Core::QueueFamilyIndices Core::Device::findQueueFamilies(VkPhysicalDevice device
 		i++;
 	}
 
+	//prefer families without graphics, their queues run next to the graphics queue instead of sharing it
+	for (uint32_t family = 0; family < queueFamilyCount; family++) {
+		const VkQueueFamilyProperties& properties = queueFamilies[family];
+		if (properties.queueCount == 0 || (properties.queueFlags & VK_QUEUE_GRAPHICS_BIT)) continue;
+
+		if ((properties.queueFlags & VK_QUEUE_COMPUTE_BIT) && !indices.computeFamilyHasValue) {
+			indices.computeFamily = family;
+			indices.computeFamilyHasValue = true;
+		}
+		if ((properties.queueFlags & VK_QUEUE_TRANSFER_BIT) && !(properties.queueFlags & VK_QUEUE_COMPUTE_BIT) && !indices.transferFamilyHasValue) {
+			indices.transferFamily = family;
+			indices.transferFamilyHasValue = true;
+		}
+	}
+
 	return indices;
 }
 
@@ -553,7 +759,8 @@ bool Core::Device::checkDeviceExtensionSupport(VkPhysicalDevice device) {
 		&extensionCount,
 		availableExtensions.data());
 
-	std::set<std::string> requiredExtensions(deviceExtensions.begin(), deviceExtensions.end());
+	std::vector<const char*> extensions = getDeviceExtensions();
+	std::set<std::string> requiredExtensions(extensions.begin(), extensions.end());
 
 	for (const auto& extension : availableExtensions) {
 		requiredExtensions.erase(extension.extensionName);
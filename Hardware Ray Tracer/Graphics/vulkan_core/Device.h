@@ -1,13 +1,34 @@
 #pragma once
 #include "../Window.h"
 #include "../Definitions.h"
+#include "MemoryAllocator.h"
+#include "DeviceDispatch.h"
+#include <array>
+#include <memory>
+#include <span>
 #include <string>
+#include <utility>
 #include <vector>
 #include <iostream>
 
-#define vkGetBufferDeviceAddressKHR reinterpret_cast<PFN_vkGetBufferDeviceAddressKHR>(vkGetDeviceProcAddr(device_, "vkGetBufferDeviceAddressKHR"))
-
 namespace Core {
+	class StagingRing;
+
+	//queues one-shot work is submitted to, transfer and compute fall back to the graphics queue if the hardware
+	//has no separate family for them
+	enum QueueType : uint32_t {
+		QUEUE_GRAPHICS,
+		QUEUE_TRANSFER,
+		QUEUE_COMPUTE,
+		QUEUE_COUNT
+	};
+
+	//value of the timeline semaphore of a queue that is reached once a submission completed, 0 is always complete
+	struct GpuTicket {
+		uint64_t value = 0;
+		QueueType queue = QUEUE_GRAPHICS;
+	};
+
 	struct SwapChainSupportDetails {
 		VkSurfaceCapabilitiesKHR capabilities;
 		std::vector<VkSurfaceFormatKHR> formats;
@@ -15,10 +36,14 @@ namespace Core {
 	};
 
 	struct QueueFamilyIndices {
-		uint32_t graphicsFamily;
-		uint32_t presentFamily;
+		uint32_t graphicsFamily; //first compute family on headless devices
+		uint32_t presentFamily; //same as graphicsFamily on headless devices
+		uint32_t transferFamily; //transfer only family, if any
+		uint32_t computeFamily; //compute family without graphics, if any
 		bool graphicsFamilyHasValue = false;
 		bool presentFamilyHasValue = false;
+		bool transferFamilyHasValue = false;
+		bool computeFamilyHasValue = false;
 		bool isComplete() { return graphicsFamilyHasValue && presentFamilyHasValue; }
 	};
 
@@ -31,6 +56,8 @@ namespace Core {
 #endif
 		VkPhysicalDeviceProperties properties;
 	public:
+		//without a window the device is headless: no surface, no swap chain extension, and the queue is picked
+		//by compute support alone, so ray tracing runs on machines without a display
 		Device(Window* window);
 		~Device();
 
@@ -39,47 +66,81 @@ namespace Core {
 		Device(const Device&&) = delete;
 		Device operator=(Device&&) = delete;
 
-		VkCommandPool getCommandPool() { return commandPool; }
+		VkCommandPool getCommandPool() { return queues[QUEUE_GRAPHICS].commandPool; }
 		VkDevice& getDevice() { return device_; }
 		VkInstance* getInstance() { return &instance; }
+		VkPhysicalDevice getPhysicalDevice() const { return physicalDevice; }
+		bool isHeadless() const { return window == nullptr; }
 		VkSurfaceKHR surface() { return surface_; }
-		VkQueue graphicsQueue() { return graphicsQueue_; }
+		VkQueue graphicsQueue() { return queues[QUEUE_GRAPHICS].queue; }
+		VkQueue getQueue(QueueType queue) { return queues[queue].queue; }
+		uint32_t getQueueFamily(QueueType queue) const { return queues[queue].family; }
 		VkQueue presentQueue() { return presentQueue_; }
 		VkPhysicalDeviceRayTracingPipelinePropertiesKHR* getRTProperties() { return &rtProperties; }
 		VkPhysicalDeviceAccelerationStructurePropertiesKHR* getAccelProperties() { return &accelProperties; }
+		//extension entry points, loaded once after device creation
+		const DeviceDispatch& getDispatch() const { return dispatch; }
 
 		SwapChainSupportDetails getSwapChainSupport() { return querySwapChainSupport(physicalDevice); }
 		uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties);
 		QueueFamilyIndices findPhysicalQueueFamilies() { return findQueueFamilies(physicalDevice); }
 		VkFormat findSupportedFormat(const std::vector<VkFormat>& candidates, VkImageTiling tiling, VkFormatFeatureFlags features);
 
+		//memory is sub-allocated from the allocator of the device and has to be given back with freeMemory
 		void createBuffer(
 			VkDeviceSize size,
 			VkBufferUsageFlags usage,
 			VkMemoryPropertyFlags properties,
 			VkBuffer* buffer,
-			VkDeviceMemory* bufferMemory);
+			Allocation* bufferMemory);
 		VkDeviceAddress getBufferDeviceAddress(VkBuffer buffer);
-		VkCommandBuffer beginSingleTimeCommands();
-		void endSingleTimeCommands(VkCommandBuffer commandBuffer);
+		//the command buffer is allocated for queue and has to be submitted to the same queue
+		VkCommandBuffer beginSingleTimeCommands(QueueType queue = QUEUE_GRAPHICS);
+		//blocks until the commands have finished, see submitSingleTimeCommands
+		void endSingleTimeCommands(VkCommandBuffer commandBuffer, QueueType queue = QUEUE_GRAPHICS);
+		//ends and submits the commands without waiting, pending staging ring copies are submitted first and waited for
+		//so the commands may read uploaded data. The commands start once every ticket in waits is reached, the command
+		//buffer is freed once the returned ticket is reached
+		GpuTicket submitSingleTimeCommands(VkCommandBuffer commandBuffer, std::span<const GpuTicket> waits = {}, QueueType queue = QUEUE_GRAPHICS);
+		//submits a recorded command buffer that signals the next timeline value of queue
+		GpuTicket submit(VkCommandBuffer commandBuffer, std::span<const GpuTicket> waits = {}, QueueType queue = QUEUE_GRAPHICS);
+		bool isComplete(GpuTicket ticket);
+		void wait(GpuTicket ticket);
+		//blocks until all work submitted to any queue so far has completed
+		void waitSubmissions();
+		//ticket of the most recent submission to queue
+		GpuTicket lastSubmission(QueueType queue = QUEUE_GRAPHICS) const { return GpuTicket{ queues[queue].timelineValue, queue }; }
+		VkSemaphore getTimeline(QueueType queue = QUEUE_GRAPHICS) const { return queues[queue].timeline; }
+
+		//the next frame submission waits for ticket, frames only wait for work of other queues they depend on
+		void addFrameDependency(GpuTicket ticket);
+		//one ticket per queue, cleared by the call
+		std::array<GpuTicket, QUEUE_COUNT> takeFrameDependencies();
 		void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size);
 		void copyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width, uint32_t height, uint32_t layerCount);
 		void createImageWithInfo(
 			const VkImageCreateInfo& imageInfo,
 			VkMemoryPropertyFlags properties,
 			VkImage& image,
-			VkDeviceMemory& imageMemory);
+			Allocation& imageMemory);
+		void freeMemory(Allocation& allocation) { allocator->free(allocation); }
+		MemoryStats getMemoryStats() { return allocator->getStats(); }
+		void printMemoryStats() { allocator->printStats(); }
+		StagingRing& getStagingRing() { return *stagingRing; }
 	private:
 		void createInstance();
 		void setupDebugMessenger();
 		void createSurface();
 		void pickPhysicalDevice();
 		void createLogicalDevice();
-		void createCommandPool();
+		void createCommandPools();
+		void createTimelines();
 		void creatRayTracingProperties();
+		void releaseCompletedCommands();
 
 		bool isDeviceSuitable(VkPhysicalDevice device);
 		std::vector<const char*> getRequiredExtensions();
+		std::vector<const char*> getDeviceExtensions();
 		bool checkValidationLayerSupport();
 		QueueFamilyIndices findQueueFamilies(VkPhysicalDevice device);
 		void populateDebugMessengerCreateInfo(VkDebugUtilsMessengerCreateInfoEXT* createInfo);
@@ -93,18 +154,33 @@ namespace Core {
 		VkDebugUtilsMessengerEXT debugMessenger;
 		VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
 		Window* window;
-		VkCommandPool commandPool;
+		std::unique_ptr<MemoryAllocator> allocator;
+		std::unique_ptr<StagingRing> stagingRing;
+
+		//logical queues may share a VkQueue, each still has its own timeline so signaled values always increase
+		struct Queue {
+			VkQueue queue;
+			uint32_t family;
+			VkCommandPool commandPool;
+			VkSemaphore timeline = VK_NULL_HANDLE;
+			uint64_t timelineValue = 0; //last signaled by a submission
+			uint64_t completedValue = 0; //last value the host saw the semaphore reach
+		};
+		std::array<Queue, QUEUE_COUNT> queues{};
+		std::vector<uint32_t> bufferQueueFamilies; //distinct families of all queues, buffers are shared between them
+		std::vector<std::pair<GpuTicket, VkCommandBuffer>> pendingCommands; //one-shot command buffers that are not complete yet
+		std::array<GpuTicket, QUEUE_COUNT> frameDependencies{};
 
 		VkDevice device_;
-		VkSurfaceKHR surface_;
-		VkQueue graphicsQueue_;
+		DeviceDispatch dispatch;
+		VkSurfaceKHR surface_ = VK_NULL_HANDLE;
 		VkQueue presentQueue_;
 		VkPhysicalDeviceRayTracingPipelinePropertiesKHR rtProperties{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_RAY_TRACING_PIPELINE_PROPERTIES_KHR };
 		VkPhysicalDeviceAccelerationStructurePropertiesKHR accelProperties{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ACCELERATION_STRUCTURE_PROPERTIES_KHR };
 
 		const std::vector<const char*> validationLayers = { "VK_LAYER_KHRONOS_validation" };
+		//VK_KHR_swapchain is added by getDeviceExtensions unless the device is headless
 		const std::vector<const char*> deviceExtensions = { 
-			VK_KHR_SWAPCHAIN_EXTENSION_NAME,
 			VK_KHR_ACCELERATION_STRUCTURE_EXTENSION_NAME,
 			VK_KHR_RAY_TRACING_PIPELINE_EXTENSION_NAME,
 			VK_KHR_DEFERRED_HOST_OPERATIONS_EXTENSION_NAME,
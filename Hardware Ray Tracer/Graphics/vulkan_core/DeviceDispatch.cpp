@@ -0,0 +1,47 @@
+#include "DeviceDispatch.h"
+#include "Device.h"
+
+#include <chrono>
+#include <string>
+
+void Core::DeviceDispatch::load(VkDevice device, bool debugUtils) {
+#define DEVICE_DISPATCH_LOAD(name) \
+	name = reinterpret_cast<PFN_##name>(vkGetDeviceProcAddr(device, #name)); \
+	if (!name) throw std::runtime_error(std::string("failed to load ") + #name + "!");
+	DEVICE_DISPATCH_REQUIRED(DEVICE_DISPATCH_LOAD)
+#undef DEVICE_DISPATCH_LOAD
+
+	if (!debugUtils) return;
+#define DEVICE_DISPATCH_LOAD_OPTIONAL(name) name = reinterpret_cast<PFN_##name>(vkGetDeviceProcAddr(device, #name));
+	DEVICE_DISPATCH_DEBUG_UTILS(DEVICE_DISPATCH_LOAD_OPTIONAL)
+#undef DEVICE_DISPATCH_LOAD_OPTIONAL
+}
+
+void Core::benchmarkDispatch(Device& device, uint32_t iterations) {
+	VkBuffer buffer;
+	Allocation memory;
+	device.createBuffer(256, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &buffer, &memory);
+
+	VkBufferDeviceAddressInfo addressInfo{ .sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO, .buffer = buffer };
+	VkDevice handle = device.getDevice();
+	//summed so the calls cannot be optimized away
+	VkDeviceAddress sum = 0;
+
+	//what every call cost while the entry points were looked up by name at the call site
+	auto start = std::chrono::high_resolution_clock::now();
+	for (uint32_t i = 0; i < iterations; i++)
+		sum += reinterpret_cast<PFN_vkGetBufferDeviceAddressKHR>(vkGetDeviceProcAddr(handle, "vkGetBufferDeviceAddressKHR"))(handle, &addressInfo);
+	float lookupTime = std::chrono::duration<float, std::chrono::nanoseconds::period>(std::chrono::high_resolution_clock::now() - start).count();
+
+	const DeviceDispatch& dispatch = device.getDispatch();
+	start = std::chrono::high_resolution_clock::now();
+	for (uint32_t i = 0; i < iterations; i++)
+		sum += dispatch.vkGetBufferDeviceAddressKHR(handle, &addressInfo);
+	float tableTime = std::chrono::duration<float, std::chrono::nanoseconds::period>(std::chrono::high_resolution_clock::now() - start).count();
+
+	vkDestroyBuffer(handle, buffer, nullptr);
+	device.freeMemory(memory);
+
+	std::cout << "[INFO] DeviceDispatch: vkGetBufferDeviceAddressKHR takes " << lookupTime / iterations << " ns per call with a name lookup, "
+		<< tableTime / iterations << " ns through the dispatch table (" << iterations << " calls, checksum " << (sum & 0xff) << ")" << std::endl;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "../Definitions.h"
+
+#include <cstdint>
+
+//device level entry points the loader does not export, or only exports through a trampoline
+//adding a function to one of the lists adds the member to Core::DeviceDispatch and loads it in DeviceDispatch::load
+#define DEVICE_DISPATCH_BUFFER_ADDRESS(X) \
+	X(vkGetBufferDeviceAddressKHR)
+
+#define DEVICE_DISPATCH_ACCELERATION_STRUCTURE(X) \
+	X(vkCreateAccelerationStructureKHR) \
+	X(vkDestroyAccelerationStructureKHR) \
+	X(vkGetAccelerationStructureBuildSizesKHR) \
+	X(vkGetAccelerationStructureDeviceAddressKHR) \
+	X(vkCmdBuildAccelerationStructuresKHR) \
+	X(vkCmdWriteAccelerationStructuresPropertiesKHR) \
+	X(vkCmdCopyAccelerationStructureKHR)
+
+#define DEVICE_DISPATCH_RAY_TRACING_PIPELINE(X) \
+	X(vkCreateRayTracingPipelinesKHR) \
+	X(vkGetRayTracingShaderGroupHandlesKHR) \
+	X(vkCmdTraceRaysKHR)
+
+#define DEVICE_DISPATCH_SYNCHRONIZATION_2(X) \
+	X(vkCmdPipelineBarrier2) \
+	X(vkCmdWriteTimestamp2) \
+	X(vkQueueSubmit2)
+
+//only available if the instance enabled VK_EXT_debug_utils, the members stay null otherwise
+#define DEVICE_DISPATCH_DEBUG_UTILS(X) \
+	X(vkSetDebugUtilsObjectNameEXT) \
+	X(vkCmdBeginDebugUtilsLabelEXT) \
+	X(vkCmdEndDebugUtilsLabelEXT) \
+	X(vkCmdInsertDebugUtilsLabelEXT)
+
+#define DEVICE_DISPATCH_REQUIRED(X) \
+	DEVICE_DISPATCH_BUFFER_ADDRESS(X) \
+	DEVICE_DISPATCH_ACCELERATION_STRUCTURE(X) \
+	DEVICE_DISPATCH_RAY_TRACING_PIPELINE(X) \
+	DEVICE_DISPATCH_SYNCHRONIZATION_2(X)
+
+namespace Core {
+	class Device;
+
+	/*
+	 * Device dispatch table
+	 * Filled once by Device after the logical device was created, calls through the table go straight to the driver
+	 * instead of looking the function up by name every time.
+	 */
+	struct DeviceDispatch {
+#define DEVICE_DISPATCH_MEMBER(name) PFN_##name name = nullptr;
+		DEVICE_DISPATCH_REQUIRED(DEVICE_DISPATCH_MEMBER)
+		DEVICE_DISPATCH_DEBUG_UTILS(DEVICE_DISPATCH_MEMBER)
+#undef DEVICE_DISPATCH_MEMBER
+
+		//throws if a required function is missing
+		void load(VkDevice device, bool debugUtils);
+	};
+
+	//logs the cost of a vkGetBufferDeviceAddressKHR call through a name lookup and through the table
+	//RTApp runs it after setup if BENCHMARK_DISPATCH is defined
+	void benchmarkDispatch(Device& device, uint32_t iterations = 100000);
+}
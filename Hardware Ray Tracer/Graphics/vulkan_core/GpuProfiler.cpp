@@ -0,0 +1,168 @@
+#include "GpuProfiler.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+Core::GpuProfiler::Scope::Scope(GpuProfiler* profiler, VkCommandBuffer cmd, const char* name, uint64_t maxRays)
+	: profiler(profiler && profiler->enabled ? profiler : nullptr),
+	cmd(cmd) {
+	if (this->profiler) this->profiler->begin(cmd, name, maxRays);
+}
+
+Core::GpuProfiler::Scope::~Scope() {
+	if (profiler) profiler->end(cmd);
+}
+
+Core::GpuProfiler::GpuProfiler(Device& device, const std::string& csvPath) : device(device) {
+	//timestampComputeAndGraphics guarantees timestamps on every graphics and compute queue
+	uint32_t familyCount = 0;
+	vkGetPhysicalDeviceQueueFamilyProperties(device.getPhysicalDevice(), &familyCount, nullptr);
+	std::vector<VkQueueFamilyProperties> families(familyCount);
+	vkGetPhysicalDeviceQueueFamilyProperties(device.getPhysicalDevice(), &familyCount, families.data());
+
+	uint32_t validBits = families[device.getQueueFamily(QUEUE_GRAPHICS)].timestampValidBits;
+	if (!device.properties.limits.timestampComputeAndGraphics || validBits == 0) {
+		std::cout << "[WARNING] GpuProfiler: the graphics queue does not support timestamps, profiling is disabled" << std::endl;
+		return;
+	}
+
+	enabled = true;
+	timestampPeriod = device.properties.limits.timestampPeriod;
+	timestampMask = validBits >= 64 ? ~0ull : (1ull << validBits) - 1;
+
+	VkQueryPoolCreateInfo poolInfo{
+		.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+		.queryType = VK_QUERY_TYPE_TIMESTAMP,
+		.queryCount = MAX_SCOPES * 2
+	};
+	for (FrameSlot& slot : slots)
+		VK_CHECK_RESULT(vkCreateQueryPool(device.getDevice(), &poolInfo, nullptr, &slot.queryPool), "failed to create timestamp query pool!");
+
+	results.resize(MAX_SCOPES * 2);
+
+	csv.open(csvPath, std::ios::trunc);
+	if (csv.is_open()) csv << "frame,pass,gpu_ms,max_rays,max_mrays_per_second\n";
+	else std::cout << "[WARNING] GpuProfiler: failed to open " << csvPath << ", writing to the console only" << std::endl;
+}
+
+Core::GpuProfiler::~GpuProfiler() {
+	//the owner waited for the device, the last frames in flight are complete
+	for (FrameSlot& slot : slots) {
+		collect(slot);
+		vkDestroyQueryPool(device.getDevice(), slot.queryPool, nullptr);
+	}
+	if (enabled) report();
+}
+
+void Core::GpuProfiler::beginFrame(VkCommandBuffer cmd, uint32_t frameIndex) {
+	if (!enabled) return;
+	assert(openScopes.empty() && "GpuProfiler scope of the previous frame was not closed");
+
+	current = &slots[frameIndex];
+	collect(*current);
+
+	current->frame = frameCount++;
+	vkCmdResetQueryPool(cmd, current->queryPool, 0, MAX_SCOPES * 2);
+
+	if (frameCount % REPORT_INTERVAL == 0) report();
+}
+
+void Core::GpuProfiler::begin(VkCommandBuffer cmd, const char* name, uint64_t maxRays) {
+	assert(current && "GpuProfiler scope outside of a frame");
+	if (current->records.size() >= MAX_SCOPES) {
+		//the scope is still closed by its destructor, an invalid record keeps begin and end paired
+		openScopes.push_back(UINT32_MAX);
+		return;
+	}
+
+	uint32_t record = static_cast<uint32_t>(current->records.size());
+	current->records.push_back({ .pass = findPass(name), .maxRays = maxRays });
+	openScopes.push_back(record);
+
+	device.getDispatch().vkCmdWriteTimestamp2(cmd, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, current->queryPool, record * 2);
+}
+
+void Core::GpuProfiler::end(VkCommandBuffer cmd) {
+	uint32_t record = openScopes.back();
+	openScopes.pop_back();
+	if (record == UINT32_MAX) return;
+
+	device.getDispatch().vkCmdWriteTimestamp2(cmd, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, current->queryPool, record * 2 + 1);
+}
+
+void Core::GpuProfiler::collect(FrameSlot& slot) {
+	if (slot.records.empty()) return;
+
+	//the fence of the slot was waited on, the results are available without VK_QUERY_RESULT_WAIT_BIT
+	uint32_t queryCount = static_cast<uint32_t>(slot.records.size()) * 2;
+	VkResult result = vkGetQueryPoolResults(device.getDevice(), slot.queryPool, 0, queryCount, queryCount * sizeof(uint64_t), results.data(), sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+	if (result != VK_SUCCESS) {
+		//a frame whose submission was discarded never wrote its timestamps
+		slot.records.clear();
+		return;
+	}
+
+	for (uint32_t i = 0; i < slot.records.size(); i++) {
+		uint64_t ticks = (results[i * 2 + 1] - results[i * 2]) & timestampMask;
+		addTime(slot.records[i].pass, static_cast<float>(ticks) * timestampPeriod * 1e-6f, slot.records[i].maxRays);
+	}
+
+	writeCsv(slot.frame, slot.records);
+	slot.records.clear();
+}
+
+void Core::GpuProfiler::addSample(const char* name, float time, uint64_t maxRays) {
+	if (!enabled) return;
+
+	Record record{ .pass = findPass(name), .maxRays = maxRays };
+	addTime(record.pass, time, maxRays);
+	writeCsv(frameCount, { record });
+}
+
+void Core::GpuProfiler::addTime(uint32_t pass, float time, uint64_t maxRays) {
+	Pass& entry = passes[pass];
+	entry.times[entry.samples % HISTORY] = time;
+	entry.samples++;
+	entry.lastTime = time;
+	entry.maxRays = maxRays;
+}
+
+void Core::GpuProfiler::writeCsv(uint64_t frame, const std::vector<Record>& records) {
+	if (!csv.is_open()) return;
+
+	for (const Record& record : records) {
+		const Pass& pass = passes[record.pass];
+		float maxMraysPerSecond = record.maxRays && pass.lastTime > 0.0f ? static_cast<float>(record.maxRays) / (pass.lastTime * 1e3f) : 0.0f;
+		csv << frame << ',' << pass.name << ',' << pass.lastTime << ',' << record.maxRays << ',' << maxMraysPerSecond << '\n';
+	}
+}
+
+void Core::GpuProfiler::report() {
+	std::vector<float> sorted;
+	for (const Pass& pass : passes) {
+		if (pass.samples == 0) continue;
+
+		uint32_t count = std::min(pass.samples, HISTORY);
+		sorted.assign(pass.times.begin(), pass.times.begin() + count);
+		std::sort(sorted.begin(), sorted.end());
+
+		float sum = 0.0f;
+		for (float time : sorted) sum += time;
+		float average = sum / count;
+		float p99 = sorted[std::min(count - 1, static_cast<uint32_t>(count * 0.99f))];
+
+		std::cout << "[INFO] GpuProfiler: " << pass.name << " min " << sorted.front() << " ms, avg " << average << " ms, p99 " << p99 << " ms";
+		//paths can terminate early, the rate is not a measured throughput
+		if (pass.maxRays) std::cout << ", <= " << static_cast<float>(pass.maxRays) / (average * 1e3f) << " Mrays/s (upper bound)";
+		std::cout << " (" << count << " frames)" << std::endl;
+	}
+}
+
+uint32_t Core::GpuProfiler::findPass(const char* name) {
+	for (uint32_t i = 0; i < passes.size(); i++)
+		if (passes[i].name == name || strcmp(passes[i].name, name) == 0) return i;
+
+	passes.push_back({ .name = name });
+	return static_cast<uint32_t>(passes.size() - 1);
+}
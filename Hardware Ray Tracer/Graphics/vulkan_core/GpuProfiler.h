@@ -0,0 +1,99 @@
+#pragma once
+
+#include "Device.h"
+#include "SwapChain.h"
+
+#include <array>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace Core {
+
+	/*
+	 * GPU timestamp profiler
+	 * Scopes write a timestamp before and after the commands they enclose into the query range of the current frame
+	 * slot. The results of a slot are read back when the slot is begun again, its fence was waited on by then, so the
+	 * read never stalls and every pass is reported MAX_FRAMES_IN_FLIGHT frames late.
+	 * Every pass keeps the times of its last HISTORY frames for min, average and p99. A pass given a ray count also
+	 * reports rays per second. The count is the most rays the pass can trace, so the rate is an upper bound and labeled as one.
+	 * Each frame is appended to the CSV file, the console gets a summary every REPORT_INTERVAL frames.
+	 * Samples added with addSample are reported with the passes of the frame they were added in.
+	 */
+	class GpuProfiler {
+	public:
+		static constexpr uint32_t MAX_SCOPES = 32; //per frame
+		static constexpr uint32_t HISTORY = 256;
+		static constexpr uint32_t REPORT_INTERVAL = 300;
+
+		//records the enclosed commands of cmd under name, does nothing without a profiler
+		//name has to outlive the profiler, scopes of the same name are one pass
+		class Scope {
+		public:
+			Scope(GpuProfiler* profiler, VkCommandBuffer cmd, const char* name, uint64_t maxRays = 0);
+			~Scope();
+
+			Scope(const Scope&) = delete;
+			Scope operator=(const Scope&) = delete;
+		private:
+			GpuProfiler* profiler;
+			VkCommandBuffer cmd;
+		};
+
+		GpuProfiler(Device& device, const std::string& csvPath = "gpu_profile.csv");
+		~GpuProfiler();
+
+		GpuProfiler(const GpuProfiler&) = delete;
+		GpuProfiler operator=(const GpuProfiler&) = delete;
+
+		//collects the results of the previous use of the frame slot and resets its queries in cmd
+		//call once the fence of the slot was waited on, before the first scope of the frame
+		void beginFrame(VkCommandBuffer cmd, uint32_t frameIndex);
+		//adds a time measured outside the frame queries to the pass name, e.g. of work submitted to another queue
+		void addSample(const char* name, float time, uint64_t maxRays = 0);
+
+		inline bool isEnabled() const { return enabled; }
+	private:
+		struct Pass {
+			const char* name;
+			std::array<float, HISTORY> times{}; //ms
+			uint32_t samples = 0;
+			uint64_t maxRays = 0; //of the latest sample
+			float lastTime = 0.0f;
+		};
+
+		struct Record {
+			uint32_t pass;
+			uint64_t maxRays;
+		};
+
+		struct FrameSlot {
+			VkQueryPool queryPool = VK_NULL_HANDLE;
+			std::vector<Record> records; //one begin and end timestamp each
+			uint64_t frame = 0;
+		};
+
+		void begin(VkCommandBuffer cmd, const char* name, uint64_t maxRays);
+		void end(VkCommandBuffer cmd);
+
+		void collect(FrameSlot& slot);
+		void addTime(uint32_t pass, float time, uint64_t maxRays);
+		void writeCsv(uint64_t frame, const std::vector<Record>& records);
+		void report();
+		uint32_t findPass(const char* name);
+	private:
+		Device& device;
+		bool enabled = false;
+		float timestampPeriod = 0.0f; //ns per tick
+		uint64_t timestampMask = ~0ull;
+
+		std::array<FrameSlot, SwapChain::MAX_FRAMES_IN_FLIGHT> slots;
+		FrameSlot* current = nullptr;
+		std::vector<uint32_t> openScopes; //records of the current frame whose end was not written yet
+		uint64_t frameCount = 0;
+
+		std::vector<Pass> passes;
+		std::vector<uint64_t> results;
+		std::ofstream csv;
+	};
+}
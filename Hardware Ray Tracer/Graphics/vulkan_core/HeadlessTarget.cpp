@@ -0,0 +1,133 @@
+#include "HeadlessTarget.h"
+
+#include <algorithm>
+#include <fstream>
+#include <limits>
+#include <vector>
+
+Core::HeadlessTarget::HeadlessTarget(Device& device, VkExtent2D extent) : device(device), extent(extent) {
+	VkFenceCreateInfo fenceInfo{
+		.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+		.flags = VK_FENCE_CREATE_SIGNALED_BIT
+	};
+
+	for (uint32_t i = 0; i < SwapChain::MAX_FRAMES_IN_FLIGHT; i++) {
+		readbackBuffers[i] = std::make_unique<Buffer>(
+			device,
+			static_cast<VkDeviceSize>(extent.width) * extent.height * PIXEL_SIZE,
+			VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
+		);
+		readbackBuffers[i]->map();
+
+		VK_CHECK_RESULT(vkCreateFence(device.getDevice(), &fenceInfo, nullptr, &fences[i]), "failed to create frame fence!");
+	}
+}
+
+Core::HeadlessTarget::~HeadlessTarget() {
+	vkWaitForFences(device.getDevice(), static_cast<uint32_t>(fences.size()), fences.data(), VK_TRUE, std::numeric_limits<uint64_t>::max());
+	for (VkFence fence : fences)
+		vkDestroyFence(device.getDevice(), fence, nullptr);
+}
+
+void Core::HeadlessTarget::waitFrame(uint32_t frameIndex) {
+	vkWaitForFences(device.getDevice(), 1, &fences[frameIndex], VK_TRUE, std::numeric_limits<uint64_t>::max());
+}
+
+void Core::HeadlessTarget::recordReadback(VkCommandBuffer cmd, VkImage image, uint32_t frameIndex) {
+	VkImageMemoryBarrier imageBarrier{
+		.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+		.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+		.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT,
+		.oldLayout = VK_IMAGE_LAYOUT_GENERAL,
+		.newLayout = VK_IMAGE_LAYOUT_GENERAL,
+		.image = image,
+		.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 }
+	};
+	vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, VK_NULL_HANDLE, 0, VK_NULL_HANDLE, 1, &imageBarrier);
+
+	VkBufferImageCopy region{
+		.bufferOffset = 0,
+		.bufferRowLength = 0,
+		.bufferImageHeight = 0,
+		.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 },
+		.imageOffset = { 0, 0, 0 },
+		.imageExtent = { extent.width, extent.height, 1 }
+	};
+	vkCmdCopyImageToBuffer(cmd, image, VK_IMAGE_LAYOUT_GENERAL, readbackBuffers[frameIndex]->getBuffer(), 1, &region);
+
+	//makes the copy visible to the host once the fence of the slot signaled
+	VkBufferMemoryBarrier bufferBarrier{
+		.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+		.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+		.dstAccessMask = VK_ACCESS_HOST_READ_BIT,
+		.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.buffer = readbackBuffers[frameIndex]->getBuffer(),
+		.offset = 0,
+		.size = VK_WHOLE_SIZE
+	};
+	vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 0, VK_NULL_HANDLE, 1, &bufferBarrier, 0, VK_NULL_HANDLE);
+}
+
+void Core::HeadlessTarget::submit(VkCommandBuffer cmd, uint32_t frameIndex) {
+	//same dependencies as SwapChain::submitCommandBuffers, without an image to acquire
+	std::array<GpuTicket, QUEUE_COUNT> dependencies = device.takeFrameDependencies();
+	dependencies[QUEUE_GRAPHICS] = device.lastSubmission(QUEUE_GRAPHICS);
+
+	VkSemaphore waitSemaphores[QUEUE_COUNT];
+	uint64_t waitValues[QUEUE_COUNT];
+	VkPipelineStageFlags waitStages[QUEUE_COUNT];
+	uint32_t waitCount = 0;
+	for (uint32_t i = 0; i < QUEUE_COUNT; i++) {
+		if (dependencies[i].value == 0) continue;
+
+		waitSemaphores[waitCount] = device.getTimeline(static_cast<QueueType>(i));
+		waitValues[waitCount] = dependencies[i].value;
+		waitStages[waitCount] = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+		waitCount++;
+	}
+
+	VkTimelineSemaphoreSubmitInfo timelineInfo{
+		.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+		.waitSemaphoreValueCount = waitCount,
+		.pWaitSemaphoreValues = waitValues
+	};
+
+	VkSubmitInfo submitInfo{
+		.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+		.pNext = &timelineInfo,
+		.waitSemaphoreCount = waitCount,
+		.pWaitSemaphores = waitSemaphores,
+		.pWaitDstStageMask = waitStages,
+		.commandBufferCount = 1,
+		.pCommandBuffers = &cmd
+	};
+
+	vkResetFences(device.getDevice(), 1, &fences[frameIndex]);
+	VK_CHECK_RESULT(vkQueueSubmit(device.graphicsQueue(), 1, &submitInfo, fences[frameIndex]), "failed to submit offscreen frame!");
+}
+
+const float* Core::HeadlessTarget::getPixels(uint32_t frameIndex) const {
+	return static_cast<const float*>(readbackBuffers[frameIndex]->getMappedMemory());
+}
+
+void Core::HeadlessTarget::writeImage(const std::string& path, uint32_t frameIndex) const {
+	std::ofstream out(path, std::ios::binary | std::ios::trunc);
+	if (!out.is_open()) throw std::runtime_error("failed to open " + path);
+
+	out << "P6\n" << extent.width << " " << extent.height << "\n255\n";
+
+	const float* pixels = getPixels(frameIndex);
+	std::vector<uint8_t> row(extent.width * 3);
+	for (uint32_t y = 0; y < extent.height; y++) {
+		for (uint32_t x = 0; x < extent.width; x++) {
+			const float* pixel = pixels + (static_cast<size_t>(y) * extent.width + x) * 4;
+			for (uint32_t c = 0; c < 3; c++)
+				row[x * 3 + c] = static_cast<uint8_t>(std::clamp(pixel[c], 0.0f, 1.0f) * 255.0f + 0.5f);
+		}
+		out.write(reinterpret_cast<const char*>(row.data()), row.size());
+	}
+
+	if (!out) throw std::runtime_error("failed to write " + path);
+}
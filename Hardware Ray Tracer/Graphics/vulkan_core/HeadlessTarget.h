@@ -0,0 +1,52 @@
+#pragma once
+
+#include "Device.h"
+#include "Buffer.h"
+#include "SwapChain.h"
+
+#include <array>
+#include <memory>
+#include <string>
+
+namespace Core {
+
+	/*
+	 * Offscreen frame target
+	 * Takes the place of the swap chain on headless devices. Every frame slot owns a fence and a host visible
+	 * readback buffer; recordReadback copies the rendered image into the buffer of the slot and submit runs the
+	 * frame on the device queue, waiting for the one-shot work the frame depends on like SwapChain does.
+	 * The pixels of a slot can be read once waitFrame returned for it.
+	 */
+	class HeadlessTarget {
+	public:
+		//storage image support is mandatory for this format, it is also the format the swap chain prefers
+		static constexpr VkFormat FORMAT = VK_FORMAT_R32G32B32A32_SFLOAT;
+		static constexpr uint32_t PIXEL_SIZE = 4 * sizeof(float);
+
+		HeadlessTarget(Device& device, VkExtent2D extent);
+		~HeadlessTarget();
+
+		HeadlessTarget(const HeadlessTarget&) = delete;
+		HeadlessTarget operator=(const HeadlessTarget&) = delete;
+
+		//blocks until the previous frame of the slot completed
+		void waitFrame(uint32_t frameIndex);
+		//image has to be in VK_IMAGE_LAYOUT_GENERAL and written by ray tracing shaders
+		void recordReadback(VkCommandBuffer cmd, VkImage image, uint32_t frameIndex);
+		void submit(VkCommandBuffer cmd, uint32_t frameIndex);
+
+		//tightly packed FORMAT rows of the last completed frame of the slot
+		const float* getPixels(uint32_t frameIndex) const;
+		//clamped to [0, 1] and stored as binary PPM
+		void writeImage(const std::string& path, uint32_t frameIndex) const;
+
+		inline VkExtent2D getExtent() const { return extent; }
+		inline float extentAspectRatio() const { return static_cast<float>(extent.width) / static_cast<float>(extent.height); }
+	private:
+		Device& device;
+		VkExtent2D extent;
+
+		std::array<std::unique_ptr<Buffer>, SwapChain::MAX_FRAMES_IN_FLIGHT> readbackBuffers;
+		std::array<VkFence, SwapChain::MAX_FRAMES_IN_FLIGHT> fences{};
+	};
+}
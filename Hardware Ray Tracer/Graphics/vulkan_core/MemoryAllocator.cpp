@@ -0,0 +1,381 @@
+#include "MemoryAllocator.h"
+
+#include <algorithm>
+#include <bit>
+#include <stdexcept>
+
+static VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment) {
+	return (value + alignment - 1) / alignment * alignment;
+}
+
+Core::MemoryAllocator::MemoryAllocator(VkDevice device, VkPhysicalDevice physicalDevice) : device(device) {
+	vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+
+	//ranges of non-coherent memory are flushed whole, so they must not share an atom
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+	granularity = std::max(MIN_ALLOCATION, properties.limits.nonCoherentAtomSize);
+
+	pools.resize(memoryProperties.memoryTypeCount * 2);
+	for (uint32_t i = 0; i < pools.size(); i++) {
+		uint32_t memoryType = i / 2;
+		VkDeviceSize heapSize = memoryProperties.memoryHeaps[memoryProperties.memoryTypes[memoryType].heapIndex].size;
+
+		pools[i].memoryType = memoryType;
+		pools[i].linear = (i & 1) != 0;
+		//small heaps (like the 256 MiB BAR window) are not filled by a handful of blocks
+		pools[i].blockSize = std::min(DEFAULT_BLOCK_SIZE, alignUp(heapSize / 8, granularity));
+	}
+}
+
+Core::MemoryAllocator::~MemoryAllocator() {
+	for (Pool& pool : pools) {
+		for (std::unique_ptr<Block>& block : pool.blocks) {
+			if (block) destroyBlock(*block);
+		}
+	}
+
+	if (allocationCount > 0) std::cout << "[WARNING] MemoryAllocator: " << allocationCount << " allocations were not freed" << std::endl;
+}
+
+Core::Allocation Core::MemoryAllocator::allocate(const VkMemoryRequirements& requirements, uint32_t memoryType, bool linear, bool deviceAddress, const VkMemoryDedicatedAllocateInfo* dedicatedInfo, MemoryTag tag) {
+	std::lock_guard<std::mutex> lock(mutex);
+
+	uint32_t poolIndex = memoryType * 2 + (linear ? 1 : 0);
+	Pool& pool = pools[poolIndex];
+	VkDeviceSize size = alignUp(requirements.size, granularity);
+
+	if (dedicatedInfo || size > pool.blockSize / 2)
+		return allocateDedicated(requirements, memoryType, deviceAddress, dedicatedInfo, tag);
+
+	Allocation allocation{
+		.size = size,
+		.pool = poolIndex,
+		.tag = tag
+	};
+
+	for (uint32_t i = 0; i <= pool.blocks.size(); i++) {
+		if (i == pool.blocks.size()) {
+			//every block is full, reuse the slot of a released block or append a new one
+			auto empty = std::find(pool.blocks.begin(), pool.blocks.end(), nullptr);
+			i = static_cast<uint32_t>(empty - pool.blocks.begin());
+			if (empty == pool.blocks.end()) pool.blocks.push_back(createBlock(pool));
+			else *empty = createBlock(pool);
+
+			if (!allocateFromBlock(*pool.blocks[i], size, requirements.alignment, allocation.node, allocation.offset))
+				throw std::runtime_error("failed to sub-allocate from a new memory block!");
+		}
+		else if (!pool.blocks[i] || !allocateFromBlock(*pool.blocks[i], size, requirements.alignment, allocation.node, allocation.offset)) continue;
+
+		Block& block = *pool.blocks[i];
+		block.used += size;
+
+		allocation.memory = block.memory;
+		allocation.block = i;
+		allocation.mapped = block.mapped ? static_cast<uint8_t*>(block.mapped) + allocation.offset : nullptr;
+		break;
+	}
+
+	bytesPerTag[tag] += size;
+	allocationCount++;
+	return allocation;
+}
+
+void Core::MemoryAllocator::free(Allocation& allocation) {
+	if (allocation.memory == VK_NULL_HANDLE) return;
+	std::lock_guard<std::mutex> lock(mutex);
+
+	bytesPerTag[allocation.tag] -= allocation.size;
+	allocationCount--;
+
+	if (allocation.pool == UINT32_MAX) {
+		vkFreeMemory(device, allocation.memory, nullptr);
+		dedicatedCount--;
+		dedicatedBytes -= allocation.size;
+		allocation = Allocation{};
+		return;
+	}
+
+	Pool& pool = pools[allocation.pool];
+	Block& block = *pool.blocks[allocation.block];
+	freeNode(block, allocation.node);
+	block.used -= allocation.size;
+
+	//empty blocks are given back as long as the pool keeps another one for the next allocation
+	if (block.used == 0) {
+		size_t liveBlocks = std::count_if(pool.blocks.begin(), pool.blocks.end(), [](const std::unique_ptr<Block>& b) { return b != nullptr; });
+		if (liveBlocks > 1) {
+			destroyBlock(block);
+			pool.blocks[allocation.block].reset();
+		}
+	}
+
+	allocation = Allocation{};
+}
+
+Core::MemoryStats Core::MemoryAllocator::getStats() {
+	std::lock_guard<std::mutex> lock(mutex);
+
+	MemoryStats stats{
+		.blockCount = 0,
+		.dedicatedCount = dedicatedCount,
+		.allocationCount = allocationCount,
+		.blockBytes = 0,
+		.usedBytes = 0,
+		.dedicatedBytes = dedicatedBytes,
+		.largestFreeRange = 0,
+		.fragmentation = 0.0f,
+		.bytesPerTag = bytesPerTag
+	};
+
+	//sum of the largest free range of every block, each block would have to be one range to be unfragmented
+	VkDeviceSize largestPerBlock = 0;
+	for (const Pool& pool : pools) {
+		for (const std::unique_ptr<Block>& block : pool.blocks) {
+			if (!block) continue;
+			stats.blockCount++;
+			stats.blockBytes += block->size;
+			stats.usedBytes += block->used;
+
+			VkDeviceSize largest = 0;
+			for (const Node& node : block->nodes) {
+				if (node.free) largest = std::max(largest, node.size);
+			}
+			largestPerBlock += largest;
+			stats.largestFreeRange = std::max(stats.largestFreeRange, largest);
+		}
+	}
+
+	VkDeviceSize freeBytes = stats.blockBytes - stats.usedBytes;
+	if (freeBytes > 0) stats.fragmentation = 1.0f - static_cast<float>(static_cast<double>(largestPerBlock) / static_cast<double>(freeBytes));
+	return stats;
+}
+
+void Core::MemoryAllocator::printStats() {
+	static const char* tagNames[MEMORY_TAG_COUNT] = { "generic", "staging", "geometry", "acceleration structures", "images" };
+	constexpr double MIB = 1024.0 * 1024.0;
+
+	MemoryStats stats = getStats();
+	std::cout << "[INFO] Memory: " << stats.allocationCount << " allocations in " << stats.blockCount << " blocks (" << stats.usedBytes / MIB << " of " << stats.blockBytes / MIB << " MiB used, "
+		<< stats.fragmentation * 100.0f << "% fragmented) and " << stats.dedicatedCount << " dedicated allocations (" << stats.dedicatedBytes / MIB << " MiB)" << std::endl;
+
+	for (uint32_t i = 0; i < MEMORY_TAG_COUNT; i++) {
+		if (stats.bytesPerTag[i] > 0) std::cout << "[INFO] Memory: " << tagNames[i] << " " << stats.bytesPerTag[i] / MIB << " MiB" << std::endl;
+	}
+}
+
+Core::Allocation Core::MemoryAllocator::allocateDedicated(const VkMemoryRequirements& requirements, uint32_t memoryType, bool deviceAddress, const VkMemoryDedicatedAllocateInfo* dedicatedInfo, MemoryTag tag) {
+	VkMemoryAllocateFlagsInfo flagsInfo{
+		.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO,
+		.pNext = dedicatedInfo,
+		.flags = deviceAddress ? static_cast<VkMemoryAllocateFlags>(VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT) : 0u
+	};
+
+	VkMemoryAllocateInfo allocInfo{
+		.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+		.pNext = &flagsInfo,
+		.allocationSize = requirements.size,
+		.memoryTypeIndex = memoryType
+	};
+
+	Allocation allocation{
+		.size = requirements.size,
+		.tag = tag
+	};
+	VK_CHECK_RESULT(vkAllocateMemory(device, &allocInfo, nullptr, &allocation.memory), "failed to allocate dedicated memory!");
+
+	if (isHostVisible(memoryType))
+		VK_CHECK_RESULT(vkMapMemory(device, allocation.memory, 0, VK_WHOLE_SIZE, 0, &allocation.mapped), "failed to map dedicated memory!");
+
+	dedicatedCount++;
+	dedicatedBytes += allocation.size;
+	bytesPerTag[tag] += allocation.size;
+	allocationCount++;
+	return allocation;
+}
+
+std::unique_ptr<Core::MemoryAllocator::Block> Core::MemoryAllocator::createBlock(const Pool& pool) {
+	//blocks for buffers always get addresses, buffers without SHADER_DEVICE_ADDRESS usage just never query theirs
+	VkMemoryAllocateFlagsInfo flagsInfo{
+		.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO,
+		.flags = pool.linear ? static_cast<VkMemoryAllocateFlags>(VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT) : 0u
+	};
+
+	VkMemoryAllocateInfo allocInfo{
+		.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+		.pNext = &flagsInfo,
+		.allocationSize = pool.blockSize,
+		.memoryTypeIndex = pool.memoryType
+	};
+
+	auto block = std::make_unique<Block>();
+	block->size = pool.blockSize;
+	block->used = 0;
+	block->mapped = nullptr;
+	block->firstLevelBitmap = 0;
+	block->secondLevelBitmaps.fill(0);
+	block->freeHeads.fill(NO_NODE);
+
+	VK_CHECK_RESULT(vkAllocateMemory(device, &allocInfo, nullptr, &block->memory), "failed to allocate memory block!");
+	if (isHostVisible(pool.memoryType))
+		VK_CHECK_RESULT(vkMapMemory(device, block->memory, 0, VK_WHOLE_SIZE, 0, &block->mapped), "failed to map memory block!");
+
+	insertFree(*block, createNode(*block, 0, block->size));
+	return block;
+}
+
+void Core::MemoryAllocator::destroyBlock(Block& block) {
+	//freeing implicitly unmaps
+	vkFreeMemory(device, block.memory, nullptr);
+	block.memory = VK_NULL_HANDLE;
+}
+
+bool Core::MemoryAllocator::allocateFromBlock(Block& block, VkDeviceSize size, VkDeviceSize alignment, uint32_t& node, VkDeviceSize& offset) {
+	//every range starts at a multiple of granularity, larger alignments may need padding in front
+	VkDeviceSize padding = alignment > granularity ? alignment - granularity : 0;
+	node = findFree(block, size + padding);
+	if (node == NO_NODE) return false;
+	removeFree(block, node);
+
+	offset = alignUp(block.nodes[node].offset, alignment);
+	VkDeviceSize front = offset - block.nodes[node].offset;
+	if (front > 0) {
+		uint32_t frontNode = createNode(block, block.nodes[node].offset, front);
+		block.nodes[frontNode].prevPhysical = block.nodes[node].prevPhysical;
+		block.nodes[frontNode].nextPhysical = node;
+		if (block.nodes[node].prevPhysical != NO_NODE) block.nodes[block.nodes[node].prevPhysical].nextPhysical = frontNode;
+
+		block.nodes[node].prevPhysical = frontNode;
+		block.nodes[node].offset = offset;
+		block.nodes[node].size -= front;
+		insertFree(block, frontNode);
+	}
+
+	VkDeviceSize rest = block.nodes[node].size - size;
+	if (rest >= granularity) {
+		uint32_t restNode = createNode(block, offset + size, rest);
+		block.nodes[restNode].prevPhysical = node;
+		block.nodes[restNode].nextPhysical = block.nodes[node].nextPhysical;
+		if (block.nodes[node].nextPhysical != NO_NODE) block.nodes[block.nodes[node].nextPhysical].prevPhysical = restNode;
+
+		block.nodes[node].nextPhysical = restNode;
+		block.nodes[node].size = size;
+		insertFree(block, restNode);
+	}
+
+	block.nodes[node].free = false;
+	return true;
+}
+
+void Core::MemoryAllocator::freeNode(Block& block, uint32_t node) {
+	//merge with the free physical neighbours, the merged range keeps the lower node
+	uint32_t prev = block.nodes[node].prevPhysical;
+	if (prev != NO_NODE && block.nodes[prev].free) {
+		removeFree(block, prev);
+		block.nodes[prev].size += block.nodes[node].size;
+		block.nodes[prev].nextPhysical = block.nodes[node].nextPhysical;
+		if (block.nodes[node].nextPhysical != NO_NODE) block.nodes[block.nodes[node].nextPhysical].prevPhysical = prev;
+
+		block.nodes[node] = Node{ .free = false };
+		block.unusedNodes.push_back(node);
+		node = prev;
+	}
+
+	uint32_t next = block.nodes[node].nextPhysical;
+	if (next != NO_NODE && block.nodes[next].free) {
+		removeFree(block, next);
+		block.nodes[node].size += block.nodes[next].size;
+		block.nodes[node].nextPhysical = block.nodes[next].nextPhysical;
+		if (block.nodes[next].nextPhysical != NO_NODE) block.nodes[block.nodes[next].nextPhysical].prevPhysical = node;
+
+		block.nodes[next] = Node{ .free = false };
+		block.unusedNodes.push_back(next);
+	}
+
+	insertFree(block, node);
+}
+
+uint32_t Core::MemoryAllocator::createNode(Block& block, VkDeviceSize offset, VkDeviceSize size) {
+	Node node{
+		.offset = offset,
+		.size = size,
+		.prevPhysical = NO_NODE,
+		.nextPhysical = NO_NODE,
+		.prevFree = NO_NODE,
+		.nextFree = NO_NODE,
+		.free = false
+	};
+
+	if (!block.unusedNodes.empty()) {
+		uint32_t index = block.unusedNodes.back();
+		block.unusedNodes.pop_back();
+		block.nodes[index] = node;
+		return index;
+	}
+
+	block.nodes.push_back(node);
+	return static_cast<uint32_t>(block.nodes.size() - 1);
+}
+
+void Core::MemoryAllocator::insertFree(Block& block, uint32_t node) {
+	uint32_t fl, sl;
+	mapping(block.nodes[node].size, fl, sl);
+	uint32_t& head = block.freeHeads[fl * SL_COUNT + sl];
+
+	block.nodes[node].free = true;
+	block.nodes[node].prevFree = NO_NODE;
+	block.nodes[node].nextFree = head;
+	if (head != NO_NODE) block.nodes[head].prevFree = node;
+	head = node;
+
+	block.firstLevelBitmap |= 1ull << fl;
+	block.secondLevelBitmaps[fl] |= 1u << sl;
+}
+
+void Core::MemoryAllocator::removeFree(Block& block, uint32_t node) {
+	uint32_t fl, sl;
+	mapping(block.nodes[node].size, fl, sl);
+	Node& removed = block.nodes[node];
+
+	if (removed.prevFree != NO_NODE) block.nodes[removed.prevFree].nextFree = removed.nextFree;
+	else block.freeHeads[fl * SL_COUNT + sl] = removed.nextFree;
+	if (removed.nextFree != NO_NODE) block.nodes[removed.nextFree].prevFree = removed.prevFree;
+
+	removed.free = false;
+	removed.prevFree = removed.nextFree = NO_NODE;
+
+	if (block.freeHeads[fl * SL_COUNT + sl] == NO_NODE) {
+		block.secondLevelBitmaps[fl] &= ~(1u << sl);
+		if (block.secondLevelBitmaps[fl] == 0) block.firstLevelBitmap &= ~(1ull << fl);
+	}
+}
+
+uint32_t Core::MemoryAllocator::findFree(Block& block, VkDeviceSize size) {
+	if (size > block.size) return NO_NODE;
+
+	//rounded up to the next size class, so every range of the class found is large enough
+	size += (1ull << (std::bit_width(size) - 1 - SL_COUNT_LOG2)) - 1;
+	uint32_t fl, sl;
+	mapping(size, fl, sl);
+
+	uint32_t secondLevel = block.secondLevelBitmaps[fl] & (~0u << sl);
+	if (secondLevel == 0) {
+		uint64_t firstLevel = fl + 1 < FL_COUNT ? block.firstLevelBitmap & (~0ull << (fl + 1)) : 0;
+		if (firstLevel == 0) return NO_NODE;
+
+		fl = std::countr_zero(firstLevel);
+		secondLevel = block.secondLevelBitmaps[fl];
+	}
+
+	return block.freeHeads[fl * SL_COUNT + std::countr_zero(secondLevel)];
+}
+
+void Core::MemoryAllocator::mapping(VkDeviceSize size, uint32_t& fl, uint32_t& sl) {
+	//sizes are at least MIN_ALLOCATION, so the first level is always larger than SL_COUNT_LOG2
+	fl = static_cast<uint32_t>(std::bit_width(size) - 1);
+	sl = static_cast<uint32_t>(size >> (fl - SL_COUNT_LOG2)) - SL_COUNT;
+}
+
+bool Core::MemoryAllocator::isHostVisible(uint32_t memoryType) const {
+	return (memoryProperties.memoryTypes[memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) != 0;
+}
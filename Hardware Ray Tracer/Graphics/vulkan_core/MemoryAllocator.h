@@ -0,0 +1,135 @@
+#pragma once
+
+#include "../Definitions.h"
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace Core {
+	//what an allocation is used for, only used for statistics
+	enum MemoryTag : uint32_t {
+		MEMORY_TAG_GENERIC,
+		MEMORY_TAG_STAGING,
+		MEMORY_TAG_GEOMETRY,
+		MEMORY_TAG_ACCELERATION_STRUCTURE,
+		MEMORY_TAG_IMAGE,
+		MEMORY_TAG_COUNT
+	};
+
+	struct Allocation {
+		VkDeviceMemory memory = VK_NULL_HANDLE;
+		VkDeviceSize offset = 0; //offset of the resource inside memory
+		VkDeviceSize size = 0;
+		void* mapped = nullptr; //host pointer to offset if the memory type is host visible
+
+		uint32_t pool = UINT32_MAX; //UINT32_MAX for dedicated allocations
+		uint32_t block = 0;
+		uint32_t node = 0;
+		MemoryTag tag = MEMORY_TAG_GENERIC;
+	};
+
+	struct MemoryStats {
+		uint32_t blockCount;
+		uint32_t dedicatedCount;
+		uint32_t allocationCount; //sub-allocations and dedicated allocations
+		VkDeviceSize blockBytes; //memory reserved by blocks
+		VkDeviceSize usedBytes; //sub-allocated from blocks
+		VkDeviceSize dedicatedBytes;
+		VkDeviceSize largestFreeRange;
+		float fragmentation; //1 - sum of the largest free range of every block / free bytes, 0 if every block has one free range
+		std::array<VkDeviceSize, MEMORY_TAG_COUNT> bytesPerTag;
+	};
+
+	/*
+	 * Device memory sub-allocator
+	 * Memory is reserved in large blocks per memory type, buffers and optimally tiled images use separate blocks
+	 * so bufferImageGranularity never has to be considered. Ranges inside a block are placed with a two level
+	 * segregated fit (TLSF) allocator: free ranges are binned by the power of two of their size and 16 linear
+	 * subdivisions, a bitmap per level finds a fitting range in constant time and freed ranges are merged with
+	 * their physical neighbours right away.
+	 * Resources that are large compared to a block or that the driver wants dedicated get their own memory.
+	 * Host visible blocks stay mapped for their whole lifetime.
+	 */
+	class MemoryAllocator {
+	public:
+		static constexpr VkDeviceSize DEFAULT_BLOCK_SIZE = 64ull << 20;
+		static constexpr VkDeviceSize MIN_ALLOCATION = 256; //granularity of all ranges, keeps offsets aligned for most resources
+
+		MemoryAllocator(VkDevice device, VkPhysicalDevice physicalDevice);
+		~MemoryAllocator();
+
+		MemoryAllocator(const MemoryAllocator&) = delete;
+		MemoryAllocator operator=(const MemoryAllocator&) = delete;
+
+		//dedicatedInfo is chained into the allocation if the resource should get its own memory
+		Allocation allocate(const VkMemoryRequirements& requirements, uint32_t memoryType, bool linear, bool deviceAddress, const VkMemoryDedicatedAllocateInfo* dedicatedInfo, MemoryTag tag);
+		void free(Allocation& allocation);
+
+		MemoryStats getStats();
+		void printStats();
+	private:
+		static constexpr uint32_t SL_COUNT_LOG2 = 4;
+		static constexpr uint32_t SL_COUNT = 1 << SL_COUNT_LOG2;
+		static constexpr uint32_t FL_COUNT = 64;
+		static constexpr uint32_t NO_NODE = UINT32_MAX;
+
+		//physically neighbouring ranges are linked to merge them, free ranges are linked per size class
+		struct Node {
+			VkDeviceSize offset;
+			VkDeviceSize size;
+			uint32_t prevPhysical;
+			uint32_t nextPhysical;
+			uint32_t prevFree;
+			uint32_t nextFree;
+			bool free;
+		};
+
+		struct Block {
+			VkDeviceMemory memory;
+			void* mapped;
+			VkDeviceSize size;
+			VkDeviceSize used;
+
+			std::vector<Node> nodes;
+			std::vector<uint32_t> unusedNodes;
+			uint64_t firstLevelBitmap;
+			std::array<uint32_t, FL_COUNT> secondLevelBitmaps;
+			std::array<uint32_t, FL_COUNT * SL_COUNT> freeHeads;
+		};
+
+		struct Pool {
+			uint32_t memoryType;
+			bool linear; //buffers, optimally tiled images use the other pool of the memory type
+			VkDeviceSize blockSize;
+			std::vector<std::unique_ptr<Block>> blocks; //null entries were released and may be reused
+		};
+
+		Allocation allocateDedicated(const VkMemoryRequirements& requirements, uint32_t memoryType, bool deviceAddress, const VkMemoryDedicatedAllocateInfo* dedicatedInfo, MemoryTag tag);
+		std::unique_ptr<Block> createBlock(const Pool& pool);
+		void destroyBlock(Block& block);
+		bool allocateFromBlock(Block& block, VkDeviceSize size, VkDeviceSize alignment, uint32_t& node, VkDeviceSize& offset);
+		void freeNode(Block& block, uint32_t node);
+
+		uint32_t createNode(Block& block, VkDeviceSize offset, VkDeviceSize size);
+		void insertFree(Block& block, uint32_t node);
+		void removeFree(Block& block, uint32_t node);
+		uint32_t findFree(Block& block, VkDeviceSize size);
+
+		static void mapping(VkDeviceSize size, uint32_t& fl, uint32_t& sl);
+		bool isHostVisible(uint32_t memoryType) const;
+	private:
+		VkDevice device;
+		VkPhysicalDeviceMemoryProperties memoryProperties;
+		VkDeviceSize granularity;
+
+		std::mutex mutex;
+		std::vector<Pool> pools; //memoryType * 2 + linear
+		std::array<VkDeviceSize, MEMORY_TAG_COUNT> bytesPerTag{};
+		uint32_t dedicatedCount = 0;
+		uint32_t allocationCount = 0;
+		VkDeviceSize dedicatedBytes = 0;
+	};
+}
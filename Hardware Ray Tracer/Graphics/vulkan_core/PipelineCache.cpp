@@ -0,0 +1,107 @@
+#include "PipelineCache.h"
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+Core::PipelineCache::PipelineCache(Device& device, const std::string& path, std::span<const char> shaderCode)
+	: device(device),
+	path(path),
+	shaderHash(hash(shaderCode)) {
+
+	std::vector<char> data = load();
+	warm = !data.empty();
+
+	VkPipelineCacheCreateInfo cacheInfo{
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO,
+		.initialDataSize = data.size(),
+		.pInitialData = data.empty() ? nullptr : data.data()
+	};
+	VK_CHECK_RESULT(vkCreatePipelineCache(device.getDevice(), &cacheInfo, nullptr, &cache), "failed to create pipeline cache!");
+}
+
+Core::PipelineCache::~PipelineCache() {
+	save();
+	vkDestroyPipelineCache(device.getDevice(), cache, nullptr);
+}
+
+void Core::PipelineCache::save() {
+	try {
+		size_t dataSize = 0;
+		VK_CHECK_RESULT(vkGetPipelineCacheData(device.getDevice(), cache, &dataSize, nullptr), "failed to query pipeline cache size!");
+		std::vector<char> data(dataSize);
+		VK_CHECK_RESULT(vkGetPipelineCacheData(device.getDevice(), cache, &dataSize, data.data()), "failed to read pipeline cache!");
+
+		PipelineCacheHeader header = createHeader(dataSize);
+
+		//write to a temporary file first so an interrupted write never leaves a truncated cache behind
+		std::string tempPath = path + ".tmp";
+		{
+			std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+			if (!out.is_open()) throw std::runtime_error("failed to open " + tempPath);
+
+			out.write(reinterpret_cast<const char*>(&header), sizeof(PipelineCacheHeader));
+			out.write(data.data(), dataSize);
+
+			if (!out) throw std::runtime_error("failed to write " + tempPath);
+		}
+
+		std::filesystem::rename(tempPath, path);
+	} catch (const std::exception& e) {
+		std::cout << "[WARNING] PipelineCache: failed to write " << path << ": " << e.what() << std::endl;
+	}
+}
+
+uint64_t Core::PipelineCache::hash(std::span<const char> data) {
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	for (char c : data)
+		hash = (hash ^ static_cast<uint8_t>(c)) * 0x100000001b3ULL;
+	return hash;
+}
+
+std::vector<char> Core::PipelineCache::load() {
+	std::ifstream in(path, std::ios::ate | std::ios::binary);
+	if (!in.is_open()) {
+		std::cout << "[INFO] PipelineCache: no cache at " << path << ", starting cold" << std::endl;
+		return {};
+	}
+
+	size_t fileSize = static_cast<size_t>(in.tellg());
+	in.seekg(0);
+
+	PipelineCacheHeader header{};
+	if (fileSize < sizeof(PipelineCacheHeader) || !in.read(reinterpret_cast<char*>(&header), sizeof(PipelineCacheHeader))) {
+		std::cout << "[WARNING] PipelineCache: " << path << " is truncated, starting cold" << std::endl;
+		return {};
+	}
+
+	PipelineCacheHeader expected = createHeader(header.dataSize);
+	if (memcmp(&header, &expected, sizeof(PipelineCacheHeader)) != 0) {
+		std::cout << "[INFO] PipelineCache: " << path << " was written for another device, driver or shader, starting cold" << std::endl;
+		return {};
+	}
+
+	if (header.dataSize > fileSize - sizeof(PipelineCacheHeader)) {
+		std::cout << "[WARNING] PipelineCache: " << path << " is truncated, starting cold" << std::endl;
+		return {};
+	}
+
+	std::vector<char> data(header.dataSize);
+	if (!in.read(data.data(), data.size())) return {};
+	return data;
+}
+
+Core::PipelineCacheHeader Core::PipelineCache::createHeader(uint64_t dataSize) const {
+	PipelineCacheHeader header{
+		.magic = MAGIC,
+		.version = VERSION,
+		.vendorID = device.properties.vendorID,
+		.deviceID = device.properties.deviceID,
+		.driverVersion = device.properties.driverVersion,
+		.reserved = 0,
+		.shaderHash = shaderHash,
+		.dataSize = dataSize
+	};
+	memcpy(header.pipelineCacheUUID, device.properties.pipelineCacheUUID, VK_UUID_SIZE);
+	return header;
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "Device.h"
+
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace Core {
+	struct PipelineCacheHeader {
+		uint32_t magic;
+		uint32_t version;
+		uint32_t vendorID;
+		uint32_t deviceID;
+		uint32_t driverVersion;
+		uint32_t reserved;
+		uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+
+		uint64_t shaderHash; //hash of the SPIR-V the cached pipelines were created from
+		uint64_t dataSize; //byte size of the driver blob following the header
+	};
+
+	/*
+	 * On-disk VkPipelineCache
+	 * The driver blob is stored behind a header keyed by the device UUID, the driver version and a hash of the
+	 * SPIR-V. A file with a different key is ignored and the cache starts empty, so a driver update or a shader
+	 * rebuild never hands stale data to the driver. save writes to a temporary file and renames it over the
+	 * previous cache, an interrupted write leaves the old cache intact.
+	 */
+	class PipelineCache {
+	public:
+		static constexpr uint32_t MAGIC = 0x43504C42; //"BLPC"
+		static constexpr uint32_t VERSION = 1;
+
+		PipelineCache(Device& device, const std::string& path, std::span<const char> shaderCode);
+		~PipelineCache();
+
+		PipelineCache(const PipelineCache&) = delete;
+		PipelineCache operator=(const PipelineCache&) = delete;
+
+		//writes the current content of the cache, failures are logged since a missing cache only costs startup time
+		void save();
+		//keys the next save to shaderCode after the pipelines were recreated from it, older entries stay in the blob
+		inline void rekey(std::span<const char> shaderCode) { shaderHash = hash(shaderCode); }
+
+		inline VkPipelineCache getCache() const { return cache; }
+		//true if the cache was created from a matching file
+		inline bool isWarm() const { return warm; }
+
+		static uint64_t hash(std::span<const char> data);
+	private:
+		std::vector<char> load();
+		PipelineCacheHeader createHeader(uint64_t dataSize) const;
+	private:
+		Device& device;
+		std::string path;
+		uint64_t shaderHash;
+
+		VkPipelineCache cache = VK_NULL_HANDLE;
+		bool warm = false;
+	};
+}
@@ -0,0 +1,136 @@
+#include "StagingRing.h"
+
+#include <algorithm>
+#include <cstring>
+
+Core::StagingRing::StagingRing(Device& device, VkDeviceSize size) : device(device), size(size) {
+	device.createBuffer(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &buffer, &memory);
+	if (!memory.mapped) throw std::runtime_error("failed to map staging ring!");
+	mapped = static_cast<uint8_t*>(memory.mapped);
+
+	VkCommandPoolCreateInfo poolInfo{
+		.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+		.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
+		.queueFamilyIndex = device.getQueueFamily(QUEUE_TRANSFER)
+	};
+	VK_CHECK_RESULT(vkCreateCommandPool(device.getDevice(), &poolInfo, nullptr, &commandPool), "failed to create staging command pool!");
+}
+
+Core::StagingRing::~StagingRing() {
+	waitIdle();
+
+	vkDestroyCommandPool(device.getDevice(), commandPool, nullptr);
+
+	vkDestroyBuffer(device.getDevice(), buffer, nullptr);
+	device.freeMemory(memory);
+}
+
+void Core::StagingRing::upload(VkBuffer dstBuffer, VkDeviceSize dstOffset, const void* data, VkDeviceSize dataSize) {
+	//uploads larger than half the ring are split, so a chunk always fits once the ring has drained
+	VkDeviceSize maxChunk = size / 2;
+
+	for (VkDeviceSize done = 0; done < dataSize;) {
+		VkDeviceSize chunk = std::min(dataSize - done, maxChunk);
+		VkDeviceSize offset = reserve(chunk);
+
+		memcpy(mapped + offset, static_cast<const uint8_t*>(data) + done, chunk);
+		pending.push_back(PendingCopy{ dstBuffer, VkBufferCopy{ .srcOffset = offset, .dstOffset = dstOffset + done, .size = chunk } });
+		done += chunk;
+	}
+}
+
+Core::GpuTicket Core::StagingRing::flush() {
+	if (pending.empty()) return lastTicket;
+
+	Submission submission{ .commandBuffer = acquireCommandBuffer() };
+
+	VkCommandBufferBeginInfo beginInfo{ .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO, .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT };
+	VK_CHECK_RESULT(vkBeginCommandBuffer(submission.commandBuffer, &beginInfo), "failed to begin staging command buffer!");
+
+	//one vkCmdCopyBuffer per destination, upload order is kept within a destination
+	std::stable_sort(pending.begin(), pending.end(), [](const PendingCopy& a, const PendingCopy& b) { return a.dstBuffer < b.dstBuffer; });
+	for (size_t first = 0; first < pending.size();) {
+		size_t end = first;
+		for (; end < pending.size() && pending[end].dstBuffer == pending[first].dstBuffer; end++)
+			regions.push_back(pending[end].region);
+
+		vkCmdCopyBuffer(submission.commandBuffer, buffer, pending[first].dstBuffer, static_cast<uint32_t>(regions.size()), regions.data());
+		regions.clear();
+		first = end;
+	}
+
+	VK_CHECK_RESULT(vkEndCommandBuffer(submission.commandBuffer), "failed to record staging command buffer!");
+
+	submission.ticket = device.submit(submission.commandBuffer, {}, QUEUE_TRANSFER);
+	submission.end = head;
+	inFlight.push_back(submission);
+	pending.clear();
+	submissionCount++;
+
+	lastTicket = submission.ticket;
+	return lastTicket;
+}
+
+void Core::StagingRing::waitIdle() {
+	flush();
+	while (!inFlight.empty())
+		waitOldest();
+}
+
+VkDeviceSize Core::StagingRing::reserve(VkDeviceSize dataSize) {
+	VkDeviceSize alignedSize = (dataSize + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+
+	for (;;) {
+		reclaim();
+
+		//a reservation never wraps, the rest of the ring is skipped instead
+		VkDeviceSize position = head % size;
+		VkDeviceSize padding = position + alignedSize > size ? size - position : 0;
+		if (head + padding + alignedSize - tail <= size) {
+			head += padding;
+			VkDeviceSize offset = head % size;
+			head += alignedSize;
+			return offset;
+		}
+
+		//the space is held by queued copies or by submissions the GPU has not finished yet
+		flush();
+		waitOldest();
+	}
+}
+
+void Core::StagingRing::reclaim() {
+	while (!inFlight.empty() && device.isComplete(inFlight.front().ticket)) {
+		tail = inFlight.front().end;
+		freeCommandBuffers.push_back(inFlight.front().commandBuffer);
+		inFlight.pop_front();
+	}
+
+	//restart at the beginning of the ring once it drained, large reservations never have to skip
+	if (inFlight.empty() && pending.empty()) head = tail = 0;
+}
+
+void Core::StagingRing::waitOldest() {
+	if (inFlight.empty()) return;
+
+	device.wait(inFlight.front().ticket);
+	reclaim();
+}
+
+VkCommandBuffer Core::StagingRing::acquireCommandBuffer() {
+	if (!freeCommandBuffers.empty()) {
+		VkCommandBuffer commandBuffer = freeCommandBuffers.back();
+		freeCommandBuffers.pop_back();
+		return commandBuffer;
+	}
+
+	VkCommandBufferAllocateInfo allocInfo{
+		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+		.commandPool = commandPool,
+		.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+		.commandBufferCount = 1
+	};
+	VkCommandBuffer commandBuffer;
+	VK_CHECK_RESULT(vkAllocateCommandBuffers(device.getDevice(), &allocInfo, &commandBuffer), "failed to allocate staging command buffer!");
+	return commandBuffer;
+}
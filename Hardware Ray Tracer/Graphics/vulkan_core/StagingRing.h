@@ -0,0 +1,76 @@
+#pragma once
+
+#include "Device.h"
+
+#include <deque>
+#include <vector>
+
+namespace Core {
+
+	/*
+	 * Persistently mapped staging ring buffer
+	 * Uploads reserve space at the head of the ring, copy their data into it and queue a copy region towards their
+	 * destination buffer. flush records every queued copy into one command buffer, grouped by destination, and
+	 * submits it to the transfer queue without waiting. Space is reclaimed from the tail once the ticket of its
+	 * submission is reached; a reservation that does not fit flushes and waits for the oldest submission.
+	 * Work that reads uploaded data waits for the ticket of flush, Device::submitSingleTimeCommands does so on its own.
+	 * The ring is not thread safe.
+	 */
+	class StagingRing {
+	public:
+		static constexpr VkDeviceSize DEFAULT_SIZE = 64ull << 20;
+		static constexpr VkDeviceSize ALIGNMENT = 16;
+
+		StagingRing(Device& device, VkDeviceSize size = DEFAULT_SIZE);
+		~StagingRing();
+
+		StagingRing(const StagingRing&) = delete;
+		StagingRing operator=(const StagingRing&) = delete;
+
+		//data is copied right away, the copy into dstBuffer is executed by the next flush
+		void upload(VkBuffer dstBuffer, VkDeviceSize dstOffset, const void* data, VkDeviceSize dataSize);
+		//submits all queued copies without waiting, the ticket is reached once every upload so far has arrived
+		GpuTicket flush();
+		//blocks until every submitted copy has finished
+		void waitIdle();
+
+		inline bool hasPending() const { return !pending.empty(); }
+		inline uint32_t getSubmissionCount() const { return submissionCount; }
+	private:
+		struct PendingCopy {
+			VkBuffer dstBuffer;
+			VkBufferCopy region;
+		};
+
+		struct Submission {
+			VkCommandBuffer commandBuffer;
+			GpuTicket ticket;
+			uint64_t end; //head of the ring when the submission was made, tail moves here once it completed
+		};
+
+		VkDeviceSize reserve(VkDeviceSize dataSize);
+		void reclaim();
+		void waitOldest();
+		VkCommandBuffer acquireCommandBuffer();
+	private:
+		Device& device;
+		VkDeviceSize size;
+
+		VkBuffer buffer = VK_NULL_HANDLE;
+		Allocation memory;
+		uint8_t* mapped = nullptr;
+
+		//monotonic byte counters, the position in the ring is the counter modulo size
+		uint64_t head = 0;
+		uint64_t tail = 0;
+
+		VkCommandPool commandPool = VK_NULL_HANDLE;
+		std::deque<Submission> inFlight;
+		std::vector<VkCommandBuffer> freeCommandBuffers;
+		GpuTicket lastTicket;
+
+		std::vector<PendingCopy> pending;
+		std::vector<VkBufferCopy> regions;
+		uint32_t submissionCount = 0;
+	};
+}
@@ -25,7 +25,7 @@ Core::SwapChain::~SwapChain() {
 	for (int i = 0; i < depthImages.size(); i++) {
 		vkDestroyImageView(device.getDevice(), depthImageViews[i], nullptr);
 		vkDestroyImage(device.getDevice(), depthImages[i], nullptr);
-		vkFreeMemory(device.getDevice(), depthImageMemorys[i], nullptr);
+		device.freeMemory(depthImageMemorys[i]);
 	}
 
 	for (auto framebuffer : swapChainFramebuffers) {
@@ -94,11 +94,35 @@ VkResult Core::SwapChain::submitCommandBuffers(const VkCommandBuffer* buffers, u
 		vkWaitForFences(device.getDevice(), 1, &imagesInFlight[*imageIndex], VK_TRUE, std::numeric_limits<uint64_t>::max());
 	}
 	imagesInFlight[*imageIndex] = inFlightFences[currentFrame];
+	//one-shot work of the graphics queue is waited for as a whole, the other queues only for the work the frame depends on,
+	//so streaming uploads and builds keep running next to the frame
+	std::array<GpuTicket, QUEUE_COUNT> dependencies = device.takeFrameDependencies();
+	dependencies[QUEUE_GRAPHICS] = device.lastSubmission(QUEUE_GRAPHICS);
+
+	VkSemaphore waitSemaphores[1 + QUEUE_COUNT] = { imageAvailableSemaphores[currentFrame] };
+	uint64_t waitValues[1 + QUEUE_COUNT] = { 0 };
+	VkPipelineStageFlags waitStages[1 + QUEUE_COUNT] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
+	uint32_t waitCount = 1;
+	for (uint32_t i = 0; i < QUEUE_COUNT; i++) {
+		if (dependencies[i].value == 0) continue;
+
+		waitSemaphores[waitCount] = device.getTimeline(static_cast<QueueType>(i));
+		waitValues[waitCount] = dependencies[i].value;
+		waitStages[waitCount] = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+		waitCount++;
+	}
+
+	VkTimelineSemaphoreSubmitInfo timelineInfo{
+		.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+		.waitSemaphoreValueCount = waitCount,
+		.pWaitSemaphoreValues = waitValues
+	};
+
 	VkSubmitInfo submitInfo = {};
 	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-	VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
-	submitInfo.waitSemaphoreCount = 1;
-	submitInfo.pWaitSemaphores = &imageAvailableSemaphores[currentFrame];
+	submitInfo.pNext = &timelineInfo;
+	submitInfo.waitSemaphoreCount = waitCount;
+	submitInfo.pWaitSemaphores = waitSemaphores;
 	submitInfo.pWaitDstStageMask = waitStages;
 	submitInfo.commandBufferCount = 1;
 	submitInfo.pCommandBuffers = buffers;
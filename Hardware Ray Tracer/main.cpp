@@ -1,8 +1,44 @@
 #include "Graphics/RayTracing/RTApp.h"
+#include "Graphics/RayTracing/HeadlessApp.h"
 
-int main() {
+#include <cstdlib>
+#include <cstring>
+
+static uint32_t parseCount(const char* name, const char* value) {
+	char* end = nullptr;
+	unsigned long count = strtoul(value, &end, 10);
+	if (end == value || *end != '\0') throw std::runtime_error(std::string("invalid value for ") + name + ": " + value);
+	return static_cast<uint32_t>(count);
+}
+
+//--headless [--width N] [--height N] [--frames N] [--output path] renders offscreen without a window
+static bool parseHeadlessSettings(int argc, char** argv, RayTracing::HeadlessSettings& settings) {
+	bool headless = false;
+	for (int i = 1; i < argc; i++) {
+		bool hasValue = i + 1 < argc;
+		if (strcmp(argv[i], "--headless") == 0) headless = true;
+		else if (strcmp(argv[i], "--width") == 0 && hasValue) settings.width = parseCount(argv[i], argv[i + 1]), i++;
+		else if (strcmp(argv[i], "--height") == 0 && hasValue) settings.height = parseCount(argv[i], argv[i + 1]), i++;
+		else if (strcmp(argv[i], "--frames") == 0 && hasValue) settings.frames = parseCount(argv[i], argv[i + 1]), i++;
+		else if (strcmp(argv[i], "--output") == 0 && hasValue) settings.output = argv[++i];
+		else throw std::runtime_error(std::string("unknown argument ") + argv[i]);
+	}
+
+	if (settings.width == 0 || settings.height == 0) throw std::runtime_error("headless resolution has to be non-zero");
+	return headless;
+}
+
+int main(int argc, char** argv) {
 
 	try {
+		RayTracing::HeadlessSettings settings;
+		if (parseHeadlessSettings(argc, argv, settings)) {
+			RayTracing::HeadlessApp app(settings);
+
+			app.run();
+			return EXIT_SUCCESS;
+		}
+
 		RayTracing::RTApp app;
 
 		app.run();
@@ -11,4 +47,4 @@ int main() {
 		system("pause");
 		return EXIT_FAILURE;
 	}
-}
\ No newline at end of file
+}